@@ -0,0 +1,113 @@
+--[[
+ BasicRawTest.lua
+
+ Copyright (C) 2016 Thermo Fisher Scientific
+
+ This software may be modified and distributed under the terms
+ of the MIT license.  See the LICENSE file for details.
+--]]
+
+-- Regression checks of a reader against example/Basic.raw
+--
+--	rawfile_bench BasicRawTest.lua path/to/Basic.raw [backend]
+--
+-- Stops at the first failed check, so rawfile_bench exits with an error.
+
+local RawFile = require("LuaRawFile")
+
+local path = assert(arg[1], "Expecting the path of Basic.raw")
+local backend = arg[2] or "native"
+
+local rawFile = assert(RawFile.New(path, backend))
+assert(rawFile:Open(), "Couldn't open " .. path .. " with " .. backend)
+
+local function near(a, b, tolerance)
+	return math.abs(a - b) <= tolerance * math.max(math.abs(a), math.abs(b), 1)
+end
+
+-- The run: three Orbitrap survey scans and 62 ion trap MS2
+assert(rawFile.FirstSpectrumNumber == 1 and rawFile.LastSpectrumNumber == 65,
+	"Scan range " .. rawFile.FirstSpectrumNumber .. "-" .. rawFile.LastSpectrumNumber)
+assert(rawFile:GetInstModel() == "Orbitrap Fusion", "Instrument model " .. tostring(rawFile:GetInstModel()))
+
+local ms1 = { [1] = true, [2] = true, [63] = true }
+assert(rawFile:GetScanFilter(9) == "ITMS + p ESI d Full ms2 537.8787@hcd25.00 [120.0000-548.0000]",
+	"Filter of scan 9 " .. rawFile:GetScanFilter(9))
+for sn = 1, 65 do
+	local filter = rawFile:GetScanFilter(sn)
+	if ms1[sn] then
+		assert(filter == "FTMS + p ESI Full ms [150.0000-1000.0000]", "Filter of scan " .. sn .. " " .. filter)
+		assert(rawFile:GetMSNOrder(sn) == 1, "MS order of scan " .. sn)
+	else
+		assert(filter:find("^ITMS %+ p ESI d Full ms2 [%d.]+@hcd25%.00 %[120%.0000%-[%d.]+%]$"),
+			"Filter of scan " .. sn .. " " .. filter)
+		assert(rawFile:GetMSNOrder(sn) == 2, "MS order of scan " .. sn)
+	end
+end
+
+-- The header TIC is the sum of the label data, which the ion trap scans
+-- don't have, so theirs is the sum of the profile
+for sn = 1, 65 do
+	local tic = rawFile:GetScanHeader(sn).TIC
+	local labels = rawFile:GetLabelData(sn)
+	assert((#labels > 0) == (ms1[sn] == true), "Label data of scan " .. sn)
+	local sum = 0
+	if #labels > 0 then
+		for _, peak in ipairs(labels) do
+			sum = sum + peak.Intensity
+		end
+	else
+		for _, peak in ipairs(rawFile:GetSpectrum(sn)) do
+			sum = sum + peak.Intensity
+		end
+	end
+	assert(near(tic, sum, 1e-6), "TIC of scan " .. sn .. " " .. tic .. " is not the sum " .. sum)
+end
+
+-- The MS trace is the TIC by default, one point a scan
+local devices = rawFile:Devices()
+assert(#devices == 1 and devices[1].TypeName == "MS" and devices[1].Index == 1, "Devices")
+local tic = rawFile:GetTrace("MS")
+assert(#tic.Time == 65 and #tic.Value == 65, "TIC trace of " .. #tic.Time .. " points")
+for sn = 1, 65 do
+	local header = rawFile:GetScanHeader(sn)
+	assert(near(tic.Time[sn], header.StartTime, 1e-9) and near(tic.Value[sn], header.TIC, 1e-9), "TIC trace at scan " .. sn)
+end
+assert(tic.StartTime == tic.Time[1] and tic.EndTime == tic.Time[65], "TIC trace range")
+
+local ms2 = rawFile:GetTrace("MS", 1, {Filter = "Full ms2"})
+assert(#ms2.Time == 62, "Filtered trace of " .. #ms2.Time .. " points")
+local basePeak = rawFile:GetTrace(0, 1, {channel = 2, Filter = "FTMS"})
+assert(#basePeak.Value == 3 and near(basePeak.Value[1], rawFile:GetScanHeader(1).BasePeakIntensity, 1e-9), "Base peak trace")
+
+-- A mass range trace sums the centroids in the range
+local range = rawFile:GetTrace("MS", 1, {channel = 0, MassRange = "400-500", Filter = "FTMS"})
+local sum = 0
+for _, peak in ipairs(rawFile:GetLabelData(1, {fm = 400, lm = 500})) do
+	sum = sum + peak.Intensity
+end
+assert(#range.Value == 3 and near(range.Value[1], sum, 1e-9), "Mass range trace " .. tostring(range.Value[1]) .. " " .. sum)
+assert(not pcall(rawFile.GetTrace, rawFile, "MS", 1, {channel = 0}), "Mass range trace without a range")
+
+-- The method has a "Scan Event 1" under Experiment 1's Decision before the
+-- Scan Event 1 section itself, the lookups find the parameter after both
+local function check(value, expected, what)
+	assert(value == expected, what .. " is " .. tostring(value) .. ", not " .. tostring(expected))
+end
+check(rawFile:GetMethodScanParameter({label = "Maximum Injection Time (ms)"}), "35", "Scan Event 1 injection time")
+check(rawFile:GetMethodScanParameter({label = "Collision Energy (%)", experiment = 1, event = "Event 1"}), "25", "Scan Event 1 collision energy")
+check(rawFile:GetMethodScanParameter({label = "Isolation Window", partial = true}), "2", "Scan Event 1 partial label")
+check(rawFile:GetMethodScanParameter({label = "Maximum Injection Time (ms)", event = "Event 2"}), nil, "Scan Event 2")
+check(rawFile:GetMethodScanParameter({label = "No Such Parameter"}), nil, "Missing parameter")
+check(rawFile:GetMethodExperimentParameter({label = "Cycle Time (sec)"}), "3", "Experiment 1 cycle time")
+check(rawFile:GetMethodExperimentParameter({label = "Maximum Injection Time (ms)"}), "100", "Experiment 1 injection time")
+check(rawFile:GetMethodExperimentParameter({label = "Cycle Time (sec)", experiment = 2}), nil, "Experiment 2")
+check(rawFile:GetMethodGlobalParameter({label = "Ion Source Type"}), "HESI", "Global ion source")
+check(rawFile:GetMethodGlobalParameter({label = "Method Duration (min)="}), "10", "Global method duration")
+check(rawFile:GetMethodGlobalParameter({label = "Vaporizer Temp", partial = true}), "40", "Global partial label")
+
+local times = rawFile:GetMaxInjectTimes()
+assert(#times == 2 and times[1] == 100 and times[2] == 35, "Maximum injection times")
+
+rawFile:Close()
+print("Basic.raw passed with " .. backend)
@@ -0,0 +1,76 @@
+/* Benchmark.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+// Runs a Lua benchmark script with the bindings preloaded as LuaRawFile.core
+//
+//	rawfile_bench [script.lua] [spec] [repeats]
+
+#include <lua.hpp>
+#include <cstdio>
+#include <cstring>
+
+extern "C" int luaopen_LuaRawFile_core(lua_State* L);
+
+static int traceback(lua_State* L)
+{
+	lua_getglobal(L, "debug");
+	lua_getfield(L, -1, "traceback");
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, 2);
+	lua_call(L, 2, 1);
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* script = BENCHMARK_SCRIPT;
+	int firstArg = 1;
+	if (argc > 1 && strlen(argv[1]) > 4 && strcmp(argv[1] + strlen(argv[1]) - 4, ".lua") == 0)
+		script = argv[firstArg++];
+
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	// require("LuaRawFile") finds src/LuaRawFile.lua, which requires the core
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "preload");
+	lua_pushcfunction(L, luaopen_LuaRawFile_core);
+	lua_setfield(L, -2, "LuaRawFile.core");
+	lua_pop(L, 1);
+	lua_getfield(L, -1, "path");
+	lua_pushstring(L, LUARAWFILE_LUA_DIR "/?.lua;");
+	lua_insert(L, -2);
+	lua_concat(L, 2);
+	lua_setfield(L, -2, "path");
+	lua_pop(L, 1);
+
+	lua_createtable(L, argc - firstArg, 1);
+	lua_pushstring(L, script);
+	lua_rawseti(L, -2, 0);
+	for (int i = firstArg; i < argc; i++)
+	{
+		lua_pushstring(L, argv[i]);
+		lua_rawseti(L, -2, i - firstArg + 1);
+	}
+	lua_setglobal(L, "arg");
+
+	lua_pushcfunction(L, traceback);
+	int status = luaL_loadfile(L, script);
+	if (status == 0)
+	{
+		for (int i = firstArg; i < argc; i++)
+			lua_pushstring(L, argv[i]);
+		status = lua_pcall(L, argc - firstArg, 0, -(argc - firstArg) - 2);
+	}
+
+	if (status != 0)
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+
+	lua_close(L);
+	return status == 0 ? 0 : 1;
+}
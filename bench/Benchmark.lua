@@ -0,0 +1,225 @@
+--[[
+ Benchmark.lua
+
+ Copyright (C) 2016 Thermo Fisher Scientific
+
+ This software may be modified and distributed under the terms
+ of the MIT license.  See the LICENSE file for details.
+--]]
+
+-- Times the bindings against a synthetic run, see SyntheticRawFile.h
+--
+--	rawfile_bench [Benchmark.lua] [spec] [repeats] [backend]
+--
+-- Each case runs repeats times and the best time is reported, with the
+-- scans and peaks per second and the Lua memory allocated per call.
+
+local RawFile = require("LuaRawFile")
+
+local spec = arg[1] or "synthetic:dda?scans=2000&peaks=1000"
+local repeats = tonumber(arg[2]) or 3
+local backend = arg[3]
+
+local rawFile = assert(RawFile.New(spec, backend))
+assert(rawFile:Open(), "Couldn't open " .. spec)
+local first = rawFile.FirstSpectrumNumber
+local last = rawFile.LastSpectrumNumber
+
+local ms1Scans = {}
+for sn = first, last do
+	if rawFile:GetMSNOrder(sn) == 1 then
+		ms1Scans[#ms1Scans + 1] = sn
+	end
+end
+
+-- Each case returns the number of scans and peaks it read
+local cases = {
+	{ "GetSpectrum", function()
+		local peaks = 0
+		for sn = first, last do
+			peaks = peaks + #rawFile:GetSpectrum(sn)
+		end
+		return last - first + 1, peaks
+	end },
+	{ "GetSpectrum into", function()
+		local peaks = 0
+		local options = {into = {}}
+		for sn = first, last do
+			peaks = peaks + #rawFile:GetSpectrum(sn, options)
+		end
+		return last - first + 1, peaks
+	end },
+	{ "GetSpectrum LoadAll", function()
+		local peaks = 0
+		rawFile:LoadAll{first = first, last = last, codec = "delta-mz+float16"}
+		for pass = 1, 3 do
+			for sn = first, last do
+				peaks = peaks + #rawFile:GetSpectrum(sn)
+			end
+		end
+		rawFile:LoadAll(false)
+		return 3 * (last - first + 1), peaks
+	end },
+	{ "GetLabelData", function()
+		local peaks = 0
+		for sn = first, last do
+			peaks = peaks + #rawFile:GetLabelData(sn)
+		end
+		return last - first + 1, peaks
+	end },
+	{ "GetLabelData columnar", function()
+		local peaks = 0
+		for sn = first, last do
+			peaks = peaks + #rawFile:GetLabelData(sn, {columnar = true}).Mass
+		end
+		return last - first + 1, peaks
+	end },
+	{ "GetLabelData Mass, Intensity", function()
+		local peaks = 0
+		for sn = first, last do
+			peaks = peaks + #rawFile:GetLabelData(sn, {fields = {"Mass", "Intensity"}}).Mass
+		end
+		return last - first + 1, peaks
+	end },
+	{ "GetLabelData Mass, Intensity into", function()
+		local peaks = 0
+		local options = {fields = {"Mass", "Intensity"}, into = {}}
+		for sn = first, last do
+			peaks = peaks + #rawFile:GetLabelData(sn, options).Mass
+		end
+		return last - first + 1, peaks
+	end },
+	{ "Scans Peaks", function()
+		local scans, peaks = 0, 0
+		for scan in rawFile:Scans{scanRange = {first, last}} do
+			scans = scans + 1
+			peaks = peaks + #scan.Peaks
+		end
+		return scans, peaks
+	end },
+	{ "GetScanHeader", function()
+		for sn = first, last do
+			rawFile:GetScanHeader(sn)
+		end
+		return last - first + 1, 0
+	end },
+	{ "GetScanHeader into", function()
+		local options = {into = {}}
+		for sn = first, last do
+			rawFile:GetScanHeader(sn, options)
+		end
+		return last - first + 1, 0
+	end },
+	{ "GetHeaderSeries TIC", function()
+		local series = rawFile:GetHeaderSeries({"TIC"}, {first = first, last = last, cache = false})
+		return last - first + 1, #series.TIC
+	end },
+	{ "GetScanHeaders", function()
+		local headers = rawFile:GetScanHeaders(first, last)
+		return #headers.ScanNumber, 0
+	end },
+	{ "GetIsolationScheme", function()
+		local scheme = rawFile:GetIsolationScheme(first, last)
+		return #scheme.ScanNumber, 0
+	end },
+	{ "ExtractDIAFragments", function()
+		local targets = {}
+		for i = 1, 100 do
+			local mz = 400 + i * 5
+			targets[i] = {mz = mz, fragments = {mz * 0.5, mz * 0.75, mz * 1.25}}
+		end
+		local extracted = rawFile:ExtractDIAFragments(targets)
+		return #targets, 0
+	end },
+	{ "GetAllTrailers", function()
+		local trailers = rawFile:GetAllTrailers(first, last)
+		return #trailers.ScanNumber, 0
+	end },
+	{ "GetStatusLogSeries", function()
+		local series = rawFile:GetStatusLogSeries()
+		return #series.RetentionTime, 0
+	end },
+	{ "GetScanFilter", function()
+		for sn = first, last do
+			rawFile:GetScanFilter(sn)
+		end
+		return last - first + 1, 0
+	end },
+	{ "GetScanTrailer", function()
+		for sn = first, last do
+			rawFile:GetScanTrailer(sn)
+		end
+		return last - first + 1, 0
+	end },
+	{ "GetScanTrailer Charge State", function()
+		for sn = first, last do
+			rawFile:GetScanTrailer(sn, "Charge State:")
+		end
+		return last - first + 1, 0
+	end },
+	{ "GetChroData TIC", function()
+		local points = #rawFile:GetChroData({Type = 1, Filter = "Full ms"})
+		return points, 0
+	end },
+	{ "GetPrecursorContext", function()
+		rawFile:GetPrecursorContext(first, last)
+		return last - first + 1, 0
+	end },
+	{ "Deisotope MS1", function()
+		local envelopes = rawFile:Deisotope(ms1Scans)
+		return #ms1Scans, #envelopes.ScanNumber
+	end },
+	{ "AverageSpectra MS1", function()
+		local average = rawFile:AverageSpectra(ms1Scans)
+		return #ms1Scans, #average.Mass
+	end },
+}
+
+-- Encode and decode the masses or intensities of the MS1 spectra with each codec
+local codecColumns = { numpressLinear = "Mass", numpressPic = "Intensity", numpressSlof = "Intensity",
+	deltaVarint = "Mass", shuffle = "Mass", float32 = "Intensity", float16 = "Intensity" }
+local codecSpectra = {}
+for i, sn in ipairs(ms1Scans) do
+	codecSpectra[i] = rawFile:GetLabelData(sn, {fields = {"Mass", "Intensity"}})
+end
+for _, codec in ipairs({"numpressLinear", "numpressPic", "numpressSlof", "deltaVarint", "shuffle", "float32", "float16"}) do
+	cases[#cases + 1] = { "Codec " .. codec, function()
+		local peaks = 0
+		for _, spectrum in ipairs(codecSpectra) do
+			local values = spectrum[codecColumns[codec]]
+			peaks = peaks + #RawFile.Codec.Decode(RawFile.Codec.Encode(values, codec), codec)
+		end
+		return #codecSpectra, peaks
+	end }
+end
+
+local function rate(count, seconds)
+	if count == 0 then return "-" end
+	if seconds <= 0 then return "inf" end
+	return string.format("%.0f", count / seconds)
+end
+
+print(string.format("%s%s, %s, %d scans, best of %d", _VERSION, jit and (" (" .. jit.version .. ")") or "", spec, last - first + 1, repeats))
+print(string.format("%-32s %10s %12s %14s %12s", "case", "seconds", "scans/s", "peaks/s", "KB/scan"))
+
+for _, case in ipairs(cases) do
+	local name, run = case[1], case[2]
+	local best, scans, peaks, allocated
+	for _ = 1, repeats do
+		collectgarbage("collect")
+		collectgarbage("stop")
+		local memory = collectgarbage("count")
+		local start = os.clock()
+		scans, peaks = run()
+		local seconds = os.clock() - start
+		allocated = collectgarbage("count") - memory
+		collectgarbage("restart")
+		if not best or seconds < best then
+			best = seconds
+		end
+	end
+	print(string.format("%-32s %10.4f %12s %14s %12.2f", name, best, rate(scans, best), rate(peaks, best),
+		scans > 0 and allocated / scans or 0))
+end
+
+rawFile:Close()
@@ -0,0 +1,261 @@
+/* CodecTest.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+// Round trips of every codec of Codec.h, with the error bound of each.  Built
+// once as is, for the scalar paths, and once with -mavx2 -mf16c, where the
+// AVX and F16C paths are checked element by element against the scalar
+// conversions.  Lengths around the vector widths run the tails too.
+//
+//	codec_test
+
+#include "Codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace RawFile;
+
+#define CODEC_TEST_SKIP		77		// ctest's SKIP_RETURN_CODE
+
+static int failures = 0;
+
+static void check(bool passed, const char* codec, size_t count, const char* what)
+{
+	if (!passed)
+	{
+		failures++;
+		fprintf(stderr, "%s, %u values: %s\n", codec, (unsigned)count, what);
+	}
+}
+
+// Deterministic, so a failure reproduces
+static double uniform(unsigned& state)
+{
+	state = state * 1103515245 + 12345;
+	return ((state >> 8) & 0xffffff) / 16777216.0;
+}
+
+// Sorted masses from 100 to about 2000, as in a spectrum
+static std::vector<double> masses(size_t count, unsigned& state)
+{
+	std::vector<double> values(count);
+	double mass = 100;
+	for (size_t i = 0; i < count; i++)
+	{
+		mass += uniform(state) * 1900.0 / (count + 1);
+		values[i] = mass;
+	}
+	return values;
+}
+
+// Intensities over six orders of magnitude, with some zeros
+static std::vector<double> intensities(size_t count, unsigned& state)
+{
+	std::vector<double> values(count);
+	for (size_t i = 0; i < count; i++)
+		values[i] = uniform(state) < 0.1 ? 0 : std::pow(10.0, 1 + uniform(state) * 6);
+	return values;
+}
+
+static double fixedPointOf(const std::vector<unsigned char>& data)
+{
+	// Stored big endian
+	unsigned char bytes[8];
+	for (int i = 0; i < 8; i++)
+	{
+		int one = 1;
+		bytes[i] = data[*(char*)&one ? 7 - i : i];
+	}
+	double fixedPoint;
+	memcpy(&fixedPoint, bytes, sizeof(double));
+	return fixedPoint;
+}
+
+static void roundTrip(CodecType type, const std::vector<double>& values)
+{
+	const char* codec = CodecNames[type];
+	size_t count = values.size();
+	std::vector<unsigned char> data(3, 0xaa);	// Encode appends
+	Encode(type, values.data(), count, data);
+	data.erase(data.begin(), data.begin() + 3);
+
+	std::vector<double> decoded(1, -1);	// and so does Decode
+	bool decodes = Decode(type, data.data(), data.size(), decoded);
+	check(decodes, codec, count, "doesn't decode");
+	check(decoded.size() == count + 1 && decoded[0] == -1, codec, count, "decodes the wrong number of values");
+	if (!decodes || decoded.size() != count + 1)
+		return;
+
+	double largest = 0;
+	for (size_t i = 0; i < count; i++)
+		largest = (std::max)(largest, std::fabs(values[i]));
+	double bound = 0;
+	bool relative = false;
+	switch (type)
+	{
+	case CodecNumpressLinear:
+		bound = 0.5 / fixedPointOf(data);
+		break;
+	case CodecNumpressPic:
+		bound = 0.5;
+		break;
+	case CodecNumpressSlof:
+		// Of log(value + 1)
+		bound = std::exp(0.5 / fixedPointOf(data)) - 1;
+		relative = true;
+		break;
+	case CodecDeltaVarint:
+	case CodecShuffle:
+		break;
+	case CodecFloat32:
+		bound = std::ldexp(1.0, -24);
+		relative = true;
+		break;
+	case CodecFloat16:
+		// Half an ulp at the largest half, which the largest value scales to
+		bound = largest * std::ldexp(1.0, -11);
+		break;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		double error = std::fabs(decoded[i + 1] - values[i]);
+		double allowed = relative ? bound * (std::fabs(values[i]) + (type == CodecNumpressSlof ? 1 : 0)) : bound;
+		if (!(error <= allowed * (1 + 1e-9) + 1e-12))
+		{
+			char what[128];
+			sprintf(what, "value %u is %.17g, not %.17g", (unsigned)i, decoded[i + 1], values[i]);
+			check(false, codec, count, what);
+			return;
+		}
+	}
+}
+
+// The vector paths against the scalar conversions
+static void conversions(const std::vector<double>& values)
+{
+	size_t count = values.size();
+	double largest = 0;
+	for (size_t i = 0; i < count; i++)
+		largest = (std::max)(largest, std::fabs(values[i]));
+	double scale = largest > 0 ? largest / 32768 : 1;
+	double inverse = 1 / scale;
+
+	std::vector<float> floats(count + 1, 0);
+	EncodeFloat(values.data(), count, floats.data());
+	std::vector<double> doubles(count + 1, 0);
+	DecodeFloat(floats.data(), count, doubles.data());
+	bool same = floats[count] == 0 && doubles[count] == 0;
+	for (size_t i = 0; i < count; i++)
+		same = same && floats[i] == (float)values[i] && doubles[i] == (double)floats[i];
+	check(same, "EncodeFloat", count, "differs from the scalar conversion");
+
+	std::vector<unsigned short> halves(count + 1, 0);
+	EncodeHalf(values.data(), count, scale, halves.data());
+	DecodeHalf(halves.data(), count, scale, doubles.data());
+	same = halves[count] == 0 && doubles[count] == 0;
+	for (size_t i = 0; i < count; i++)
+		same = same && halves[i] == FloatToHalf((float)(values[i] * inverse))
+			&& doubles[i] == HalfToFloat(halves[i]) * scale;
+	check(same, "EncodeHalf", count, "differs from the scalar conversion");
+}
+
+// Every half but the NaNs survives the trip through a float
+static void halves()
+{
+	for (unsigned half = 0; half < 0x10000; half++)
+	{
+		if ((half & 0x7c00) == 0x7c00 && (half & 0x3ff) != 0)
+			continue;
+		if (FloatToHalf(HalfToFloat((unsigned short)half)) != half)
+		{
+			check(false, "FloatToHalf", 1, "doesn't round trip every half");
+			return;
+		}
+	}
+	// Halfway between 1 and its next half rounds to the even 1
+	check(FloatToHalf(1.0f + std::ldexp(1.0f, -11)) == 0x3c00, "FloatToHalf", 1, "doesn't round to nearest even");
+	check(FloatToHalf(65520.0f) == 0x7c00, "FloatToHalf", 1, "doesn't overflow to infinity");
+}
+
+// Worked by hand from the MS-Numpress specification
+static void numpressBytes()
+{
+	static const double linear[] = { 100, 101, 102.5 };
+	static const unsigned char linearBytes[] = { 0x40, 0x24, 0, 0, 0, 0, 0, 0,
+		0xe8, 0x03, 0, 0, 0xf2, 0x03, 0, 0, 0x75 };
+	static const double pic[] = { 1, 2, 300 };
+	static const unsigned char picBytes[] = { 0x71, 0x72, 0x5c, 0x21 };
+	static const double slof[] = { 0, 1.718281828459045 };
+	static const unsigned char slofBytes[] = { 0x40, 0x59, 0, 0, 0, 0, 0, 0, 0, 0, 0x64, 0 };
+
+	std::vector<unsigned char> data;
+	Encode(CodecNumpressLinear, linear, 3, data, 10);
+	check(data.size() == sizeof(linearBytes) && memcmp(data.data(), linearBytes, data.size()) == 0,
+		"numpressLinear", 3, "isn't byte compatible");
+	data.clear();
+	Encode(CodecNumpressPic, pic, 3, data);
+	check(data.size() == sizeof(picBytes) && memcmp(data.data(), picBytes, data.size()) == 0,
+		"numpressPic", 3, "isn't byte compatible");
+	data.clear();
+	Encode(CodecNumpressSlof, slof, 2, data, 100);
+	check(data.size() == sizeof(slofBytes) && memcmp(data.data(), slofBytes, data.size()) == 0,
+		"numpressSlof", 2, "isn't byte compatible");
+
+	std::vector<double> values;
+	check(!Decode(CodecNumpressLinear, linearBytes, 10, values), "numpressLinear", 0, "decodes a short header");
+	check(!Decode(CodecShuffle, linearBytes, 9, values), "shuffle", 0, "decodes a partial value");
+}
+
+int main()
+{
+#if defined(__GNUC__) && (defined(__AVX__) || defined(__F16C__))
+	// Built for the vector paths, but the CPU may not have them
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx") || !__builtin_cpu_supports("f16c"))
+	{
+		printf("codec_test: no AVX and F16C here, skipped\n");
+		return CODEC_TEST_SKIP;
+	}
+#endif
+	printf("codec_test: %s paths\n",
+#if defined(__AVX__) || defined(__F16C__) || defined(__AVX2__)
+		"vector"
+#else
+		"scalar"
+#endif
+		);
+
+	static const size_t counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 1000, 4099 };
+	unsigned state = 1;
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+		std::vector<double> mz = masses(counts[c], state);
+		std::vector<double> intensity = intensities(counts[c], state);
+		for (int type = CodecNumpressLinear; type <= CodecFloat16; type++)
+		{
+			roundTrip((CodecType)type, mz);
+			roundTrip((CodecType)type, intensity);
+		}
+		conversions(mz);
+		conversions(intensity);
+	}
+	halves();
+	numpressBytes();
+
+	if (failures > 0)
+	{
+		fprintf(stderr, "codec_test: %d failures\n", failures);
+		return 1;
+	}
+	printf("codec_test: passed\n");
+	return 0;
+}
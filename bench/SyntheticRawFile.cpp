@@ -0,0 +1,1155 @@
+/* SyntheticRawFile.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "SyntheticRawFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+namespace MSFileReaderLib {
+
+	#define SYNTHETIC_ISOTOPE_SPACING	1.00335483
+	#define SYNTHETIC_RT_PER_SCAN		0.0015		// minutes, about 1 s for a top 10 cycle
+	#define SYNTHETIC_LOW_MASS			350.0
+	#define SYNTHETIC_HIGH_MASS			1500.0
+	#define SYNTHETIC_MS2_LOW_MASS		100.0
+	#define SYNTHETIC_MS2_HIGH_MASS		2000.0
+	#define SYNTHETIC_DIA_LOW_MASS		400.0
+	#define SYNTHETIC_DIA_HIGH_MASS		1000.0
+	#define SYNTHETIC_STATUS_EVERY		10			// scans per status log entry
+	#define SYNTHETIC_TRACE_STEP		0.01		// minutes between analog trace points
+
+	// The layouts the bindings read the returned arrays as
+	typedef struct _syntheticLabel
+	{
+		double Mass;
+		double Intensity;
+		double Resolution;
+		double Baseline;
+		double Noise;
+		double Charge;
+	} SyntheticLabel;
+
+	typedef struct _syntheticFlags
+	{
+		unsigned char Saturated;
+		unsigned char Fragmented;
+		unsigned char Merged;
+		unsigned char Exception;
+		unsigned char Modified;
+	} SyntheticFlags;
+
+	typedef struct _syntheticEntry
+	{
+		std::string Label;
+		VARTYPE Type;
+		double Number;
+		std::string Text;
+	} SyntheticEntry;
+
+	// splitmix64, seeded from the run seed and up to two keys
+	class Random
+	{
+	public:
+		Random(unsigned long long seed, unsigned long long a, unsigned long long b)
+			: State(seed * 0x9E3779B97F4A7C15ULL ^ (a + 1) * 0xBF58476D1CE4E5B9ULL ^ (b + 1) * 0x94D049BB133111EBULL) {}
+		unsigned long long Next()
+		{
+			unsigned long long z = (State += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		}
+		double Uniform() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+	private:
+		unsigned long long State;
+	};
+
+	static BSTR AllocString(const std::string& s)
+	{
+		std::wstring wide(s.begin(), s.end());
+		return SysAllocString(wide.c_str());
+	}
+
+	static std::string Format(const char* format, double value)
+	{
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer), format, value);
+		return buffer;
+	}
+
+	static void ReturnStrings(const std::vector<std::string>& items, VARIANT* result)
+	{
+		VariantClear(result);
+		result->vt = VT_ARRAY | VT_BSTR;
+		result->parray = SafeArrayCreateRecords(VT_BSTR, sizeof(BSTR), (ULONG)items.size());
+		BSTR* data = (BSTR*)result->parray->pvData;
+		for (size_t i = 0; i < items.size(); i++)
+			data[i] = AllocString(items[i]);
+	}
+
+	template <typename T>
+	static void ReturnRecords(const std::vector<T>& records, VARTYPE vt, VARIANT* result)
+	{
+		VariantClear(result);
+		result->vt = VT_ARRAY | vt;
+		result->parray = SafeArrayCreateRecords(vt, sizeof(T), (ULONG)records.size());
+		if (!records.empty())
+			memcpy(result->parray->pvData, &records[0], records.size() * sizeof(T));
+	}
+
+	static void EntryToVariant(const SyntheticEntry& entry, VARIANT* value)
+	{
+		VariantClear(value);
+		value->vt = entry.Type;
+		switch (entry.Type)
+		{
+		case VT_BSTR: value->bstrVal = AllocString(entry.Text); break;
+		case VT_R4: value->fltVal = (float)entry.Number; break;
+		case VT_R8: value->dblVal = entry.Number; break;
+		case VT_I4: value->lVal = (long)entry.Number; break;
+		case VT_I2: value->iVal = (short)entry.Number; break;
+		default: value->vt = VT_EMPTY; break;
+		}
+	}
+
+	static std::string EntryToString(const SyntheticEntry& entry)
+	{
+		switch (entry.Type)
+		{
+		case VT_BSTR: return entry.Text;
+		case VT_I4:
+		case VT_I2: return Format("%.0f", entry.Number);
+		default: return Format("%.4f", entry.Number);
+		}
+	}
+
+	static HRESULT FindEntry(const std::vector<SyntheticEntry>& entries, const char* label, VARIANT* value)
+	{
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (entries[i].Label == label)
+			{
+				EntryToVariant(entries[i], value);
+				return S_OK;
+			}
+		}
+		return E_FAIL;
+	}
+
+	static void ReturnEntries(const std::vector<SyntheticEntry>& entries, VARIANT* labels, VARIANT* values, long* size)
+	{
+		std::vector<std::string> names;
+		std::vector<std::string> texts;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			names.push_back(entries[i].Label);
+			texts.push_back(EntryToString(entries[i]));
+		}
+		ReturnStrings(names, labels);
+		if (values != NULL)
+			ReturnStrings(texts, values);
+		*size = (long)entries.size();
+	}
+
+	static void AddEntry(std::vector<SyntheticEntry>& entries, const std::string& label, VARTYPE type, double number, const std::string& text = "")
+	{
+		SyntheticEntry entry = { label, type, number, text };
+		entries.push_back(entry);
+	}
+
+	static bool MassLess(const SyntheticPeak& a, const SyntheticPeak& b)
+	{
+		return a.Mass < b.Mass;
+	}
+
+	static double Envelope(double rt, double endTime)
+	{
+		double x = endTime > 0 ? rt / endTime : 0;
+		return 0.2 + 0.8 * std::sin(3.14159265358979 * x) * std::sin(3.14159265358979 * x);
+	}
+
+	static const char* SyntheticMethod =
+		"Method of Synthetic Orbitrap\n"
+		"Method Settings\n"
+		"  Application Mode: Peptide\n"
+		"  Method Duration (min): 60\n"
+		"Global Parameters\n"
+		"  Ion Source\n"
+		"    Ion Source Type: NSI\n"
+		"    Spray Voltage: Static\n"
+		"    Positive Ion (V): 2000\n"
+		"  MS Global Settings\n"
+		"    Default Charge State: 2\n"
+		"Experiment 1\n"
+		"  Scan Event 1\n"
+		"    Full Scan\n"
+		"      Orbitrap Resolution = 60000\n"
+		"      Scan Range (m/z) = 350-1500\n"
+		"      Maximum Injection Time (ms) = 50\n"
+		"      AGC Target = 300000\n"
+		"  Scan Event 2\n"
+		"    Data Dependent MS2\n"
+		"      Orbitrap Resolution = 15000\n"
+		"      Isolation Window (m/z) = 1.6\n"
+		"      Collision Energy (%) = 30\n"
+		"      Maximum Injection Time (ms) = 22\n"
+		"      AGC Target = 100000\n";
+
+	IXRawfile5::IXRawfile5()
+		: RefCount(1), IsOpen(false), ControllerType(-1), ControllerIndex(0), Visible(0), CachedScan(0)
+	{
+	}
+
+	unsigned long IXRawfile5::Release()
+	{
+		unsigned long count = --RefCount;
+		if (count == 0)
+			delete this;
+		return count;
+	}
+
+	HRESULT IXRawfile5Ptr::CreateInstance(const char*)
+	{
+		Release();
+		Instance = new IXRawfile5();
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::Open(_bstr_t fileName)
+	{
+		std::string spec((const char*)fileName);
+		if (spec.compare(0, 10, "synthetic:") != 0)
+			return E_FAIL;
+
+		Spec.DIA = spec.compare(10, 3, "dia") == 0;
+		Spec.Scans = 5000;
+		Spec.Peaks = 1000;
+		Spec.TopN = 10;
+		Spec.Windows = 24;
+		Spec.TrailerExtra = 20;
+		Spec.Live = 0;
+		Spec.Seed = 1;
+
+		// key=value pairs after the ?
+		size_t position = spec.find('?');
+		while (position != std::string::npos)
+		{
+			size_t end = spec.find('&', position + 1);
+			std::string pair = spec.substr(position + 1, end == std::string::npos ? std::string::npos : end - position - 1);
+			position = end;
+
+			size_t equals = pair.find('=');
+			if (equals == std::string::npos)
+				continue;
+			std::string key = pair.substr(0, equals);
+			long value = atol(pair.c_str() + equals + 1);
+			if (key == "scans") Spec.Scans = (std::max)(1L, value);
+			else if (key == "peaks") Spec.Peaks = (std::max)(4L, value);
+			else if (key == "topn") Spec.TopN = (std::max)(0L, value);
+			else if (key == "windows") Spec.Windows = (std::max)(1L, value);
+			else if (key == "trailer") Spec.TrailerExtra = (std::max)(0L, value);
+			else if (key == "live") Spec.Live = (std::max)(0L, value);
+			else if (key == "seed") Spec.Seed = (unsigned long long)value;
+		}
+
+		IsOpen = true;
+		ControllerType = -1;
+		ControllerIndex = 0;
+		Visible = Spec.Live > 0 ? (std::min)(Spec.Live, Spec.Scans) : Spec.Scans;
+		CachedScan = 0;
+		Cached.clear();
+		Tic.clear();
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::Close()
+	{
+		IsOpen = false;
+		CachedScan = 0;
+		Cached.clear();
+		Tic.clear();
+		return S_OK;
+	}
+
+	// One MS controller and one analog controller
+	HRESULT IXRawfile5::SetCurrentController(long type, long index)
+	{
+		if (!IsOpen || (type != 0 && type != 1) || index != 1)
+			return E_FAIL;
+		ControllerType = type;
+		ControllerIndex = index;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetCurrentController(long* type, long* index)
+	{
+		*type = ControllerType;
+		*index = ControllerIndex;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetNumberOfControllers(long* count)
+	{
+		*count = IsOpen ? 2 : 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetControllerType(long index, long* type)
+	{
+		if (!IsOpen || index < 0 || index > 1)
+			return E_FAIL;
+		*type = index;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetNumberOfControllersOfType(long type, long* count)
+	{
+		*count = IsOpen && (type == 0 || type == 1) ? 1 : 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetFirstSpectrumNumber(long* sn)
+	{
+		*sn = 1;
+		return IsMS() ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetLastSpectrumNumber(long* sn)
+	{
+		*sn = Visible;
+		return IsMS() ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetNumSpectra(long* count)
+	{
+		*count = Visible;
+		return IsMS() ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetNumStatusLog(long* count)
+	{
+		*count = (Visible + SYNTHETIC_STATUS_EVERY - 1) / SYNTHETIC_STATUS_EVERY;
+		return IsMS() ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetStartTime(double* rt)
+	{
+		*rt = 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetEndTime(double* rt)
+	{
+		*rt = (Visible - 1) * SYNTHETIC_RT_PER_SCAN;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	// While in acquisition every refresh makes another cycle readable
+	HRESULT IXRawfile5::RefreshViewOfFile()
+	{
+		if (!IsOpen)
+			return E_FAIL;
+		Visible = (std::min)(Spec.Scans, Visible + CycleLength());
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::InAcquisition(long* inAcquisition)
+	{
+		*inAcquisition = IsOpen && Visible < Spec.Scans ? 1 : 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	static void TuneEntries(std::vector<SyntheticEntry>& entries)
+	{
+		AddEntry(entries, "Spray Voltage (V):", VT_R8, 2000);
+		AddEntry(entries, "Capillary Temperature (C):", VT_R8, 275);
+		AddEntry(entries, "S-Lens RF Level:", VT_R8, 50);
+		AddEntry(entries, "Sheath Gas Flow:", VT_R8, 0);
+		AddEntry(entries, "Aux Gas Flow:", VT_R8, 0);
+	}
+
+	HRESULT IXRawfile5::GetTuneDataValue(long index, _bstr_t label, VARIANT* value)
+	{
+		if (!IsMS() || index != 0)
+			return E_FAIL;
+
+		std::vector<SyntheticEntry> entries;
+		TuneEntries(entries);
+		return FindEntry(entries, label, value);
+	}
+
+	HRESULT IXRawfile5::GetTuneData(long index, VARIANT* labels, VARIANT* values, long* size)
+	{
+		if (!IsMS() || index != 0)
+			return E_FAIL;
+
+		std::vector<SyntheticEntry> entries;
+		TuneEntries(entries);
+		ReturnEntries(entries, labels, values, size);
+		return S_OK;
+	}
+
+	// The trailer has the entries the bindings read plus TrailerExtra padding
+	static void TrailerEntries(const SyntheticSpec& spec, long msOrder, double mz, long charge, long master, double rt, std::vector<SyntheticEntry>& entries)
+	{
+		AddEntry(entries, "Charge State:", VT_I2, msOrder > 1 && !spec.DIA ? charge : 0);
+		AddEntry(entries, "Monoisotopic M/Z:", VT_R8, msOrder > 1 && !spec.DIA ? mz : 0);
+		AddEntry(entries, "Ion Injection Time (ms):", VT_R4, msOrder > 1 ? 22 : 50 * (0.3 + 0.7 * std::fabs(std::sin(rt * 7))));
+		AddEntry(entries, "Master Scan Number:", VT_I4, msOrder > 1 ? master : 0);
+		AddEntry(entries, "Elapsed Scan Time (sec):", VT_R4, msOrder > 1 ? 0.032 : 0.128);
+		AddEntry(entries, "FT Resolution:", VT_I4, msOrder > 1 ? 15000 : 60000);
+		AddEntry(entries, "AGC Target:", VT_I4, msOrder > 1 ? 100000 : 300000);
+		AddEntry(entries, "Micro Scan Count:", VT_I2, 1);
+		AddEntry(entries, "Scan Description:", VT_BSTR, 0, "");
+		for (long i = 0; i < spec.TrailerExtra; i++)
+			AddEntry(entries, "Extra Value " + std::to_string(i + 1) + ":", VT_R8, i * 0.5);
+	}
+
+	HRESULT IXRawfile5::GetTrailerExtraValueForScanNum(long sn, _bstr_t label, VARIANT* value)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		long msOrder = 0;
+		double mz = 0;
+		long charge = 0;
+		double width = 0;
+		double rt = 0;
+		GetMSOrderForScanNum(sn, &msOrder);
+		Precursor(sn, mz, charge, width);
+		RTFromScanNum(sn, &rt);
+
+		std::vector<SyntheticEntry> entries;
+		TrailerEntries(Spec, msOrder, mz, charge, MasterScan(sn), rt, entries);
+		return FindEntry(entries, label, value);
+	}
+
+	HRESULT IXRawfile5::GetTrailerExtraForScanNum(long sn, VARIANT* labels, VARIANT* values, long* size)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		long msOrder = 0;
+		double mz = 0;
+		long charge = 0;
+		double width = 0;
+		double rt = 0;
+		GetMSOrderForScanNum(sn, &msOrder);
+		Precursor(sn, mz, charge, width);
+		RTFromScanNum(sn, &rt);
+
+		std::vector<SyntheticEntry> entries;
+		TrailerEntries(Spec, msOrder, mz, charge, MasterScan(sn), rt, entries);
+		ReturnEntries(entries, labels, values, size);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetTrailerExtraLabelsForScanNum(long sn, VARIANT* labels, long* size)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		std::vector<SyntheticEntry> entries;
+		TrailerEntries(Spec, 1, 0, 0, 0, 0, entries);
+		ReturnEntries(entries, labels, NULL, size);
+		return S_OK;
+	}
+
+	// Status log entries are recorded every SYNTHETIC_STATUS_EVERY scans
+	static void StatusEntries(double rt, std::vector<SyntheticEntry>& entries)
+	{
+		AddEntry(entries, "Ambient Temperature (C):", VT_R8, 24 + 0.5 * std::sin(rt / 3));
+		AddEntry(entries, "Capillary Temperature (C):", VT_R8, 275 + 0.1 * std::sin(rt * 5));
+		AddEntry(entries, "Spray Current (uA):", VT_R8, 0.4 + 0.1 * std::sin(rt * 2));
+		AddEntry(entries, "Vacuum Pressure (Torr):", VT_R8, 1.2e-10 * (1 + 0.01 * std::sin(rt)));
+		AddEntry(entries, "Ion Gauge (E-5 Torr):", VT_R8, 1.8 + 0.05 * std::sin(rt / 2));
+		AddEntry(entries, "Vacuum OK:", VT_BSTR, 0, "Yes");
+	}
+
+	HRESULT IXRawfile5::GetStatusLogValueForScanNum(long sn, _bstr_t label, double* rt, VARIANT* value)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		*rt = ((sn - 1) / SYNTHETIC_STATUS_EVERY) * SYNTHETIC_STATUS_EVERY * SYNTHETIC_RT_PER_SCAN;
+		std::vector<SyntheticEntry> entries;
+		StatusEntries(*rt, entries);
+		return FindEntry(entries, label, value);
+	}
+
+	HRESULT IXRawfile5::GetStatusLogForScanNum(long sn, double* rt, VARIANT* labels, VARIANT* values, long* size)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		*rt = ((sn - 1) / SYNTHETIC_STATUS_EVERY) * SYNTHETIC_STATUS_EVERY * SYNTHETIC_RT_PER_SCAN;
+		std::vector<SyntheticEntry> entries;
+		StatusEntries(*rt, entries);
+		ReturnEntries(entries, labels, values, size);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetStatusLogLabelsForScanNum(long sn, double* rt, VARIANT* labels, long* size)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		*rt = ((sn - 1) / SYNTHETIC_STATUS_EVERY) * SYNTHETIC_STATUS_EVERY * SYNTHETIC_RT_PER_SCAN;
+		std::vector<SyntheticEntry> entries;
+		StatusEntries(*rt, entries);
+		ReturnEntries(entries, labels, NULL, size);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetStatusLogForPos(long pos, VARIANT* rt, VARIANT* values, long* size)
+	{
+		long count = 0;
+		if (FAILED(GetNumStatusLog(&count)) || pos < 0 || pos >= count)
+			return E_FAIL;
+
+		VariantClear(rt);
+		rt->vt = VT_R8;
+		rt->dblVal = pos * SYNTHETIC_STATUS_EVERY * SYNTHETIC_RT_PER_SCAN;
+		std::vector<SyntheticEntry> entries;
+		StatusEntries(rt->dblVal, entries);
+
+		VariantClear(values);
+		values->vt = VT_ARRAY | VT_VARIANT;
+		values->parray = SafeArrayCreateRecords(VT_VARIANT, sizeof(VARIANT), (ULONG)entries.size());
+		VARIANT* data = (VARIANT*)values->parray->pvData;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			VariantInit(&data[i]);
+			EntryToVariant(entries[i], &data[i]);
+		}
+		*size = (long)entries.size();
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetStatusLogPlottableIndex(VARIANT* labels, VARIANT* indices, long* size)
+	{
+		if (!IsMS())
+			return E_FAIL;
+
+		std::vector<SyntheticEntry> entries;
+		StatusEntries(0, entries);
+		std::vector<std::string> names;
+		std::vector<long> positions;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (entries[i].Type == VT_BSTR)
+				continue;
+			names.push_back(entries[i].Label);
+			positions.push_back((long)i);
+		}
+		ReturnStrings(names, labels);
+		ReturnRecords(positions, VT_I4, indices);
+		*size = (long)names.size();
+		return S_OK;
+	}
+
+	// Precursor of a MS2 scan, zero for MS1 scans
+	void IXRawfile5::Precursor(long sn, double& mz, long& charge, double& width) const
+	{
+		long position = CyclePosition(sn);
+		mz = 0;
+		charge = 0;
+		width = 0;
+		if (position == 0)
+			return;
+
+		if (Spec.DIA)
+		{
+			width = (SYNTHETIC_DIA_HIGH_MASS - SYNTHETIC_DIA_LOW_MASS) / Spec.Windows;
+			mz = SYNTHETIC_DIA_LOW_MASS + width * (position - 0.5);
+			return;
+		}
+
+		Random random(Spec.Seed, MasterScan(sn), 1000 + position);
+		mz = 400 + 800 * random.Uniform();
+		charge = 2 + (long)(random.Next() % 3);
+		width = 1.6;
+	}
+
+	static std::string FilterFor(const SyntheticSpec& spec, long msOrder, double mz, long charge)
+	{
+		if (msOrder == 1)
+			return "FTMS + c NSI Full ms [350.0000-1500.0000]";
+
+		char buffer[128];
+		double high = (std::min)(SYNTHETIC_MS2_HIGH_MASS, mz * (std::max)(charge, 2L));
+		snprintf(buffer, sizeof(buffer), "FTMS + c NSI %sFull ms2 %.4f@hcd30.00 [%.4f-%.4f]",
+			spec.DIA ? "" : "d ", mz, SYNTHETIC_MS2_LOW_MASS, high);
+		return buffer;
+	}
+
+	HRESULT IXRawfile5::GetFilterForScanNum(long sn, BSTR* filter)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		long msOrder = 0;
+		double mz = 0;
+		long charge = 0;
+		double width = 0;
+		GetMSOrderForScanNum(sn, &msOrder);
+		Precursor(sn, mz, charge, width);
+		*filter = AllocString(FilterFor(Spec, msOrder, mz, charge));
+		return S_OK;
+	}
+
+	// The filters of the first cycle
+	HRESULT IXRawfile5::GetFilters(VARIANT* filters, long* size)
+	{
+		if (!IsMS())
+			return E_FAIL;
+
+		std::vector<std::string> items;
+		for (long sn = 1; sn <= (std::min)(CycleLength(), Visible); sn++)
+		{
+			long msOrder = 0;
+			double mz = 0;
+			long charge = 0;
+			double width = 0;
+			GetMSOrderForScanNum(sn, &msOrder);
+			Precursor(sn, mz, charge, width);
+			items.push_back(FilterFor(Spec, msOrder, mz, charge));
+		}
+		ReturnStrings(items, filters);
+		*size = (long)items.size();
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetScanEventForScanNum(long sn, BSTR* scanEvent)
+	{
+		return GetFilterForScanNum(sn, scanEvent);
+	}
+
+	HRESULT IXRawfile5::GetScanHeaderInfoForScanNum(long sn, long* packets, double* startTime, double* lowMass, double* highMass,
+		double* tic, double* basePeakMass, double* basePeakIntensity, long* channels, long* uniformTime, double* frequency)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		const std::vector<SyntheticPeak>& peaks = Peaks(sn);
+		double sum = 0;
+		size_t base = 0;
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			sum += peaks[i].Intensity;
+			if (peaks[i].Intensity > peaks[base].Intensity)
+				base = i;
+		}
+
+		long msOrder = 0;
+		double mz = 0;
+		long charge = 0;
+		double width = 0;
+		GetMSOrderForScanNum(sn, &msOrder);
+		Precursor(sn, mz, charge, width);
+
+		*packets = (long)peaks.size();
+		RTFromScanNum(sn, startTime);
+		*lowMass = msOrder == 1 ? SYNTHETIC_LOW_MASS : SYNTHETIC_MS2_LOW_MASS;
+		*highMass = msOrder == 1 ? SYNTHETIC_HIGH_MASS : (std::min)(SYNTHETIC_MS2_HIGH_MASS, mz * (std::max)(charge, 2L));
+		*tic = sum;
+		*basePeakMass = peaks.empty() ? 0 : peaks[base].Mass;
+		*basePeakIntensity = peaks.empty() ? 0 : peaks[base].Intensity;
+		*channels = 0;
+		*uniformTime = 0;
+		*frequency = 0;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetSegmentAndEventForScanNum(long sn, long* segment, long* scanEvent)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		*segment = 1;
+		*scanEvent = CyclePosition(sn) + 1;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetCycleNumberFromScanNumber(long sn, long* cycle)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		*cycle = (sn - 1) / CycleLength() + 1;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::RTFromScanNum(long sn, double* rt)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		*rt = (sn - 1) * SYNTHETIC_RT_PER_SCAN;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::ScanNumFromRT(double rt, long* sn)
+	{
+		if (!IsMS())
+			return E_FAIL;
+		long scan = (long)std::floor(rt / SYNTHETIC_RT_PER_SCAN + 0.5) + 1;
+		*sn = (std::max)(1L, (std::min)(Visible, scan));
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetMSOrderForScanNum(long sn, long* msOrder)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		*msOrder = CyclePosition(sn) == 0 ? 1 : 2;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::IsCentroidScanForScanNum(long sn, long* centroid)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		*centroid = 1;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetIsolationWidthForScanNum(long sn, long, double* width)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		double mz = 0;
+		long charge = 0;
+		Precursor(sn, mz, charge, *width);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetPrecursorMassForScanNum(long sn, long msOrder, double* mass)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+		long charge = 0;
+		double width = 0;
+		Precursor(sn, *mass, charge, width);
+		if (msOrder != 2)
+			*mass = 0;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetPrecursorInfoFromScanNum(long sn, VARIANT* info, long* size)
+	{
+		if (!ValidScan(sn))
+			return E_FAIL;
+
+		std::vector<MS_PrecursorInfo> records;
+		if (CyclePosition(sn) > 0)
+		{
+			MS_PrecursorInfo precursor;
+			double width = 0;
+			Precursor(sn, precursor.dIsolationMass, precursor.nChargeState, width);
+			precursor.dMonoIsoMass = Spec.DIA ? 0 : precursor.dIsolationMass;
+			precursor.nScanNumber = MasterScan(sn);
+			records.push_back(precursor);
+		}
+		ReturnRecords(records, VT_RECORD, info);
+		*size = (long)records.size();
+		return S_OK;
+	}
+
+	// The centroids of a scan.  MS1 scans have isotope envelopes, including the
+	// ones picked for the following MS2 scans, and noise.  The last scan is kept.
+	const std::vector<SyntheticPeak>& IXRawfile5::Peaks(long sn)
+	{
+		if (sn == CachedScan)
+			return Cached;
+
+		Cached.clear();
+		double endTime = (Spec.Scans - 1) * SYNTHETIC_RT_PER_SCAN;
+		double envelope = Envelope((sn - 1) * SYNTHETIC_RT_PER_SCAN, endTime);
+		static const double isotopes[3] = { 1.0, 0.6, 0.25 };
+
+		if (CyclePosition(sn) == 0)
+		{
+			Random random(Spec.Seed, sn, 0);
+			long features = Spec.Peaks / 4;
+			for (long f = 0; f < features; f++)
+			{
+				double mz = 0;
+				long charge = 0;
+				double intensity = 0;
+				if (!Spec.DIA && f < Spec.TopN)
+				{
+					double width = 0;
+					Precursor(sn + f + 1, mz, charge, width);
+					intensity = 1e6 * (1 + 9 * random.Uniform());
+				}
+				else
+				{
+					mz = SYNTHETIC_LOW_MASS + (SYNTHETIC_HIGH_MASS - SYNTHETIC_LOW_MASS - 5) * random.Uniform();
+					charge = 1 + (long)(random.Next() % 4);
+					intensity = 1e4 * std::pow(10.0, 2.5 * random.Uniform());
+				}
+
+				for (int k = 0; k < 3; k++)
+				{
+					SyntheticPeak peak = { mz + k * SYNTHETIC_ISOTOPE_SPACING / charge, intensity * isotopes[k] * envelope, charge };
+					Cached.push_back(peak);
+				}
+			}
+
+			while ((long)Cached.size() < Spec.Peaks)
+			{
+				SyntheticPeak peak = { SYNTHETIC_LOW_MASS + (SYNTHETIC_HIGH_MASS - SYNTHETIC_LOW_MASS) * random.Uniform(), 500 + 2000 * random.Uniform(), 0 };
+				Cached.push_back(peak);
+			}
+		}
+		else
+		{
+			Random random(Spec.Seed, sn, 1);
+			double mz = 0;
+			long charge = 0;
+			double width = 0;
+			Precursor(sn, mz, charge, width);
+			double high = (std::min)(SYNTHETIC_MS2_HIGH_MASS, mz * (std::max)(charge, 2L));
+
+			long count = (std::max)(1L, Spec.Peaks / 4);
+			for (long i = 0; i < count; i++)
+			{
+				SyntheticPeak peak = { SYNTHETIC_MS2_LOW_MASS + (high - SYNTHETIC_MS2_LOW_MASS) * random.Uniform(),
+					1e3 * std::pow(10.0, 3 * random.Uniform()) * envelope, (long)(random.Next() % 3) };
+				Cached.push_back(peak);
+			}
+		}
+
+		std::sort(Cached.begin(), Cached.end(), MassLess);
+		CachedScan = sn;
+		return Cached;
+	}
+
+	void IXRawfile5::ReturnPeaks(const std::vector<SyntheticPeak>& peaks, VARIANT* massList, VARIANT* peakFlags, long* size)
+	{
+		std::vector<double> values(peaks.size() * 2);
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			values[2 * i] = peaks[i].Mass;
+			values[2 * i + 1] = peaks[i].Intensity;
+		}
+
+		VariantClear(massList);
+		massList->vt = VT_ARRAY | VT_R8;
+		massList->parray = SafeArrayCreateRecords(VT_R8, 2 * sizeof(double), (ULONG)peaks.size());
+		if (!values.empty())
+			memcpy(massList->parray->pvData, &values[0], values.size() * sizeof(double));
+
+		ReturnRecords(std::vector<unsigned char>(peaks.size(), 0), VT_UI1, peakFlags);
+		*size = (long)peaks.size();
+	}
+
+	HRESULT IXRawfile5::GetMassListFromScanNum(long* sn, _bstr_t, long, long,
+		long maxPeaks, long, double*, VARIANT* massList, VARIANT* peakFlags, long* size)
+	{
+		if (!ValidScan(*sn))
+		{
+			*size = 0;
+			return E_FAIL;
+		}
+
+		const std::vector<SyntheticPeak>& peaks = Peaks(*sn);
+		if (maxPeaks > 0 && maxPeaks < (long)peaks.size())
+		{
+			std::vector<SyntheticPeak> top(peaks);
+			std::nth_element(top.begin(), top.begin() + maxPeaks, top.end(),
+				[](const SyntheticPeak& a, const SyntheticPeak& b) { return a.Intensity > b.Intensity; });
+			top.resize(maxPeaks);
+			std::sort(top.begin(), top.end(), MassLess);
+			ReturnPeaks(top, massList, peakFlags, size);
+		}
+		else
+		{
+			ReturnPeaks(peaks, massList, peakFlags, size);
+		}
+		return S_OK;
+	}
+
+	// Centroids of several scans merged within 10 ppm
+	static void MergePeaks(std::vector<SyntheticPeak>& peaks, double scale)
+	{
+		std::sort(peaks.begin(), peaks.end(), MassLess);
+		size_t out = 0;
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			if (out > 0 && peaks[i].Mass - peaks[out - 1].Mass < peaks[out - 1].Mass * 10e-6)
+			{
+				SyntheticPeak& merged = peaks[out - 1];
+				double total = merged.Intensity + peaks[i].Intensity;
+				merged.Mass = (merged.Mass * merged.Intensity + peaks[i].Mass * peaks[i].Intensity) / total;
+				merged.Intensity = total;
+			}
+			else
+			{
+				peaks[out++] = peaks[i];
+			}
+		}
+		peaks.resize(out);
+		for (size_t i = 0; i < peaks.size(); i++)
+			peaks[i].Intensity *= scale;
+	}
+
+	HRESULT IXRawfile5::GetAverageMassList(long*, long*, long*, long*,
+		long* first, long* last, _bstr_t, long, long, long,
+		long, double*, VARIANT* massList, VARIANT* peakFlags, long* size)
+	{
+		if (!ValidScan(*first) || !ValidScan(*last) || *last < *first)
+			return E_FAIL;
+
+		std::vector<SyntheticPeak> merged;
+		for (long sn = *first; sn <= *last; sn++)
+		{
+			const std::vector<SyntheticPeak>& peaks = Peaks(sn);
+			merged.insert(merged.end(), peaks.begin(), peaks.end());
+		}
+		MergePeaks(merged, 1.0 / (*last - *first + 1));
+		ReturnPeaks(merged, massList, peakFlags, size);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetAveragedMassSpectrum(long* scans, long count, long, VARIANT* massList, VARIANT* peakFlags, long* size)
+	{
+		std::vector<SyntheticPeak> merged;
+		for (long i = 0; i < count; i++)
+		{
+			if (!ValidScan(scans[i]))
+				return E_FAIL;
+			const std::vector<SyntheticPeak>& peaks = Peaks(scans[i]);
+			merged.insert(merged.end(), peaks.begin(), peaks.end());
+		}
+		MergePeaks(merged, count > 0 ? 1.0 / count : 1.0);
+		ReturnPeaks(merged, massList, peakFlags, size);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetSummedMassSpectrum(long* scans, long count, long, VARIANT* massList, VARIANT* peakFlags, long* size)
+	{
+		std::vector<SyntheticPeak> merged;
+		for (long i = 0; i < count; i++)
+		{
+			if (!ValidScan(scans[i]))
+				return E_FAIL;
+			const std::vector<SyntheticPeak>& peaks = Peaks(scans[i]);
+			merged.insert(merged.end(), peaks.begin(), peaks.end());
+		}
+		MergePeaks(merged, 1.0);
+		ReturnPeaks(merged, massList, peakFlags, size);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetLabelData(VARIANT* labels, VARIANT* flags, long* sn)
+	{
+		if (!ValidScan(*sn))
+			return E_FAIL;
+
+		bool ms1 = CyclePosition(*sn) == 0;
+		const std::vector<SyntheticPeak>& peaks = Peaks(*sn);
+		std::vector<SyntheticLabel> records(peaks.size());
+		std::vector<SyntheticFlags> recordFlags(peaks.size());
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			SyntheticLabel& label = records[i];
+			label.Mass = peaks[i].Mass;
+			label.Intensity = peaks[i].Intensity;
+			label.Resolution = (ms1 ? 60000 : 15000) * std::sqrt(200 / peaks[i].Mass);
+			label.Baseline = 100;
+			label.Noise = 300;
+			label.Charge = peaks[i].Charge;
+
+			SyntheticFlags& flag = recordFlags[i];
+			memset(&flag, 0, sizeof(flag));
+			flag.Saturated = peaks[i].Intensity > 9e6;
+			flag.Merged = peaks[i].Charge == 0 && peaks[i].Intensity < 600;
+		}
+
+		ReturnRecords(records, VT_R8, labels);
+		ReturnRecords(recordFlags, VT_UI1, flags);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetChroData(long type1, long, long, _bstr_t filter, _bstr_t, _bstr_t,
+		double, double* startTime, double* endTime, long, long,
+		VARIANT* chroData, VARIANT* peakFlags, long* size)
+	{
+		if (!IsOpen)
+			return E_FAIL;
+
+		double runEnd = (Visible - 1) * SYNTHETIC_RT_PER_SCAN;
+		double from = *startTime;
+		double to = *endTime > 0 ? *endTime : runEnd;
+		std::vector<double> points;
+
+		if (ControllerType == 1)
+		{
+			// Analog pump pressure, the channel changes the frequency
+			for (double t = 0; t <= runEnd; t += SYNTHETIC_TRACE_STEP)
+			{
+				if (t < from || t > to)
+					continue;
+				points.push_back(t);
+				points.push_back(200 + 50 * std::sin(t * (type1 + 1)));
+			}
+		}
+		else if (ControllerType == 0)
+		{
+			// TIC (or base peak for type 2) of the scans matching a Full ms or ms2 filter
+			std::string text((const char*)filter);
+			long onlyOrder = text.find("ms2") != std::string::npos ? 2 : (text.find("ms") != std::string::npos ? 1 : 0);
+
+			if ((long)Tic.size() != Visible + 1)
+				Tic.assign(Visible + 1, -1.0);
+
+			for (long sn = 1; sn <= Visible; sn++)
+			{
+				double rt = (sn - 1) * SYNTHETIC_RT_PER_SCAN;
+				long msOrder = CyclePosition(sn) == 0 ? 1 : 2;
+				if (rt < from || rt > to || (onlyOrder != 0 && msOrder != onlyOrder))
+					continue;
+
+				double value = 0;
+				if (type1 == 2)
+				{
+					const std::vector<SyntheticPeak>& peaks = Peaks(sn);
+					for (size_t i = 0; i < peaks.size(); i++)
+						value = (std::max)(value, peaks[i].Intensity);
+				}
+				else
+				{
+					if (Tic[sn] < 0)
+					{
+						const std::vector<SyntheticPeak>& peaks = Peaks(sn);
+						double sum = 0;
+						for (size_t i = 0; i < peaks.size(); i++)
+							sum += peaks[i].Intensity;
+						Tic[sn] = sum;
+					}
+					value = Tic[sn];
+				}
+				points.push_back(rt);
+				points.push_back(value);
+			}
+		}
+		else
+		{
+			return E_FAIL;
+		}
+
+		*startTime = from;
+		*endTime = to;
+		*size = (long)(points.size() / 2);
+
+		VariantClear(chroData);
+		chroData->vt = VT_ARRAY | VT_R8;
+		chroData->parray = SafeArrayCreateRecords(VT_R8, 2 * sizeof(double), (ULONG)*size);
+		if (!points.empty())
+			memcpy(chroData->parray->pvData, &points[0], points.size() * sizeof(double));
+		ReturnRecords(std::vector<unsigned char>(*size, 0), VT_UI1, peakFlags);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetNumInstMethods(long* count)
+	{
+		*count = IsOpen ? 1 : 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstMethod(long index, BSTR* method)
+	{
+		if (!IsOpen || index != 0)
+			return E_FAIL;
+		*method = AllocString(SyntheticMethod);
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetInstMethodNames(long* count, VARIANT* names)
+	{
+		if (!IsOpen)
+			return E_FAIL;
+		ReturnStrings(std::vector<std::string>(1, "Synthetic Orbitrap"), names);
+		*count = 1;
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetLowMass(double* mass)
+	{
+		*mass = SYNTHETIC_LOW_MASS;
+		return IsMS() ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetHighMass(double* mass)
+	{
+		*mass = SYNTHETIC_HIGH_MASS;
+		return IsMS() ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstName(BSTR* name)
+	{
+		*name = AllocString(ControllerType == 1 ? "Synthetic Pump" : "Synthetic Orbitrap");
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstSoftwareVersion(BSTR* version)
+	{
+		*version = AllocString("1.0.0");
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstSerialNumber(BSTR* serialNumber)
+	{
+		*serialNumber = AllocString("SYN" + std::to_string(Spec.Seed));
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstHardwareVersion(BSTR* version)
+	{
+		*version = AllocString("1.0");
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstModel(BSTR* model)
+	{
+		*model = AllocString(ControllerType == 1 ? "Synthetic Pump" : "Synthetic Orbitrap");
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstNumChannelLabels(long* count)
+	{
+		*count = ControllerType == 1 ? 2 : 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetInstChannelLabel(long index, BSTR* label)
+	{
+		if (ControllerType != 1 || index < 0 || index > 1)
+			return E_FAIL;
+		*label = AllocString(index == 0 ? "Pump Pressure" : "Flow");
+		return S_OK;
+	}
+
+	HRESULT IXRawfile5::GetNumErrorLog(long* count)
+	{
+		*count = IsOpen ? 1 : 0;
+		return IsOpen ? S_OK : E_FAIL;
+	}
+
+	HRESULT IXRawfile5::GetErrorLogItem(long index, double* rt, BSTR* message)
+	{
+		if (!IsOpen || index != 0)
+			return E_FAIL;
+		*rt = 0;
+		*message = AllocString("Synthetic acquisition started");
+		return S_OK;
+	}
+
+}
@@ -0,0 +1,184 @@
+/* SyntheticRawFile.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+// A stand-in for the XRawfile2 type library that generates a deterministic
+// acquisition instead of reading a .raw file.  It is selected with
+// RAWFILE_SYNTHETIC so the bindings can be built and benchmarked on Linux.
+//
+// The file name is a spec of the run to generate:
+//
+//	synthetic:dda?scans=5000&peaks=1000&topn=10&trailer=20&seed=1
+//	synthetic:dia?scans=5000&peaks=1000&windows=24
+//	synthetic:dda?scans=5000&live=500		(InAcquisition, grows on RefreshViewOfFile)
+//
+// Every value is a pure function of the spec and the scan number, so two
+// handles on the same spec see the same data.
+
+#pragma once
+
+#include "atlstr.h"
+#include "comutil.h"
+
+#include <vector>
+
+namespace MSFileReaderLib {
+
+	typedef struct MS_PrecursorInfo
+	{
+		double dIsolationMass;
+		double dMonoIsoMass;
+		long nChargeState;
+		long nScanNumber;
+	} MS_PrecursorInfo;
+
+	// Parameters of the generated run, parsed from the file name
+	typedef struct SyntheticSpec
+	{
+		bool DIA;
+		long Scans;
+		long Peaks;			// MS1 peaks, MS2 scans have a quarter of these
+		long TopN;			// MS2 scans per cycle in DDA mode
+		long Windows;		// MS2 windows per cycle in DIA mode
+		long TrailerExtra;	// padding entries added to the scan trailer
+		long Live;			// scans visible at open while in acquisition, 0 for a complete file
+		unsigned long long Seed;
+	} SyntheticSpec;
+
+	typedef struct SyntheticPeak
+	{
+		double Mass;
+		double Intensity;
+		long Charge;
+	} SyntheticPeak;
+
+	class IXRawfile5
+	{
+	public:
+		IXRawfile5();
+
+		unsigned long AddRef() { return ++RefCount; }
+		unsigned long Release();
+
+		HRESULT Open(_bstr_t fileName);
+		HRESULT Close();
+		HRESULT SetCurrentController(long type, long index);
+		HRESULT GetCurrentController(long* type, long* index);
+		HRESULT GetNumberOfControllers(long* count);
+		HRESULT GetControllerType(long index, long* type);
+		HRESULT GetNumberOfControllersOfType(long type, long* count);
+		HRESULT GetFirstSpectrumNumber(long* sn);
+		HRESULT GetLastSpectrumNumber(long* sn);
+		HRESULT GetNumSpectra(long* count);
+		HRESULT GetNumStatusLog(long* count);
+		HRESULT GetStartTime(double* rt);
+		HRESULT GetEndTime(double* rt);
+		HRESULT RefreshViewOfFile();
+		HRESULT InAcquisition(long* inAcquisition);
+
+		HRESULT GetTuneDataValue(long index, _bstr_t label, VARIANT* value);
+		HRESULT GetTuneData(long index, VARIANT* labels, VARIANT* values, long* size);
+		HRESULT GetTrailerExtraValueForScanNum(long sn, _bstr_t label, VARIANT* value);
+		HRESULT GetTrailerExtraForScanNum(long sn, VARIANT* labels, VARIANT* values, long* size);
+		HRESULT GetTrailerExtraLabelsForScanNum(long sn, VARIANT* labels, long* size);
+		HRESULT GetStatusLogValueForScanNum(long sn, _bstr_t label, double* rt, VARIANT* value);
+		HRESULT GetStatusLogForScanNum(long sn, double* rt, VARIANT* labels, VARIANT* values, long* size);
+		HRESULT GetStatusLogLabelsForScanNum(long sn, double* rt, VARIANT* labels, long* size);
+		HRESULT GetStatusLogForPos(long pos, VARIANT* rt, VARIANT* values, long* size);
+		HRESULT GetStatusLogPlottableIndex(VARIANT* labels, VARIANT* indices, long* size);
+
+		HRESULT GetFilterForScanNum(long sn, BSTR* filter);
+		HRESULT GetFilters(VARIANT* filters, long* size);
+		HRESULT GetScanEventForScanNum(long sn, BSTR* scanEvent);
+		HRESULT GetScanHeaderInfoForScanNum(long sn, long* packets, double* startTime, double* lowMass, double* highMass,
+			double* tic, double* basePeakMass, double* basePeakIntensity, long* channels, long* uniformTime, double* frequency);
+		HRESULT GetSegmentAndEventForScanNum(long sn, long* segment, long* scanEvent);
+		HRESULT GetCycleNumberFromScanNumber(long sn, long* cycle);
+		HRESULT RTFromScanNum(long sn, double* rt);
+		HRESULT ScanNumFromRT(double rt, long* sn);
+		HRESULT GetMSOrderForScanNum(long sn, long* msOrder);
+		HRESULT IsCentroidScanForScanNum(long sn, long* centroid);
+		HRESULT GetIsolationWidthForScanNum(long sn, long msOrder, double* width);
+		HRESULT GetPrecursorMassForScanNum(long sn, long msOrder, double* mass);
+		HRESULT GetPrecursorInfoFromScanNum(long sn, VARIANT* info, long* size);
+
+		HRESULT GetMassListFromScanNum(long* sn, _bstr_t filter, long intensityCutoffType, long intensityCutoffValue,
+			long maxPeaks, long centroid, double* peakWidth, VARIANT* massList, VARIANT* peakFlags, long* size);
+		HRESULT GetAverageMassList(long* firstBackground1, long* lastBackground1, long* firstBackground2, long* lastBackground2,
+			long* first, long* last, _bstr_t filter, long intensityCutoffType, long intensityCutoffValue, long maxPeaks,
+			long centroid, double* peakWidth, VARIANT* massList, VARIANT* peakFlags, long* size);
+		HRESULT GetAveragedMassSpectrum(long* scans, long count, long centroid, VARIANT* massList, VARIANT* peakFlags, long* size);
+		HRESULT GetSummedMassSpectrum(long* scans, long count, long centroid, VARIANT* massList, VARIANT* peakFlags, long* size);
+		HRESULT GetLabelData(VARIANT* labels, VARIANT* flags, long* sn);
+		HRESULT GetChroData(long type1, long chroOperator, long type2, _bstr_t filter, _bstr_t massRange1, _bstr_t massRange2,
+			double delay, double* startTime, double* endTime, long smoothingType, long smoothingValue,
+			VARIANT* chroData, VARIANT* peakFlags, long* size);
+
+		HRESULT GetNumInstMethods(long* count);
+		HRESULT GetInstMethod(long index, BSTR* method);
+		HRESULT GetInstMethodNames(long* count, VARIANT* names);
+		HRESULT GetLowMass(double* mass);
+		HRESULT GetHighMass(double* mass);
+		HRESULT GetInstName(BSTR* name);
+		HRESULT GetInstSoftwareVersion(BSTR* version);
+		HRESULT GetInstSerialNumber(BSTR* serialNumber);
+		HRESULT GetInstHardwareVersion(BSTR* version);
+		HRESULT GetInstModel(BSTR* model);
+		HRESULT GetInstNumChannelLabels(long* count);
+		HRESULT GetInstChannelLabel(long index, BSTR* label);
+		HRESULT GetNumErrorLog(long* count);
+		HRESULT GetErrorLogItem(long index, double* rt, BSTR* message);
+
+	private:
+		bool IsMS() const { return IsOpen && ControllerType == 0; }
+		bool ValidScan(long sn) const { return IsMS() && sn >= 1 && sn <= Visible; }
+		long CyclePosition(long sn) const { return (sn - 1) % CycleLength(); }
+		long CycleLength() const { return 1 + (Spec.DIA ? Spec.Windows : Spec.TopN); }
+		long MasterScan(long sn) const { return sn - CyclePosition(sn); }
+		void Precursor(long sn, double& mz, long& charge, double& width) const;
+		const std::vector<SyntheticPeak>& Peaks(long sn);
+		void ReturnPeaks(const std::vector<SyntheticPeak>& peaks, VARIANT* massList, VARIANT* peakFlags, long* size);
+
+		unsigned long RefCount;
+		bool IsOpen;
+		SyntheticSpec Spec;
+		long ControllerType;
+		long ControllerIndex;
+		long Visible;						// last scan readable, below Spec.Scans while in acquisition
+		long CachedScan;
+		std::vector<SyntheticPeak> Cached;	// peaks of CachedScan
+		std::vector<double> Tic;			// per scan, computed on the first chromatogram
+	};
+
+	// Reference counted handle with the _com_ptr_t members used by the bindings
+	class IXRawfile5Ptr
+	{
+	public:
+		IXRawfile5Ptr() : Instance(NULL) {}
+		IXRawfile5Ptr(const IXRawfile5Ptr& other) : Instance(other.Instance) { if (Instance) Instance->AddRef(); }
+		~IXRawfile5Ptr() { Release(); }
+		IXRawfile5Ptr& operator=(const IXRawfile5Ptr& other)
+		{
+			if (other.Instance)
+				other.Instance->AddRef();
+			Release();
+			Instance = other.Instance;
+			return *this;
+		}
+		HRESULT CreateInstance(const char* progId);
+		void Release()
+		{
+			if (Instance)
+				Instance->Release();
+			Instance = NULL;
+		}
+		IXRawfile5* operator->() const { return Instance; }
+	private:
+		IXRawfile5* Instance;
+	};
+
+}
@@ -0,0 +1,113 @@
+/* atlstr.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "atlstr.h"
+
+#include <mutex>
+#include <set>
+
+// BSTRs carry their length in front of the characters, as in OLE
+BSTR SysAllocString(const wchar_t* s)
+{
+	if (s == NULL)
+		return NULL;
+	size_t length = wcslen(s);
+	unsigned int* block = (unsigned int*)malloc(sizeof(unsigned int) + (length + 1) * sizeof(wchar_t));
+	block[0] = (unsigned int)length;
+	BSTR result = (BSTR)(block + 1);
+	wmemcpy(result, s, length + 1);
+	return result;
+}
+
+unsigned int SysStringLen(BSTR s)
+{
+	return s == NULL ? 0 : ((unsigned int*)s)[-1];
+}
+
+void SysFreeString(BSTR s)
+{
+	if (s != NULL)
+		free(((unsigned int*)s) - 1);
+}
+
+// The bindings sometimes destroy an array and then clear the variant holding
+// it, so the live arrays are tracked and a second destroy is ignored.
+static std::mutex LiveArraysLock;
+static std::set<SAFEARRAY*> LiveArrays;
+
+SAFEARRAY* SafeArrayCreateRecords(VARTYPE vt, ULONG cbElements, ULONG count)
+{
+	SAFEARRAY* psa = new SAFEARRAY();
+	psa->cDims = 1;
+	psa->vt = vt;
+	psa->cbElements = cbElements;
+	psa->pvData = calloc(count > 0 ? count : 1, cbElements);
+	psa->rgsabound[0].cElements = count;
+	psa->rgsabound[0].lLbound = 0;
+
+	std::lock_guard<std::mutex> lock(LiveArraysLock);
+	LiveArrays.insert(psa);
+	return psa;
+}
+
+HRESULT SafeArrayAccessData(SAFEARRAY* psa, void** ppvData)
+{
+	if (psa == NULL)
+	{
+		*ppvData = NULL;
+		return E_INVALIDARG;
+	}
+	*ppvData = psa->pvData;
+	return S_OK;
+}
+
+HRESULT SafeArrayUnaccessData(SAFEARRAY* psa)
+{
+	return psa == NULL ? E_INVALIDARG : S_OK;
+}
+
+HRESULT SafeArrayDestroy(SAFEARRAY* psa)
+{
+	{
+		std::lock_guard<std::mutex> lock(LiveArraysLock);
+		if (psa == NULL || LiveArrays.erase(psa) == 0)
+			return E_INVALIDARG;
+	}
+
+	if (psa->vt == VT_BSTR)
+	{
+		BSTR* items = (BSTR*)psa->pvData;
+		for (ULONG i = 0; i < psa->rgsabound[0].cElements; i++)
+			SysFreeString(items[i]);
+	}
+	else if (psa->vt == VT_VARIANT)
+	{
+		VARIANT* items = (VARIANT*)psa->pvData;
+		for (ULONG i = 0; i < psa->rgsabound[0].cElements; i++)
+			VariantClear(&items[i]);
+	}
+	free(psa->pvData);
+	delete psa;
+	return S_OK;
+}
+
+void VariantInit(VARIANT* pvarg)
+{
+	memset(pvarg, 0, sizeof(VARIANT));
+	pvarg->vt = VT_EMPTY;
+}
+
+HRESULT VariantClear(VARIANT* pvarg)
+{
+	if (pvarg->vt & VT_ARRAY)
+		SafeArrayDestroy(pvarg->parray);
+	else if (pvarg->vt == VT_BSTR)
+		SysFreeString(pvarg->bstrVal);
+	VariantInit(pvarg);
+	return S_OK;
+}
@@ -0,0 +1,120 @@
+/* atlstr.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+// Minimal stand-ins for the Windows, OLE and ATL types used by RawFile.cpp so
+// the bindings build on Linux against the synthetic reader.  Only what the
+// bindings use is provided, with the same ownership rules as OLE.
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <string>
+
+typedef int HRESULT;					// 32 bits as on Windows, so the failure codes are negative
+typedef wchar_t* BSTR;
+typedef const char* LPCTSTR;
+typedef unsigned short VARTYPE;
+typedef unsigned long ULONG;
+typedef long LONG;
+typedef short VARIANT_BOOL;
+typedef long SCODE;
+
+#define FAR
+#define S_OK						((HRESULT)0)
+#define E_FAIL						((HRESULT)0x80004005L)
+#define E_INVALIDARG				((HRESULT)0x80070057L)
+#define SUCCEEDED(hr)				((HRESULT)(hr) >= 0)
+#define FAILED(hr)					((HRESULT)(hr) < 0)
+#define COINIT_APARTMENTTHREADED	0x2
+#define COINIT_MULTITHREADED		0x0
+
+enum VARENUM
+{
+	VT_EMPTY = 0,
+	VT_NULL = 1,
+	VT_I2 = 2,
+	VT_I4 = 3,
+	VT_R4 = 4,
+	VT_R8 = 5,
+	VT_BSTR = 8,
+	VT_ERROR = 10,
+	VT_BOOL = 11,
+	VT_VARIANT = 12,
+	VT_UI1 = 17,
+	VT_RECORD = 36,
+	VT_ARRAY = 0x2000
+};
+
+typedef struct tagSAFEARRAYBOUND
+{
+	ULONG cElements;
+	LONG lLbound;
+} SAFEARRAYBOUND;
+
+// rgsabound[0] holds the number of records, as the readers return them
+typedef struct tagSAFEARRAY
+{
+	unsigned short cDims;
+	VARTYPE vt;
+	ULONG cbElements;
+	void* pvData;
+	SAFEARRAYBOUND rgsabound[2];
+} SAFEARRAY;
+
+typedef struct tagVARIANT
+{
+	VARTYPE vt;
+	union
+	{
+		BSTR bstrVal;
+		float fltVal;
+		double dblVal;
+		long lVal;
+		short iVal;
+		VARIANT_BOOL boolVal;
+		unsigned char bVal;
+		SCODE scode;
+		SAFEARRAY* parray;
+	};
+} VARIANT;
+
+BSTR SysAllocString(const wchar_t* s);
+unsigned int SysStringLen(BSTR s);
+void SysFreeString(BSTR s);
+
+// records of cbElements bytes, or BSTRs (VARIANTs) when vt is VT_BSTR (VT_VARIANT)
+SAFEARRAY* SafeArrayCreateRecords(VARTYPE vt, ULONG cbElements, ULONG count);
+HRESULT SafeArrayAccessData(SAFEARRAY* psa, void** ppvData);
+HRESULT SafeArrayUnaccessData(SAFEARRAY* psa);
+HRESULT SafeArrayDestroy(SAFEARRAY* psa);
+
+void VariantInit(VARIANT* pvarg);
+HRESULT VariantClear(VARIANT* pvarg);
+
+inline HRESULT CoInitialize(void*) { return S_OK; }
+inline HRESULT CoInitializeEx(void*, unsigned long) { return S_OK; }
+inline void CoUninitialize() {}
+
+// Narrow copy of a wide string, characters outside ASCII become '?'
+class CStringA
+{
+public:
+	CStringA() {}
+	CStringA(const char* s) : Value(s != NULL ? s : "") {}
+	CStringA(const wchar_t* s)
+	{
+		for (; s != NULL && *s; s++)
+			Value.push_back(*s < 128 ? (char)*s : '?');
+	}
+	operator const char*() const { return Value.c_str(); }
+	int GetLength() const { return (int)Value.size(); }
+private:
+	std::string Value;
+};
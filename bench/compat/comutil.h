@@ -0,0 +1,41 @@
+/* comutil.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+// Stand-in for the _bstr_t string wrapper, see atlstr.h
+
+#pragma once
+
+#include "atlstr.h"
+
+class _bstr_t
+{
+public:
+	_bstr_t() {}
+	_bstr_t(const char* s)
+	{
+		for (; s != NULL && *s; s++)
+		{
+			Narrow.push_back(*s);
+			Wide.push_back((unsigned char)*s);
+		}
+	}
+	_bstr_t(const wchar_t* s)
+	{
+		for (; s != NULL && *s; s++)
+		{
+			Wide.push_back(*s);
+			Narrow.push_back(*s < 128 ? (char)*s : '?');
+		}
+	}
+	operator const char*() const { return Narrow.c_str(); }
+	operator const wchar_t*() const { return Wide.c_str(); }
+	unsigned int length() const { return (unsigned int)Wide.size(); }
+private:
+	std::string Narrow;
+	std::wstring Wide;
+};
@@ -31,6 +31,12 @@ print(rawFile.FilePath)			-- Filepath to the raw file
 print(rawFile:Open())			-- Open the connection to read data
 print(rawFile.IsOpen)			-- Status if the connection is open or not
 print(rawFile:InAcquisition())	-- Usually will be false, variable to spin on
+-- Follow a running acquisition, waiting up to 5 s for each batch of new scans
+-- while rawFile:InAcquisition() do
+--	for sn in rawFile:NewScans(5000) do
+--		print("New scan", sn, rawFile:GetRetentionTime(sn))
+--	end
+-- end
 print(rawFile:GetInstrumentMethod(1))
 
 print(rawFile:GetLowMass())
@@ -47,6 +53,20 @@ for i,name in ipairs(rawFile:GetInstrumentMethodNames()) do
     print("Instrument Method Index:",i,"name:",name)
 end
 
+print("== Method Tree ==")
+local function printMethodNode(node, indent)
+	for _, key in ipairs(node.Keys) do
+		print(indent .. key, node.Parameters[key])
+	end
+	for _, child in ipairs(node.Children) do
+		print(indent .. child.Name)
+		printMethodNode(child, indent .. "  ")
+	end
+end
+printMethodNode(rawFile:GetMethodTree(), "")
+print(rawFile:GetMethodGlobalParameter({label = "Method Duration (min)"}))
+print(rawFile:GetMethodScanParameter({label = "Maximum Injection Time (ms)", experiment = 1, event = "Event 1"}))
+
 -- Helper function 
 local printf = function(formatString, ...)
 	print(string.format(formatString, ...))
@@ -127,12 +147,143 @@ for _,chroPoint in ipairs(chro) do
 	print(chroPoint.Time,chroPoint.Intensity)	
 end
 
+print("== Devices ==")
+for _, device in ipairs(rawFile:Devices()) do
+	print(device.Type, device.TypeName, device.Index)
+	if device.Type ~= 0 then
+		local trace = rawFile:GetTrace(device.Type, device.Index, {channel = 0})
+		print(#trace.Time, trace.StartTime, trace.EndTime)
+	end
+end
+
 print("== Label Data ==")
 local peaks = rawFile:GetLabelData(1)
 for _,labelPeak in ipairs(peaks) do	
 	print(labelPeak.Mass,labelPeak.Intensity, labelPeak.Noise, labelPeak.Baseline, labelPeak.Resolution, labelPeak.Charge, labelPeak.Exception,labelPeak.Fragmented, labelPeak.Merged, labelPeak.Modified, labelPeak.Saturated)	
 end
 
+print("== Columnar Label Data ==")
+local columns = rawFile:GetLabelData(1, {fields = {"Mass", "Intensity", "Charge", "Noise", "Flags"}})
+for i = 1, #columns.Mass do
+	local saturated = columns.Flags[i] % (2 * RawFile.LabelFlags.Saturated) >= RawFile.LabelFlags.Saturated
+	print(columns.Mass[i], columns.Intensity[i], columns.Charge[i], columns.Noise[i], saturated)
+end
+
+print("== Reused Results ==")
+-- Filling the same tables for every scan keeps a whole run loop from allocating
+local spectrumOptions = {into = {}}
+local labelOptions = {fields = {"Mass", "Intensity"}, into = {}}
+for sn = rawFile.FirstSpectrumNumber, rawFile.LastSpectrumNumber do
+	local spectrum = rawFile:GetSpectrum(sn, spectrumOptions)
+	local labels = rawFile:GetLabelData(sn, labelOptions)
+	print(sn, #spectrum, #labels.Mass)
+end
+
+print("== Selected Scans ==")
+-- Only the fields used are read, the MS order and time were read to select the scan
+for scan in rawFile:Scans{msOrder = 2, rtRange = {0.5, 1.5}} do
+	print(scan.Number, scan.RetentionTime, scan.PrecursorMass, #scan.Peaks)
+end
+
+print("== Spectra In Memory ==")
+-- Later passes over the MS1 spectra are served from a compressed copy
+local loaded = rawFile:LoadAll({msOrder = 1, codec = "delta-mz+float16"})
+print(loaded.Scans, loaded.Bytes, loaded.RawBytes, loaded.Complete)
+print(#rawFile:GetSpectrum(1))
+rawFile:LoadAll(false)
+
+print("== Averaged Spectrum ==")
+local averaged = rawFile:AverageSpectra({10, 11, 12}, {ppm = 5, mode = "mean"})
+for i = 1, #averaged.Mass do
+	print(averaged.Mass[i], averaged.Intensity[i])
+end
+
+print("== Binned Spectra ==")
+local binned = rawFile:BinSpectra({10, 11, 12}, {binWidth = 1.0005, min = 100, max = 2000, normalize = "sqrt"})
+print(binned, binned:Size())
+print(binned:Get(1, 1))
+-- binned:Save("binned.npy")		-- loadable with numpy.load
+
+print("== Library Search ==")
+-- local library = RawFile.LoadLibrary([[library.msp]])
+-- local hits = rawFile:SearchLibrary(library, {precursorPpm = 10, fragmentTol = 0.02, topN = 1})
+-- for i = 1, #hits.ScanNumber do
+--	print(hits.ScanNumber[i], hits.Name[i], hits.PrecursorMz[i], hits.Score[i])
+-- end
+
+print("== File Summaries ==")
+local summary = RawFile.Summarize({[[Basic.raw]]}, {workers = 4})
+for i = 1, #summary.FilePath do
+	print(summary.FilePath[i], summary.InstrumentModel[i], summary.StartTime[i], summary.EndTime[i], summary.TIC[i], table.concat(summary.ScanCounts[i] or {}, " "))
+end
+
+print("== Deisotoped ==")
+local envelopes = rawFile:Deisotope(1, {ppm = 5, maxCharge = 8})
+for i = 1, #envelopes.MonoisotopicMass do
+	print(envelopes.MonoisotopicMass[i], envelopes.Charge[i], envelopes.Intensity[i])
+end
+
+print("== Call Statistics ==")
+rawFile:EnableStats(true)
+for sn = rawFile.FirstSpectrumNumber, rawFile.LastSpectrumNumber do
+	rawFile:GetSpectrum(sn)
+end
+for name, stats in pairs(rawFile:GetStats()) do
+	printf("%s calls %d total %.3fs com %.3fs lua %.3fs p99 %.6fs %d bytes", name, stats.Calls, stats.TotalTime, stats.ComTime, stats.LuaTime, stats.P99, stats.LuaBytes)
+end
+rawFile:ResetStats()
+rawFile:EnableStats(false)
+
 print("== Precursor Data==")
 print(rawFile:GetPrecursorMass(13))
 
+print("== TIC and Base Peak ==")
+local series = rawFile:GetHeaderSeries({"StartTime", "TIC", "BasePeakIntensity"}, {msOrder = 1})
+for i = 1, #series.ScanNumber do
+	print(series.ScanNumber[i], series.StartTime[i], series.TIC[i], series.BasePeakIntensity[i])
+end
+
+print("== Scan Headers ==")
+local headers = rawFile:GetScanHeaders(1, 10, {"NumPackets", "StartTime", "UniformTime"})
+for i = 1, #headers.ScanNumber do
+	print(headers.ScanNumber[i], headers.NumPackets[i], headers.StartTime[i], headers.UniformTime[i])
+end
+
+print("== Isolation Scheme ==")
+local scheme = rawFile:GetIsolationScheme()
+for w = 1, #scheme.Windows.Center do
+	print(w, scheme.Windows.LowMz[w], scheme.Windows.HighMz[w], scheme.Windows.ScanEvent[w], scheme.Windows.Scans[w])
+end
+print("Cycles", #scheme.Cycles.FirstScan)
+
+print("== DIA Fragments ==")
+local extracted = rawFile:ExtractDIAFragments({
+	{mz = 500.25, fragments = {600.3, 700.35}, ppm = 20, rtRange = {0, 5}},
+})
+for t, target in ipairs(extracted) do
+	for i = 1, #target.ScanNumber do
+		print(t, target.ScanNumber[i], target.RetentionTime[i], target.Intensities[1][i], target.Intensities[2][i])
+	end
+end
+
+print("== All Trailers ==")
+local trailers = rawFile:GetAllTrailers(nil, nil, {workers = 2})
+for _, label in ipairs(trailers.Labels) do
+	local column = trailers.Columns[label]
+	local value = column.Values[1]
+	if column.Type == "string" then value = column.Dictionary[value] end
+	print(label, column.Type, column.Missing[1] and "-" or value)
+end
+
+print("== Status Log Series ==")
+local series = rawFile:GetStatusLogSeries()
+for label, values in pairs(series) do
+	print(label, #values, values[1])
+end
+
+print("== Precursor Context ==")
+local context = rawFile:GetPrecursorContext()
+for i = 1, #context.ScanNumber do
+	print(context.ScanNumber[i], context.MasterScanNumber[i], context.PrecursorMz[i], context.Charge[i], context.IsolationWidth[i], context.PrecursorIntensity[i])
+end
+
@@ -0,0 +1,67 @@
+/* Codec.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace RawFile {
+
+	// The codings of Encode and Decode, named as in CodecNames
+	enum CodecType { CodecNumpressLinear, CodecNumpressPic, CodecNumpressSlof, CodecDeltaVarint,
+		CodecShuffle, CodecFloat32, CodecFloat16 };
+
+	// NULL terminated, in CodecType order
+	extern const char* const CodecNames[];
+
+	// Encode values, appending to out.  The Numpress linear and slof codings
+	// take a fixed point, 0 chooses the best one for the values.
+	void Encode(CodecType type, const double* values, size_t count, std::vector<unsigned char>& out, double fixedPoint = 0);
+	// Decode all the values of data, appending to values, false if it's malformed
+	bool Decode(CodecType type, const unsigned char* data, size_t size, std::vector<double>& values);
+
+	// MS-Numpress, byte compatible with the reference implementation.  Linear
+	// suits masses, pic (positive integers) counts and slof (short logged
+	// float) intensities.  The fixed point, if any, is at the start.
+	double OptimalLinearFixedPoint(const double* values, size_t count);
+	double OptimalSlofFixedPoint(const double* values, size_t count);
+	void EncodeNumpressLinear(const double* values, size_t count, double fixedPoint, std::vector<unsigned char>& out);
+	bool DecodeNumpressLinear(const unsigned char* data, size_t size, std::vector<double>& values);
+	void EncodeNumpressPic(const double* values, size_t count, std::vector<unsigned char>& out);
+	bool DecodeNumpressPic(const unsigned char* data, size_t size, std::vector<double>& values);
+	void EncodeNumpressSlof(const double* values, size_t count, double fixedPoint, std::vector<unsigned char>& out);
+	bool DecodeNumpressSlof(const unsigned char* data, size_t size, std::vector<double>& values);
+
+	// Zigzag varints of the differences between the bit patterns of successive
+	// doubles.  Exact for any values, and shortest for sorted, close values
+	// such as the masses of a spectrum.
+	void EncodeDeltaDoubles(const double* values, size_t count, std::vector<unsigned char>& out);
+	// Decode count values, the bytes read are returned, 0 if the data is short
+	size_t DecodeDeltaDoubles(const unsigned char* data, size_t size, size_t count, double* values);
+
+	// Group the bytes of elements of the given size by their position in the
+	// element, the first bytes of all elements first.  Slowly changing values
+	// then give long runs for a general purpose compressor.
+	void ShuffleBytes(const unsigned char* data, size_t count, size_t elementSize, unsigned char* out);
+	void UnshuffleBytes(const unsigned char* data, size_t count, size_t elementSize, unsigned char* out);
+
+	// Doubles truncated to floats, and back, four at a time with AVX
+	void EncodeFloat(const double* values, size_t count, float* out);
+	void DecodeFloat(const float* data, size_t count, double* values);
+
+	// IEEE half precision, rounded to nearest even
+	unsigned short FloatToHalf(float value);
+	float HalfToFloat(unsigned short value);
+
+	// Values divided by scale as half precision, and back, eight at a time
+	// where the compiler targets F16C
+	void EncodeHalf(const double* values, size_t count, double scale, unsigned short* out);
+	void DecodeHalf(const unsigned short* data, size_t count, double scale, double* values);
+
+}
@@ -0,0 +1,111 @@
+/* ComBackend.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include "RawFileBackend.h"
+
+#include <algorithm>
+#include <atlstr.h>
+#include <comutil.h>
+
+// This uses the MS File Reader type library, but works for Foundation as well.
+// The benchmarks build against a generated stand-in, see bench/SyntheticRawFile.h
+#ifdef RAWFILE_SYNTHETIC
+#include "SyntheticRawFile.h"
+#else
+#import "XRawfile2.tlb"
+#endif
+
+// MS File Reader COM details
+#define MSFR_XRAWFILE				"MSFileReader.XRawfile.1"
+#define MSFR_CLSID					"1d23188d-53fe-4c25-b032-dc70acdbdc02"
+
+// Foundation COM details
+#define FOUNDATION_XRAWFILE			"XRawfile.XRawfile.1"
+#define FOUNDATION_CLSID			"5fe970b2-29c3-11d3-811d-00104b304896"
+
+#ifdef PERFER_MS_FILE_READER
+#define RAW_FILE_INSTANCE			MSFR_XRAWFILE
+#define RAW_FILE_INSTANCE_BACKUP	FOUNDATION_XRAWFILE
+#else
+#define RAW_FILE_INSTANCE			FOUNDATION_XRAWFILE
+#define RAW_FILE_INSTANCE_BACKUP	MSFR_XRAWFILE
+#endif
+
+namespace RawFile {
+
+	// The XRawfile2 COM component of MS File Reader or Foundation.  Failed calls,
+	// whether reported or thrown by the wrappers, return false.
+	class ComBackend : public RawFileBackend
+	{
+	public:
+		ComBackend();
+		~ComBackend();
+
+		// The result of creating the COM instance, 0 when it succeeded
+		HRESULT Status() const { return Init; }
+
+		bool Open(const char* fileName);
+		void Close();
+		bool SetCurrentController(long type, long index);
+		bool GetNumberOfControllers(long& count);
+		bool GetControllerType(long index, long& type);
+		bool GetFirstSpectrumNumber(long& sn);
+		bool GetLastSpectrumNumber(long& sn);
+		bool InAcquisition(bool& inAcquisition);
+		bool RefreshViewOfFile();
+		bool SupportsParallelReads(bool& parallel);
+
+		bool GetTuneData(long index, LabelValues& entries);
+		bool GetTuneDataValue(long index, const std::string& label, ReaderValue& value);
+		bool GetTrailerExtra(long sn, LabelValues& entries);
+		bool GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value);
+		bool GetStatusLog(long sn, double& rt, LabelValues& entries);
+		bool GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value);
+		bool GetNumStatusLog(long& count);
+		bool GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values);
+		bool GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices);
+
+		bool GetScanHeader(long sn, ScanHeader& header);
+		bool GetFilter(long sn, std::string& filter);
+		bool GetSegmentAndEvent(long sn, long& segment, long& scanEvent);
+		bool RTFromScanNum(long sn, double& rt);
+		bool ScanNumFromRT(double rt, long& sn);
+		bool GetMSOrder(long sn, long& msOrder);
+		bool IsCentroidScan(long sn, bool& centroid);
+		bool GetIsolationWidth(long sn, long msOrder, double& width);
+		bool GetPrecursorMass(long sn, long msOrder, double& mass);
+
+		bool GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks);
+		bool GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags);
+		bool GetAveragedSpectrum(const std::vector<long>& scans, bool sum, std::vector<DataPeak>& peaks);
+		bool GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points);
+
+		bool GetNumInstMethods(long& count);
+		bool GetInstMethod(long index, std::string& method);
+		bool GetInstMethodNames(std::vector<std::string>& names);
+		bool GetLowMass(double& mass);
+		bool GetHighMass(double& mass);
+		bool GetInstName(std::string& name);
+		bool GetInstSoftwareVersion(std::string& version);
+		bool GetInstSerialNumber(std::string& serialNumber);
+		bool GetInstHardwareVersion(std::string& version);
+		bool GetInstModel(std::string& model);
+		bool GetNumErrorLog(long& count);
+		bool GetErrorLogItem(long index, double& rt, std::string& message);
+
+	private:
+		ComBackend(const ComBackend&);
+		ComBackend& operator=(const ComBackend&);
+
+		MSFileReaderLib::IXRawfile5Ptr Raw;
+		HRESULT Init;
+	};
+
+}
@@ -0,0 +1,133 @@
+/* MemoryBackend.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include "RawFileBackend.h"
+
+#include <map>
+
+namespace RawFile {
+
+	typedef struct _memoryScan
+	{
+		ScanHeader Header;
+		std::string Filter;
+		long MSOrder;
+		bool Centroid;
+		long Segment;
+		long Event;
+		std::vector<double> PrecursorMass;		// per MSn stage from 2
+		std::vector<double> IsolationWidth;
+		std::vector<DataPeak> Peaks;
+		std::vector<DataPeak> Centroids;			// the reader's centroids of a profile scan
+		std::vector<LabelData> Labels;
+		std::vector<LabelFlags> Flags;
+		LabelValues Trailer;
+		size_t StatusLog;						// index into StatusLogs
+	} MemoryScan;
+
+	typedef struct _memoryStatusLog
+	{
+		double RetentionTime;
+		LabelValues Entries;
+	} MemoryStatusLog;
+
+	typedef struct _memoryStatusRecord
+	{
+		double RetentionTime;
+		std::vector<ReaderValue> Values;
+	} MemoryStatusRecord;
+
+	// A whole run held in memory.  Open reads every MS scan of the file through
+	// another reader (the default one unless named as "memory:<reader>") and
+	// closes it again, so later reads never touch the file.  Only the MS
+	// controller is kept.  Typed values are recovered from their text, and
+	// chromatograms are rebuilt from the scans: mass range (type 0), TIC (1)
+	// and base peak (2), without delay or smoothing, where the filter selects
+	// the scans whose filter contains it.
+	class MemoryBackend : public RawFileBackend
+	{
+	public:
+		MemoryBackend(const std::string& source);
+
+		bool Open(const char* fileName);
+		void Close();
+		bool SetCurrentController(long type, long index);
+		bool GetNumberOfControllers(long& count);
+		bool GetControllerType(long index, long& type);
+		bool GetFirstSpectrumNumber(long& sn);
+		bool GetLastSpectrumNumber(long& sn);
+		bool InAcquisition(bool& inAcquisition);
+		bool RefreshViewOfFile();
+		bool SupportsParallelReads(bool& parallel);
+
+		bool GetTuneData(long index, LabelValues& entries);
+		bool GetTuneDataValue(long index, const std::string& label, ReaderValue& value);
+		bool GetTrailerExtra(long sn, LabelValues& entries);
+		bool GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value);
+		bool GetStatusLog(long sn, double& rt, LabelValues& entries);
+		bool GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value);
+		bool GetNumStatusLog(long& count);
+		bool GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values);
+		bool GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices);
+
+		bool GetScanHeader(long sn, ScanHeader& header);
+		bool GetFilter(long sn, std::string& filter);
+		bool GetSegmentAndEvent(long sn, long& segment, long& scanEvent);
+		bool RTFromScanNum(long sn, double& rt);
+		bool ScanNumFromRT(double rt, long& sn);
+		bool GetMSOrder(long sn, long& msOrder);
+		bool IsCentroidScan(long sn, bool& centroid);
+		bool GetIsolationWidth(long sn, long msOrder, double& width);
+		bool GetPrecursorMass(long sn, long msOrder, double& mass);
+
+		bool GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks);
+		bool GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags);
+		bool GetAveragedSpectrum(const std::vector<long>& scans, bool sum, std::vector<DataPeak>& peaks);
+		bool GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points);
+
+		bool GetNumInstMethods(long& count);
+		bool GetInstMethod(long index, std::string& method);
+		bool GetInstMethodNames(std::vector<std::string>& names);
+		bool GetLowMass(double& mass);
+		bool GetHighMass(double& mass);
+		bool GetInstName(std::string& name);
+		bool GetInstSoftwareVersion(std::string& version);
+		bool GetInstSerialNumber(std::string& serialNumber);
+		bool GetInstHardwareVersion(std::string& version);
+		bool GetInstModel(std::string& model);
+		bool GetNumErrorLog(long& count);
+		bool GetErrorLogItem(long index, double& rt, std::string& message);
+
+	private:
+		const MemoryScan* Scan(long sn) const;
+		bool Load(RawFileBackend& source);
+
+		std::string Source;
+		bool IsOpen;
+		long FirstScan;
+		std::vector<MemoryScan> Scans;
+		std::vector<MemoryStatusLog> StatusLogs;
+		std::vector<MemoryStatusRecord> StatusRecords;		// by position
+		std::vector<std::string> PlottableLabels;
+		std::vector<long> PlottableIndices;
+		std::vector<LabelValues> TuneData;
+		std::vector<std::string> Methods;
+		std::vector<std::string> MethodNames;
+		std::map<long, std::pair<double, std::string> > ErrorLog;	// by the reader's index
+		double LowMass;
+		double HighMass;
+		std::string InstName;
+		std::string InstSoftwareVersion;
+		std::string InstSerialNumber;
+		std::string InstHardwareVersion;
+		std::string InstModel;
+	};
+
+}
@@ -0,0 +1,61 @@
+/* MethodTree.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace RawFile {
+
+	typedef struct _methodParameter
+	{
+		std::string Key;
+		std::string Value;
+		size_t Node;
+	} MethodParameter;
+
+	// A section header of the method report (Global Settings, Experiment 1, Scan Event 1, ...)
+	typedef struct _methodNode
+	{
+		std::string Name;
+		int Indent;
+		size_t Parent;
+		std::vector<size_t> Children;
+		size_t FirstParameter;
+		size_t EndParameter;
+	} MethodNode;
+
+	// The instrument method report parsed once into a tree of sections by indentation
+	typedef struct MethodTree
+	{
+		std::vector<MethodNode> Nodes;				// Nodes[0] is the root, in document order
+		std::vector<MethodParameter> Parameters;	// in document order
+
+		// Every occurrence of a section name or parameter key, in document order
+		std::unordered_map<std::string, std::vector<size_t> > SectionIndex;
+		std::unordered_map<std::string, std::vector<size_t> > ParameterIndex;
+
+		MethodTree(const std::string& text);
+
+		// The first section named by each element of the path after the section
+		// of the element before, or NULL.  As in the method text, the match may
+		// be a later sibling rather than a subsection: a "Scan Event 1" under
+		// an experiment's Decision comes before the Scan Event 1 section.
+		const MethodNode* Find(const std::vector<std::string>& path) const;
+
+		// The first parameter after the start of node matching label, or NULL.
+		// A partial match accepts any key containing the label.
+		const MethodParameter* Lookup(const MethodNode* node, const std::string& label, bool partial) const;
+
+		// Trim whitespace and a trailing '=' or ':' separator from a label
+		static std::string NormalizeKey(const std::string& label);
+	} MethodTree;
+
+}
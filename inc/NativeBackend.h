@@ -0,0 +1,172 @@
+/* NativeBackend.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include "RawFileBackend.h"
+
+namespace RawFile {
+
+	// A generic data descriptor: the type and size of a tune, trailer or status log field
+	typedef struct _nativeField
+	{
+		unsigned long Type;
+		unsigned long Length;					// characters for text, precision for floats
+		std::string Label;
+		size_t Offset;							// within the record
+	} NativeField;
+
+	typedef struct _nativeRecords
+	{
+		std::vector<NativeField> Fields;
+		size_t RecordSize;
+		size_t Address;							// of the first record
+		size_t Stride;							// from one record to the next, a leading time included
+		size_t Count;
+	} NativeRecords;
+
+	typedef struct _nativeReaction
+	{
+		double PrecursorMass;
+		double IsolationWidth;
+		double Energy;
+		unsigned long Flags;					// bit 0 energy valid, the activation type above it
+	} NativeReaction;
+
+	typedef struct _nativeEvent
+	{
+		unsigned char Polarity;
+		unsigned char ScanMode;					// 0 centroid, 1 profile
+		unsigned char MSOrder;
+		unsigned char ScanType;
+		unsigned char Dependent;
+		unsigned char Ionization;
+		unsigned char Analyzer;
+		std::vector<NativeReaction> Reactions;
+		std::vector<std::pair<double, double> > MassRanges;
+		std::vector<double> Coefficients;		// frequency to m/z conversion of FT scans
+	} NativeEvent;
+
+	typedef struct _nativeScan
+	{
+		ScanHeader Header;
+		long Segment;
+		long Event;
+		unsigned long PacketType;
+		size_t Address;
+		size_t Size;
+	} NativeScan;
+
+	// Reads .raw files directly, without the COM component, from a read only
+	// memory map of the file.  Open decodes the run header, scan index, scan
+	// events, trailers and logs of the MS controller, spectra are decoded from
+	// their packets when asked for.  The layout is that of version 66 files,
+	// other versions and further controllers are not read.  Profile data is
+	// returned as stored, centroids are the file's where it has them and
+	// otherwise found in the profile, and chromatograms are computed as for
+	// the memory reader.
+	class NativeBackend : public RawFileBackend
+	{
+	public:
+		NativeBackend();
+		~NativeBackend();
+
+		bool Open(const char* fileName);
+		void Close();
+		bool SetCurrentController(long type, long index);
+		bool GetNumberOfControllers(long& count);
+		bool GetControllerType(long index, long& type);
+		bool GetFirstSpectrumNumber(long& sn);
+		bool GetLastSpectrumNumber(long& sn);
+		bool InAcquisition(bool& inAcquisition);
+		bool RefreshViewOfFile();
+		bool SupportsParallelReads(bool& parallel);
+
+		bool GetTuneData(long index, LabelValues& entries);
+		bool GetTuneDataValue(long index, const std::string& label, ReaderValue& value);
+		bool GetTrailerExtra(long sn, LabelValues& entries);
+		bool GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value);
+		bool GetStatusLog(long sn, double& rt, LabelValues& entries);
+		bool GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value);
+		bool GetNumStatusLog(long& count);
+		bool GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values);
+		bool GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices);
+
+		bool GetScanHeader(long sn, ScanHeader& header);
+		bool GetFilter(long sn, std::string& filter);
+		bool GetSegmentAndEvent(long sn, long& segment, long& scanEvent);
+		bool RTFromScanNum(long sn, double& rt);
+		bool ScanNumFromRT(double rt, long& sn);
+		bool GetMSOrder(long sn, long& msOrder);
+		bool IsCentroidScan(long sn, bool& centroid);
+		bool GetIsolationWidth(long sn, long msOrder, double& width);
+		bool GetPrecursorMass(long sn, long msOrder, double& mass);
+
+		bool GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks);
+		bool GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags);
+		bool GetAveragedSpectrum(const std::vector<long>& scans, bool sum, std::vector<DataPeak>& peaks);
+		bool GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points);
+
+		bool GetNumInstMethods(long& count);
+		bool GetInstMethod(long index, std::string& method);
+		bool GetInstMethodNames(std::vector<std::string>& names);
+		bool GetLowMass(double& mass);
+		bool GetHighMass(double& mass);
+		bool GetInstName(std::string& name);
+		bool GetInstSoftwareVersion(std::string& version);
+		bool GetInstSerialNumber(std::string& serialNumber);
+		bool GetInstHardwareVersion(std::string& version);
+		bool GetInstModel(std::string& model);
+		bool GetNumErrorLog(long& count);
+		bool GetErrorLogItem(long index, double& rt, std::string& message);
+
+	private:
+		NativeBackend(const NativeBackend&);
+		NativeBackend& operator=(const NativeBackend&);
+
+		bool Map(const char* fileName);
+		void Unmap();
+		void ReadAhead(size_t address, size_t size) const;
+		bool Decode();
+		bool DecodeMethods(size_t address);
+		const NativeScan* Scan(long sn) const;
+		const NativeEvent* Event(long sn) const;
+		bool Record(const NativeRecords& records, size_t index, LabelValues& entries) const;
+		bool RecordValue(const NativeRecords& records, size_t index, const std::string& label, ReaderValue& value) const;
+		long StatusLogIndex(long sn) const;
+		bool ReadPeaks(const NativeScan& scan, std::vector<DataPeak>& peaks, std::vector<LabelData>* labels, std::vector<LabelFlags>* flags) const;
+		bool ReadProfile(const NativeScan& scan, const NativeEvent& event, std::vector<DataPeak>& peaks) const;
+
+		// The mapped file
+		const unsigned char* Data;
+		size_t Size;
+		void* File;
+		void* Mapping;
+
+		bool IsOpen;
+		long FirstScan;
+		long LastScan;
+		size_t DataAddress;
+		std::vector<NativeScan> Scans;
+		std::vector<NativeEvent> Events;		// by scan
+		NativeRecords Trailers;					// by scan
+		NativeRecords StatusLogs;				// retention time first
+		NativeRecords TuneData;
+		std::vector<std::pair<double, std::string> > ErrorLog;
+		std::vector<std::string> Methods;
+		std::vector<std::string> MethodNames;
+		double LowMass;
+		double HighMass;
+		std::string InstName;
+		std::string InstSoftwareVersion;
+		std::string InstSerialNumber;
+		std::string InstHardwareVersion;
+		std::string InstModel;
+	};
+
+}
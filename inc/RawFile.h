@@ -22,43 +22,47 @@
 #define luaD_getString(L, field, value) lua_getfield(L, -1, field); if (lua_isstring(L, -1)) value = lua_tostring(L, -1); lua_pop(L, 1)
 #define luaD_getBoolean(L, field, value) lua_getfield(L, -1, field); if (lua_isboolean(L, -1)) value = lua_toboolean(L, -1); lua_pop(L, 1)
 
+#define ISOTOPE_SPACING				1.00335483		// 13C - 12C
+#define PROTON_MASS					1.00727646688
+
 #define RawFileVersion				"1.0.0"
 #define RawFileType					"LuaRawFile.Rawfile"
 #define checkRawFile(L)				*reinterpret_cast<RawFile**>(luaL_checkudata(L, 1, RawFileType))
-
-// MS File Reader COM details
-#define MSFR_XRAWFILE				"MSFileReader.XRawfile.1"
-#define MSFR_CLSID					"1d23188d-53fe-4c25-b032-dc70acdbdc02"
-
-// Foundation COM details
-#define FOUNDATION_XRAWFILE			"XRawfile.XRawfile.1"
-#define FOUNDATION_CLSID			"5fe970b2-29c3-11d3-811d-00104b304896"
-
-#ifdef PERFER_MS_FILE_READER
-#define RAW_FILE_INSTANCE			MSFR_XRAWFILE
-#define RAW_FILE_INSTANCE_BACKUP	FOUNDATION_XRAWFILE
-#else
-#define RAW_FILE_INSTANCE			FOUNDATION_XRAWFILE
-#define RAW_FILE_INSTANCE_BACKUP	MSFR_XRAWFILE
-#endif
+#define MatrixType					"LuaRawFile.Matrix"
+#define checkMatrix(L)				*reinterpret_cast<Matrix**>(luaL_checkudata(L, 1, MatrixType))
+#define LibraryType					"LuaRawFile.Library"
+#define checkLibrary(L, i)			*reinterpret_cast<Library**>(luaL_checkudata(L, i, LibraryType))
+#define ScanType					"LuaRawFile.Scan"
+#define checkScan(L)				*reinterpret_cast<long*>(luaL_checkudata(L, 1, ScanType))
 
 #include <lua.hpp>
 #include <iostream>
 #include <sstream>
 #include <cctype>
-#include <atlstr.h>
+#include <cstring>
+#include <cwchar>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <new>
+#include "MethodTree.h"
+#include "RawFileBackend.h"
+#include "SpectrumStore.h"
+#include "Codec.h"
 #include <sys/stat.h>
 
-// This uses the MS File Reader type library, but works for Foundation as well
-#import "XRawfile2.tlb" 
-
 #if LUA_VERSION_NUM < 502
 #define COMPAT52_IS_LUAJIT 1
 #include "compat-5.2.h"
 #endif
 
-using namespace MSFileReaderLib;
-
 namespace RawFile {
 
 	static char const* Version = RawFileVersion;
@@ -71,61 +75,149 @@ namespace RawFile {
 		return (stat(filePath, &buffer) == 0);
 	}
 
-	typedef struct _ChroPeak
+	// Bits of the packed label flag mask returned by columnar GetLabelData
+	#define LABEL_FLAG_SATURATED		0x01
+	#define LABEL_FLAG_FRAGMENTED		0x02
+	#define LABEL_FLAG_MERGED			0x04
+	#define LABEL_FLAG_EXCEPTION		0x08
+	#define LABEL_FLAG_MODIFIED			0x10
+
+	// Columns of the columnar label data
+	enum LabelField
+	{
+		LabelMass,
+		LabelIntensity,
+		LabelResolution,
+		LabelBaseline,
+		LabelNoise,
+		LabelCharge,
+		LabelFlagMask,
+		LabelFieldCount
+	};
+
+	static char const* LabelFieldNames[LabelFieldCount] = {
+		"Mass", "Intensity", "Resolution", "Baseline", "Noise", "Charge", "Flags"
+	};
+
+	// Dense row major float32 matrix, one row per spectrum
+	typedef struct Matrix
+	{
+		int Rows;
+		int Columns;
+		std::vector<float> Data;
+		Matrix(int rows, int columns) : Rows(rows), Columns(columns), Data((size_t)rows * columns, 0.0f) {}
+		float* Row(int row) { return &Data[(size_t)row * Columns]; }
+	} Matrix;
+
+	// Library spectra have sqrt scaled, unit length intensities for cosine scoring
+	typedef struct _librarySpectrum
 	{
-		double dTime;
-		double dIntensity;
-	} ChroPeak;
+		std::string Name;
+		double PrecursorMz;
+		std::vector<DataPeak> Peaks;
+	} LibrarySpectrum;
 
-	typedef struct _labelData
+	// Spectral library sorted by precursor m/z
+	typedef struct Library
 	{
-		double Mass;
-		double Intensity;
-		double Resolution;
-		double Baseline;
-		double Noise;
-		double Charge;
-	} LabelData;
-
-	typedef struct _labelDataFlags
+		std::string FileName;
+		std::vector<LibrarySpectrum> Spectra;
+	} Library;
+
+	// Call statistics, see EnableStats.  The COM time is accumulated by TimedCall.
+	#define STATS_BUCKETS				32		// log2 microsecond latency buckets
+
+	typedef struct _functionStats
 	{
-		unsigned char Saturated;
-		unsigned char Fragmented;
-		unsigned char Merged;
-		unsigned char Exception;
-		unsigned char Modified;
-	} LabelFlags;
-
-	typedef struct _datapeak
+		const char* Name;
+		lua_CFunction Function;
+		unsigned long long Calls;
+		double TotalSeconds;
+		double ComSeconds;
+		double LuaBytes;
+		unsigned long long Histogram[STATS_BUCKETS];
+	} FunctionStats;
+
+	// Set by EnableStats, and the reader time of every thread since the start
+	extern std::atomic<bool> StatsEnabled;
+	extern std::atomic<long long> StatsComNanoseconds;
+
+	// Times one call made through TimedReader, from operator-> to the end of the expression
+	class TimedCall
 	{
-		double Mass;
-		double Intensity;
-	} DataPeak;
+	public:
+		TimedCall(RawFileBackend* instance) : Instance(instance), Active(StatsEnabled.load(std::memory_order_relaxed))
+		{
+			if (Active)
+				Start = std::chrono::steady_clock::now();
+		}
+		TimedCall(TimedCall&& other) : Instance(other.Instance), Active(other.Active), Start(other.Start) { other.Active = false; }
+		~TimedCall()
+		{
+			if (Active)
+				StatsComNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start).count(), std::memory_order_relaxed);
+		}
+		RawFileBackend* operator->() const { return Instance; }
+	private:
+		TimedCall(const TimedCall&);
+		RawFileBackend* Instance;
+		bool Active;
+		std::chrono::steady_clock::time_point Start;
+	};
+
+	// The reader of a raw file, every call through it is timed
+	class TimedReader
+	{
+	public:
+		TimedReader() : Instance(NULL) {}
+		TimedCall operator->() const { return TimedCall(Instance); }
+		RawFileBackend* Get() const { return Instance; }
+		void Reset(RawFileBackend* instance) { delete Instance; Instance = instance; }
+	private:
+		RawFileBackend* Instance;
+	};
+
+	// Controller type as used by SetCurrentController, and its 1 based index
+	typedef std::pair<long, long> DeviceKey;
+
+	// The header and MS order of a scan, as kept by the scan index
+	typedef struct _indexedScan
+	{
+		ScanHeader Header;
+		long MSOrder;
+	} IndexedScan;
 
 	typedef struct RawFile
 	{
-		const char* FileName;
+		std::string FileName;
 		bool IsOpen;
 		int init;
-		IXRawfile5Ptr comRawFile;
-		RawFile(const char* filePath) {	
-			CoInitialize(NULL);	
-
-			// Try to create an instance of the preferred Rawfile
-			HRESULT result = comRawFile.CreateInstance(RAW_FILE_INSTANCE);	
-						
-			if (result != 0)
-			{
-				// If that failed, try the backup instance
-				result = comRawFile.CreateInstance(RAW_FILE_INSTANCE_BACKUP);			
-			}
-
-			init = result;
+		long LastScanSeen;		// last scan returned by NewScans
+		std::string BackendName;
+		TimedReader Reader;
+		std::map<DeviceKey, RawFileBackend*> Devices;	// separate readers for the non MS controllers
+		MethodTree* Method;								// parsed on first use
+		std::vector<IndexedScan> ScanIndex;				// from the first spectrum, read on first use
+		SpectrumStore* Store;							// mass lists kept by LoadAll
+		RawFile(const char* filePath, const char* backend) {
+			BackendName = backend != NULL ? backend : "";
+			Reader.Reset(CreateBackend(backend, init));
 
 			IsOpen = false;
 			FileName = filePath;
+			LastScanSeen = 0;
+			Method = NULL;
+			Store = NULL;
+		}
+		void CloseDevices() {
+			for (std::map<DeviceKey, RawFileBackend*>::iterator it = Devices.begin(); it != Devices.end(); ++it)
+			{
+				it->second->Close();
+				delete it->second;
+			}
+			Devices.clear();
 		}
-		~RawFile() { comRawFile.Release(); CoUninitialize(); }		
+		~RawFile() { delete Method; delete Store; CloseDevices(); Reader.Reset(NULL); }
 	} RawFile;
 
 	int Register(lua_State* L);
@@ -138,11 +230,17 @@ namespace RawFile {
 	int scanFilter(lua_State* L);
 	int scanHeader(lua_State* L);
 	int newRawFile(lua_State* L);
+	int summarize(lua_State* L);
+	int codecEncode(lua_State* L);
+	int codecDecode(lua_State* L);
 	static int getMetaTable(lua_State* L) {luaL_getmetatable(L, RawFileType);	return 1;}
 	int getNumInstMethods(lua_State* L);
 	int getInstrumentMethod(lua_State* L);
 	int getIsolationWidthForScanNum(lua_State* L);
 	int getInstrumentMethodNames(lua_State* L);
+	int getMethodTree(lua_State* L);
+	int findMethodParameter(lua_State* L);
+	int getMethodValues(lua_State* L);
 	int getRetentionTime(lua_State* L);
 	int getScanNumberFromRT(lua_State* L);
 	int getMSNOrder(lua_State* L);
@@ -150,8 +248,25 @@ namespace RawFile {
 	int getChroData(lua_State* L);
 	int getSpectrumData(lua_State* L);
 	int getLabelData(lua_State* L);
+	int averageSpectra(lua_State* L);
+	int binSpectra(lua_State* L);
+	int searchLibrary(lua_State* L);
+	int loadLibrary(lua_State* L);
 	int getInAcquisition(lua_State* L);
+	int refreshRawFile(lua_State* L);
+	int newScans(lua_State* L);
+	int getDevices(lua_State* L);
+	int getTrace(lua_State* L);
 	int getPrecursorMass(lua_State* L);
+	int getPrecursorContext(lua_State* L);
+	int getIsolationScheme(lua_State* L);
+	int extractDIAFragments(lua_State* L);
+	int getHeaderSeries(lua_State* L);
+	int getScanHeaders(lua_State* L);
+	int loadAll(lua_State* L);
+	int getAllTrailers(lua_State* L);
+	int getStatusLogSeries(lua_State* L);
+	int deisotope(lua_State* L);
 	int getSegmentsForScanNumber(lua_State* L);
 	int getLowMass(lua_State* L);
 	int getHighMass(lua_State* L);
@@ -163,6 +278,23 @@ namespace RawFile {
 	int getErrorLogCount(lua_State* L);
 	int getErrorLogItem(lua_State* L);
 	int releaseRawfile(lua_State* L);
+	int getScans(lua_State* L);
+	int scanIndex(lua_State* L);
+	int scanToString(lua_State* L);
+	int enableStats(lua_State* L);
+	int getStats(lua_State* L);
+	int resetStats(lua_State* L);
+	int matrixSize(lua_State* L);
+	int matrixGet(lua_State* L);
+	int matrixGetRow(lua_State* L);
+	int matrixSave(lua_State* L);
+	int matrixLength(lua_State* L);
+	int matrixToString(lua_State* L);
+	int releaseMatrix(lua_State* L);
+	int libraryGet(lua_State* L);
+	int libraryLength(lua_State* L);
+	int libraryToString(lua_State* L);
+	int releaseLibrary(lua_State* L);
 
 	static const struct luaL_Reg thermo_rawfile_m[] = {
 		{ "New", newRawFile },
@@ -170,12 +302,18 @@ namespace RawFile {
 		{ "Close", closeRawFile },
 		{ "GetTuneData", tuneData },
 		{ "GetScanTrailer", scanTrailer },
+		{ "GetAllTrailers", getAllTrailers },
 		{ "GetStatusLog", statusLog },
+		{ "GetStatusLogSeries", getStatusLogSeries },
 		{ "GetScanFilter", scanFilter },
 		{ "GetScanHeader", scanHeader },
+		{ "GetScanHeaders", getScanHeaders },
 		{ "GetNumberOfInstrumentMethods", getNumInstMethods},
 		{ "GetInstrumentMethod", getInstrumentMethod },
 		{ "GetInstrumentMethodNames", getInstrumentMethodNames},
+		{ "GetMethodTree", getMethodTree },
+		{ "FindMethodParameter", findMethodParameter },
+		{ "GetMethodValues", getMethodValues },
 		{ "GetIsolationWidth", getIsolationWidthForScanNum },		
 		{ "GetRetentionTime", getRetentionTime },
 		{ "GetScanNumberFromRT", getScanNumberFromRT },
@@ -184,8 +322,22 @@ namespace RawFile {
 		{ "GetChroData", getChroData },
 		{ "GetSpectrum", getSpectrumData },
 		{ "GetLabelData", getLabelData },
+		{ "AverageSpectra", averageSpectra },
+		{ "BinSpectra", binSpectra },
+		{ "SearchLibrary", searchLibrary },
 		{ "GetPrecursorMass", getPrecursorMass },
+		{ "GetPrecursorContext", getPrecursorContext },
+		{ "GetIsolationScheme", getIsolationScheme },
+		{ "ExtractDIAFragments", extractDIAFragments },
+		{ "GetHeaderSeries", getHeaderSeries },
+		{ "LoadAll", loadAll },
+		{ "Deisotope", deisotope },
 		{ "InAcquisition", getInAcquisition },
+		{ "Refresh", refreshRawFile },
+		{ "NewScans", newScans },
+		{ "Scans", getScans },
+		{ "Devices", getDevices },
+		{ "GetTrace", getTrace },
 		{ "GetRawFileMetaTable", getMetaTable },
 		{ "GetNumSegments", getSegmentsForScanNumber },
 		{ "GetLowMass", getLowMass},
@@ -197,10 +349,41 @@ namespace RawFile {
 		{ "GetInstModel", getInstModel},
 		{ "GetNumErrorLog", getErrorLogCount },
 		{ "GetErrorLogItem", getErrorLogItem },
+		{ "EnableStats", enableStats },
+		{ "GetStats", getStats },
+		{ "ResetStats", resetStats },
 		{ "__tostring", rawFileToString },
 		{ "__gc", releaseRawfile },
 		{ "__index", __index },
 		{ NULL, NULL }
 	};
 
+
+	static const struct luaL_Reg thermo_matrix_m[] = {
+		{ "Size", matrixSize },
+		{ "Get", matrixGet },
+		{ "GetRow", matrixGetRow },
+		{ "Save", matrixSave },
+		{ "__len", matrixLength },
+		{ "__tostring", matrixToString },
+		{ "__gc", releaseMatrix },
+		{ NULL, NULL }
+	};
+
+
+	static const struct luaL_Reg thermo_scan_m[] = {
+		{ "__index", scanIndex },
+		{ "__tostring", scanToString },
+		{ NULL, NULL }
+	};
+
+
+	static const struct luaL_Reg thermo_library_m[] = {
+		{ "Get", libraryGet },
+		{ "__len", libraryLength },
+		{ "__tostring", libraryToString },
+		{ "__gc", releaseLibrary },
+		{ NULL, NULL }
+	};
+
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+/* RawFileBackend.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace RawFile {
+
+	typedef struct _ChroPeak
+	{
+		double dTime;
+		double dIntensity;
+	} ChroPeak;
+
+	typedef struct _labelData
+	{
+		double Mass;
+		double Intensity;
+		double Resolution;
+		double Baseline;
+		double Noise;
+		double Charge;
+	} LabelData;
+
+	typedef struct _labelDataFlags
+	{
+		unsigned char Saturated;
+		unsigned char Fragmented;
+		unsigned char Merged;
+		unsigned char Exception;
+		unsigned char Modified;
+	} LabelFlags;
+
+	typedef struct _datapeak
+	{
+		double Mass;
+		double Intensity;
+	} DataPeak;
+
+	typedef struct _scanHeader
+	{
+		long NumPackets;
+		double StartTime;
+		double LowMass;
+		double HighMass;
+		double TIC;
+		double BasePeakMass;
+		double BasePeakIntensity;
+		long NumChannels;
+		long UniformTime;
+		double Frequency;
+	} ScanHeader;
+
+	// A single tune, trailer or status log value with the type the reader gave it
+	enum ReaderValueType { ValueNil, ValueNumber, ValueString, ValueBoolean };
+
+	typedef struct _readerValue
+	{
+		ReaderValueType Type;
+		double Number;
+		std::string Text;
+	} ReaderValue;
+
+	// The labels of a tune, trailer or status log entry and their values as text
+	typedef struct _labelValues
+	{
+		std::vector<std::string> Labels;
+		std::vector<std::string> Values;
+	} LabelValues;
+
+	// The GetChroData parameters, see the MS File Reader documentation
+	typedef struct _chroSettings
+	{
+		long Type;
+		long Operator;
+		long Type2;
+		std::string Filter;
+		std::string MassRange1;
+		std::string MassRange2;
+		double Delay;
+		long SmoothingType;
+		long SmoothingValue;
+	} ChroSettings;
+
+	// The reader behind a RawFile.  Every binding reads through this interface,
+	// so a reader only has to implement it to serve the whole Lua API.  The calls
+	// follow the XRawfile2 methods of the same name, scans and controllers are
+	// numbered the same way and false is returned where those would fail.
+	class RawFileBackend
+	{
+	public:
+		virtual ~RawFileBackend() {}
+
+		virtual bool Open(const char* fileName) = 0;
+		virtual void Close() = 0;
+		virtual bool SetCurrentController(long type, long index) = 0;
+		virtual bool GetNumberOfControllers(long& count) = 0;
+		virtual bool GetControllerType(long index, long& type) = 0;
+		virtual bool GetFirstSpectrumNumber(long& sn) = 0;
+		virtual bool GetLastSpectrumNumber(long& sn) = 0;
+		virtual bool InAcquisition(bool& inAcquisition) = 0;
+		virtual bool RefreshViewOfFile() = 0;
+		// Whether more readers of the same file may share out bulk reads, false
+		// when opening the file again costs more than reading it
+		virtual bool SupportsParallelReads(bool& parallel) = 0;
+
+		virtual bool GetTuneData(long index, LabelValues& entries) = 0;
+		virtual bool GetTuneDataValue(long index, const std::string& label, ReaderValue& value) = 0;
+		virtual bool GetTrailerExtra(long sn, LabelValues& entries) = 0;
+		virtual bool GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value) = 0;
+		virtual bool GetStatusLog(long sn, double& rt, LabelValues& entries) = 0;
+		virtual bool GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value) = 0;
+		// Status log records by position, 0 to count - 1, in time order.  The
+		// values follow the labels of GetStatusLog, the plottable (numeric)
+		// ones are listed with their index among them.
+		virtual bool GetNumStatusLog(long& count) = 0;
+		virtual bool GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values) = 0;
+		virtual bool GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices) = 0;
+
+		virtual bool GetScanHeader(long sn, ScanHeader& header) = 0;
+		virtual bool GetFilter(long sn, std::string& filter) = 0;
+		virtual bool GetSegmentAndEvent(long sn, long& segment, long& scanEvent) = 0;
+		virtual bool RTFromScanNum(long sn, double& rt) = 0;
+		virtual bool ScanNumFromRT(double rt, long& sn) = 0;
+		virtual bool GetMSOrder(long sn, long& msOrder) = 0;
+		virtual bool IsCentroidScan(long sn, bool& centroid) = 0;
+		virtual bool GetIsolationWidth(long sn, long msOrder, double& width) = 0;
+		virtual bool GetPrecursorMass(long sn, long msOrder, double& mass) = 0;
+
+		// Mass sorted peaks, centroided when asked for and the scan is profile data
+		virtual bool GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks) = 0;
+		virtual bool GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags) = 0;
+		// The reader's own averaging (or summing) of profile spectra, false if it has none
+		virtual bool GetAveragedSpectrum(const std::vector<long>& scans, bool sum, std::vector<DataPeak>& peaks) = 0;
+		virtual bool GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points) = 0;
+
+		virtual bool GetNumInstMethods(long& count) = 0;
+		virtual bool GetInstMethod(long index, std::string& method) = 0;
+		virtual bool GetInstMethodNames(std::vector<std::string>& names) = 0;
+		virtual bool GetLowMass(double& mass) = 0;
+		virtual bool GetHighMass(double& mass) = 0;
+		virtual bool GetInstName(std::string& name) = 0;
+		virtual bool GetInstSoftwareVersion(std::string& version) = 0;
+		virtual bool GetInstSerialNumber(std::string& serialNumber) = 0;
+		virtual bool GetInstHardwareVersion(std::string& version) = 0;
+		virtual bool GetInstModel(std::string& model) = 0;
+		virtual bool GetNumErrorLog(long& count) = 0;
+		virtual bool GetErrorLogItem(long index, double& rt, std::string& message) = 0;
+	};
+
+	// Append UTF-16 text as UTF-8 in a single pass, up to length code units or
+	// a terminating zero.  Surrogate pairs are joined, a lone surrogate is
+	// replaced by U+FFFD so the result is always valid UTF-8.
+	void AppendUtf8(const wchar_t* text, size_t length, std::string& out);
+	// The same for little endian UTF-16 as stored in a file, at any alignment
+	void AppendUtf8(const unsigned char* text, size_t length, std::string& out);
+	// Append UTF-8 text as wide characters, invalid bytes are taken as Latin-1
+	void AppendWide(const std::string& text, std::wstring& out);
+
+	// The readers by name, NULL terminated, the first is the default
+	extern const char* const BackendNames[];
+
+	// Create a reader by name (NULL or "" for the default).  NULL is returned
+	// for an unknown name, or with the reader's error code when it couldn't start.
+	RawFileBackend* CreateBackend(const char* name, int& error);
+
+}
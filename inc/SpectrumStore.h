@@ -0,0 +1,60 @@
+/* SpectrumStore.h
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#pragma once
+
+#include "RawFileBackend.h"
+
+namespace RawFile {
+
+	enum MassCoding { MassDelta, MassDouble };
+	enum IntensityCoding { IntensityHalf, IntensityFloat, IntensityDouble };
+
+	// Mass lists of many scans kept compressed in one buffer, see LoadAll.
+	// Masses are kept exactly, as deltas or plain doubles, intensities as
+	// doubles, floats or halves scaled to the largest of their spectrum.
+	class SpectrumStore
+	{
+	public:
+		SpectrumStore(MassCoding masses, IntensityCoding intensities);
+
+		// Add the peaks of a scan, scans must come in increasing order.  False,
+		// and nothing added, when the store would grow past maxBytes.
+		bool Add(long sn, const std::vector<DataPeak>& peaks, size_t maxBytes);
+		// The peaks of a stored scan, false when it isn't stored
+		bool Get(long sn, std::vector<DataPeak>& peaks) const;
+		// Give back the memory kept for growth once every scan is added
+		void Compact() { Data.shrink_to_fit(); Numbers.shrink_to_fit(); Stored.shrink_to_fit(); }
+
+		size_t Scans() const { return Numbers.size(); }
+		size_t Bytes() const { return Data.size() + Numbers.size() * (sizeof(long) + sizeof(StoredScan)); }
+		// The bytes of the stored peaks as DataPeak arrays
+		size_t RawBytes() const { return Peaks * sizeof(DataPeak); }
+
+	private:
+		typedef struct _storedScan
+		{
+			size_t Offset;						// intensities first, then masses
+			size_t Size;
+			size_t Count;
+			double Scale;						// of half precision intensities
+		} StoredScan;
+
+		MassCoding Masses;
+		IntensityCoding Intensities;
+		std::vector<long> Numbers;				// sorted
+		std::vector<StoredScan> Stored;
+		std::vector<unsigned char> Data;
+		size_t Peaks;
+
+		// Decoding buffers, reused from call to call
+		mutable std::vector<double> MassBuffer;
+		mutable std::vector<double> IntensityBuffer;
+	};
+
+}
@@ -0,0 +1,580 @@
+/* Codec.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "Codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// MSVC has no F16C switch of its own, /arch:AVX2 implies it
+#if defined(__F16C__) || defined(__AVX2__)
+#define CODEC_F16C
+#endif
+#if defined(__AVX__)
+#define CODEC_AVX
+#endif
+#if defined(CODEC_F16C) || defined(CODEC_AVX)
+#include <immintrin.h>
+#endif
+
+namespace RawFile {
+
+	// Half precision values are scaled to at most this, well inside their range
+	#define CODEC_HALF_MAX				32768.0
+
+	const char* const CodecNames[] = { "numpressLinear", "numpressPic", "numpressSlof", "deltaVarint",
+		"shuffle", "float32", "float16", NULL };
+
+	// The half bytes of the Numpress codings, high half first
+	class HalfByteWriter
+	{
+	public:
+		HalfByteWriter(std::vector<unsigned char>& out) : Out(out), Pending(false) {}
+		void Put(unsigned long halfByte)
+		{
+			if (Pending)
+				Out.back() |= (unsigned char)(halfByte & 0xf);
+			else
+				Out.push_back((unsigned char)((halfByte & 0xf) << 4));
+			Pending = !Pending;
+		}
+	private:
+		std::vector<unsigned char>& Out;
+		bool Pending;
+	};
+
+	class HalfByteReader
+	{
+	public:
+		HalfByteReader(const unsigned char* data, size_t size) : Data(data), Size(size), Position(0) {}
+		bool Get(unsigned long& halfByte)
+		{
+			if (Position >= 2 * Size)
+				return false;
+			unsigned char byte = Data[Position / 2];
+			halfByte = Position % 2 == 0 ? byte >> 4 : byte & 0xf;
+			Position++;
+			return true;
+		}
+		// A zero half byte filling up the last byte ends the data as well
+		bool AtEnd() const
+		{
+			return Position >= 2 * Size || (Position == 2 * Size - 1 && (Data[Size - 1] & 0xf) == 0);
+		}
+	private:
+		const unsigned char* Data;
+		size_t Size;
+		size_t Position;
+	};
+
+	// A 32 bit integer as a count of leading zero (or, with 8 added, all ones)
+	// half bytes followed by the remaining half bytes, lowest first
+	static void PutInt(HalfByteWriter& writer, long long value)
+	{
+		unsigned long x = (unsigned long)value & 0xffffffffUL;
+		unsigned long top = x & 0xf0000000UL;
+		int leading = 0;
+		if (top == 0)
+		{
+			leading = 8;
+			for (int i = 0; i < 8; i++)
+			{
+				if ((x & (0xf0000000UL >> (4 * i))) != 0)
+				{
+					leading = i;
+					break;
+				}
+			}
+			writer.Put(leading);
+		}
+		else if (top == 0xf0000000UL)
+		{
+			leading = 7;
+			for (int i = 0; i < 8; i++)
+			{
+				unsigned long mask = 0xf0000000UL >> (4 * i);
+				if ((x & mask) != mask)
+				{
+					leading = i;
+					break;
+				}
+			}
+			writer.Put(leading + 8);
+		}
+		else
+			writer.Put(0);
+
+		for (int i = leading; i < 8; i++)
+			writer.Put(x >> (4 * (i - leading)));
+	}
+
+	static bool GetInt(HalfByteReader& reader, long long& value)
+	{
+		unsigned long head = 0;
+		if (!reader.Get(head))
+			return false;
+
+		unsigned long x = 0;
+		unsigned long leading = head;
+		if (head > 8)
+		{
+			leading = head - 8;
+			for (unsigned long i = 0; i < leading; i++)
+				x |= 0xf0000000UL >> (4 * i);
+		}
+		for (unsigned long i = leading; i < 8; i++)
+		{
+			unsigned long halfByte = 0;
+			if (!reader.Get(halfByte))
+				return false;
+			x |= halfByte << (4 * (i - leading));
+		}
+		value = (long long)(int)(unsigned int)x;
+		return true;
+	}
+
+	// The fixed point is stored big endian, the first values little endian
+	static void PutFixedPoint(double fixedPoint, std::vector<unsigned char>& out)
+	{
+		unsigned long long bits;
+		memcpy(&bits, &fixedPoint, sizeof(bits));
+		for (int i = 7; i >= 0; i--)
+			out.push_back((unsigned char)(bits >> (8 * i)));
+	}
+
+	static double GetFixedPoint(const unsigned char* data)
+	{
+		unsigned long long bits = 0;
+		for (int i = 0; i < 8; i++)
+			bits = (bits << 8) | data[i];
+		double fixedPoint;
+		memcpy(&fixedPoint, &bits, sizeof(fixedPoint));
+		return fixedPoint;
+	}
+
+	static void PutUnsigned(unsigned long long value, int bytes, std::vector<unsigned char>& out)
+	{
+		for (int i = 0; i < bytes; i++)
+			out.push_back((unsigned char)(value >> (8 * i)));
+	}
+
+	static unsigned long long GetUnsigned(const unsigned char* data, int bytes)
+	{
+		unsigned long long value = 0;
+		for (int i = bytes - 1; i >= 0; i--)
+			value = (value << 8) | data[i];
+		return value;
+	}
+
+	double OptimalLinearFixedPoint(const double* values, size_t count)
+	{
+		if (count == 0)
+			return 0;
+		if (count == 1)
+			return values[0] > 0 ? std::floor(0xFFFFFFFF / values[0]) : 1;
+
+		double largest = (std::max)(values[0], values[1]);
+		for (size_t i = 2; i < count; i++)
+		{
+			double extrapolated = values[i - 1] + (values[i - 1] - values[i - 2]);
+			largest = (std::max)(largest, std::ceil(std::fabs(values[i] - extrapolated) + 1));
+		}
+		return largest > 0 ? std::floor(0x7FFFFFFF / largest) : 1;
+	}
+
+	double OptimalSlofFixedPoint(const double* values, size_t count)
+	{
+		double largest = 1;
+		for (size_t i = 0; i < count; i++)
+			largest = (std::max)(largest, values[i]);
+		double logged = std::log(largest + 1);
+		return std::floor(0xFFFF / logged);
+	}
+
+	void EncodeNumpressLinear(const double* values, size_t count, double fixedPoint, std::vector<unsigned char>& out)
+	{
+		PutFixedPoint(fixedPoint, out);
+		if (count == 0)
+			return;
+
+		long long ints[3] = { 0, (long long)(values[0] * fixedPoint + 0.5), 0 };
+		PutUnsigned((unsigned long long)ints[1], 4, out);
+		if (count == 1)
+			return;
+		ints[2] = (long long)(values[1] * fixedPoint + 0.5);
+		PutUnsigned((unsigned long long)ints[2], 4, out);
+
+		// Then the differences from a linear prediction of each value
+		HalfByteWriter writer(out);
+		for (size_t i = 2; i < count; i++)
+		{
+			ints[0] = ints[1];
+			ints[1] = ints[2];
+			ints[2] = (long long)(values[i] * fixedPoint + 0.5);
+			PutInt(writer, ints[2] - (ints[1] + (ints[1] - ints[0])));
+		}
+	}
+
+	bool DecodeNumpressLinear(const unsigned char* data, size_t size, std::vector<double>& values)
+	{
+		if (size < 8)
+			return false;
+		double fixedPoint = GetFixedPoint(data);
+		if (size == 8)
+			return true;
+		if (size < 12 || fixedPoint == 0)
+			return false;
+
+		long long ints[3] = { 0, (long long)GetUnsigned(data + 8, 4), 0 };
+		values.push_back(ints[1] / fixedPoint);
+		if (size == 12)
+			return true;
+		if (size < 16)
+			return false;
+		ints[2] = (long long)GetUnsigned(data + 12, 4);
+		values.push_back(ints[2] / fixedPoint);
+
+		HalfByteReader reader(data + 16, size - 16);
+		while (!reader.AtEnd())
+		{
+			long long difference = 0;
+			if (!GetInt(reader, difference))
+				return false;
+			ints[0] = ints[1];
+			ints[1] = ints[2];
+			ints[2] = ints[1] + (ints[1] - ints[0]) + difference;
+			values.push_back(ints[2] / fixedPoint);
+		}
+		return true;
+	}
+
+	void EncodeNumpressPic(const double* values, size_t count, std::vector<unsigned char>& out)
+	{
+		HalfByteWriter writer(out);
+		for (size_t i = 0; i < count; i++)
+			PutInt(writer, (long long)(values[i] + 0.5));
+	}
+
+	bool DecodeNumpressPic(const unsigned char* data, size_t size, std::vector<double>& values)
+	{
+		HalfByteReader reader(data, size);
+		while (!reader.AtEnd())
+		{
+			long long value = 0;
+			if (!GetInt(reader, value))
+				return false;
+			values.push_back((double)value);
+		}
+		return true;
+	}
+
+	void EncodeNumpressSlof(const double* values, size_t count, double fixedPoint, std::vector<unsigned char>& out)
+	{
+		PutFixedPoint(fixedPoint, out);
+		for (size_t i = 0; i < count; i++)
+			PutUnsigned((unsigned short)(std::log(values[i] + 1) * fixedPoint + 0.5), 2, out);
+	}
+
+	bool DecodeNumpressSlof(const unsigned char* data, size_t size, std::vector<double>& values)
+	{
+		if (size < 8 || size % 2 != 0)
+			return false;
+		double fixedPoint = GetFixedPoint(data);
+		if (fixedPoint == 0 && size > 8)
+			return false;
+		for (size_t p = 8; p < size; p += 2)
+			values.push_back(std::exp(GetUnsigned(data + p, 2) / fixedPoint) - 1);
+		return true;
+	}
+
+	void EncodeDeltaDoubles(const double* values, size_t count, std::vector<unsigned char>& out)
+	{
+		unsigned long long previous = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned long long bits;
+			memcpy(&bits, &values[i], sizeof(bits));
+			unsigned long long delta = bits - previous;
+			previous = bits;
+
+			unsigned long long zigzag = (delta << 1) ^ (0ULL - (delta >> 63));
+			while (zigzag >= 0x80)
+			{
+				out.push_back((unsigned char)(zigzag | 0x80));
+				zigzag >>= 7;
+			}
+			out.push_back((unsigned char)zigzag);
+		}
+	}
+
+	size_t DecodeDeltaDoubles(const unsigned char* data, size_t size, size_t count, double* values)
+	{
+		unsigned long long previous = 0;
+		size_t p = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned long long zigzag = 0;
+			for (int shift = 0; ; shift += 7)
+			{
+				if (p == size || shift > 63)
+					return 0;
+				unsigned char byte = data[p++];
+				zigzag |= (unsigned long long)(byte & 0x7f) << shift;
+				if (byte < 0x80)
+					break;
+			}
+
+			previous += (zigzag >> 1) ^ (0ULL - (zigzag & 1));
+			memcpy(&values[i], &previous, sizeof(previous));
+		}
+		return p;
+	}
+
+	void ShuffleBytes(const unsigned char* data, size_t count, size_t elementSize, unsigned char* out)
+	{
+		for (size_t b = 0; b < elementSize; b++)
+			for (size_t i = 0; i < count; i++)
+				out[b * count + i] = data[i * elementSize + b];
+	}
+
+	void UnshuffleBytes(const unsigned char* data, size_t count, size_t elementSize, unsigned char* out)
+	{
+		for (size_t b = 0; b < elementSize; b++)
+			for (size_t i = 0; i < count; i++)
+				out[i * elementSize + b] = data[b * count + i];
+	}
+
+	void EncodeFloat(const double* values, size_t count, float* out)
+	{
+		size_t i = 0;
+#ifdef CODEC_AVX
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(values + i)));
+#endif
+		for (; i < count; i++)
+			out[i] = (float)values[i];
+	}
+
+	void DecodeFloat(const float* data, size_t count, double* values)
+	{
+		size_t i = 0;
+#ifdef CODEC_AVX
+		for (; i + 4 <= count; i += 4)
+			_mm256_storeu_pd(values + i, _mm256_cvtps_pd(_mm_loadu_ps(data + i)));
+#endif
+		for (; i < count; i++)
+			values[i] = data[i];
+	}
+
+	unsigned short FloatToHalf(float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		unsigned long sign = (bits >> 16) & 0x8000;
+		unsigned long exponent = (bits >> 23) & 0xff;
+		unsigned long mantissa = bits & 0x7fffff;
+
+		// Infinity and NaN
+		if (exponent == 0xff)
+			return (unsigned short)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+
+		long e = (long)exponent - 127 + 15;
+		if (e >= 0x1f)
+			return (unsigned short)(sign | 0x7c00);
+
+		// Subnormal, or zero when below half the smallest one
+		if (e <= 0)
+		{
+			if (e < -10)
+				return (unsigned short)sign;
+			mantissa |= 0x800000;
+			int shift = (int)(14 - e);
+			unsigned long half = mantissa >> shift;
+			unsigned long rest = mantissa & ((1UL << shift) - 1);
+			unsigned long middle = 1UL << (shift - 1);
+			if (rest > middle || (rest == middle && (half & 1)))
+				half++;
+			return (unsigned short)(sign | half);
+		}
+
+		// A carry out of the mantissa moves to the next exponent, up to infinity
+		unsigned long half = ((unsigned long)e << 10) | (mantissa >> 13);
+		unsigned long rest = mantissa & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			half++;
+		return (unsigned short)(sign | half);
+	}
+
+	float HalfToFloat(unsigned short value)
+	{
+		unsigned long sign = (unsigned long)(value & 0x8000) << 16;
+		unsigned long exponent = (value >> 10) & 0x1f;
+		unsigned long mantissa = value & 0x3ff;
+		unsigned int bits;
+
+		if (exponent == 0x1f)
+			bits = (unsigned int)(sign | 0x7f800000 | (mantissa << 13));
+		else if (exponent != 0)
+			bits = (unsigned int)(sign | ((exponent + 112) << 23) | (mantissa << 13));
+		else if (mantissa == 0)
+			bits = (unsigned int)sign;
+		else
+		{
+			exponent = 113;
+			while ((mantissa & 0x400) == 0)
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			bits = (unsigned int)(sign | (exponent << 23) | ((mantissa & 0x3ff) << 13));
+		}
+
+		float result;
+		memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	void EncodeHalf(const double* values, size_t count, double scale, unsigned short* out)
+	{
+		double inverse = scale != 0 ? 1 / scale : 1;
+		size_t i = 0;
+#ifdef CODEC_F16C
+		__m256d factor = _mm256_set1_pd(inverse);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128 low = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(values + i), factor));
+			__m128 high = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(values + i + 4), factor));
+			__m256 floats = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_cvtps_ph(floats, _MM_FROUND_TO_NEAREST_INT));
+		}
+#endif
+		for (; i < count; i++)
+			out[i] = FloatToHalf((float)(values[i] * inverse));
+	}
+
+	void DecodeHalf(const unsigned short* data, size_t count, double scale, double* values)
+	{
+		size_t i = 0;
+#ifdef CODEC_F16C
+		__m256d factor = _mm256_set1_pd(scale);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 floats = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+			_mm256_storeu_pd(values + i, _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(floats)), factor));
+			_mm256_storeu_pd(values + i + 4, _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(floats, 1)), factor));
+		}
+#endif
+		for (; i < count; i++)
+			values[i] = HalfToFloat(data[i]) * scale;
+	}
+
+	void Encode(CodecType type, const double* values, size_t count, std::vector<unsigned char>& out, double fixedPoint)
+	{
+		size_t start = out.size();
+		switch (type)
+		{
+		case CodecNumpressLinear:
+			EncodeNumpressLinear(values, count, fixedPoint != 0 ? fixedPoint : OptimalLinearFixedPoint(values, count), out);
+			break;
+		case CodecNumpressPic:
+			EncodeNumpressPic(values, count, out);
+			break;
+		case CodecNumpressSlof:
+			EncodeNumpressSlof(values, count, fixedPoint != 0 ? fixedPoint : OptimalSlofFixedPoint(values, count), out);
+			break;
+		case CodecDeltaVarint:
+			EncodeDeltaDoubles(values, count, out);
+			break;
+		case CodecShuffle:
+			out.resize(start + count * sizeof(double));
+			ShuffleBytes(reinterpret_cast<const unsigned char*>(values), count, sizeof(double), out.data() + start);
+			break;
+		case CodecFloat32:
+		{
+			std::vector<float> floats(count);
+			EncodeFloat(values, count, floats.data());
+			out.resize(start + count * sizeof(float));
+			if (count > 0)
+				memcpy(out.data() + start, floats.data(), count * sizeof(float));
+			break;
+		}
+		case CodecFloat16:
+		{
+			// The scale first, then the values relative to it
+			double largest = 0;
+			for (size_t i = 0; i < count; i++)
+				largest = (std::max)(largest, std::fabs(values[i]));
+			double scale = largest > 0 ? largest / CODEC_HALF_MAX : 1;
+			std::vector<unsigned short> halves(count);
+			EncodeHalf(values, count, scale, halves.data());
+			out.resize(start + sizeof(double) + count * sizeof(unsigned short));
+			memcpy(out.data() + start, &scale, sizeof(double));
+			if (count > 0)
+				memcpy(out.data() + start + sizeof(double), halves.data(), count * sizeof(unsigned short));
+			break;
+		}
+		}
+	}
+
+	bool Decode(CodecType type, const unsigned char* data, size_t size, std::vector<double>& values)
+	{
+		size_t start = values.size();
+		switch (type)
+		{
+		case CodecNumpressLinear:
+			return DecodeNumpressLinear(data, size, values);
+		case CodecNumpressPic:
+			return DecodeNumpressPic(data, size, values);
+		case CodecNumpressSlof:
+			return DecodeNumpressSlof(data, size, values);
+		case CodecDeltaVarint:
+		{
+			// Every value takes one to ten bytes, so count them first
+			size_t count = 0;
+			for (size_t p = 0; p < size; p++)
+				if (data[p] < 0x80)
+					count++;
+			values.resize(start + count);
+			return count == 0 ? size == 0 : DecodeDeltaDoubles(data, size, count, values.data() + start) == size;
+		}
+		case CodecShuffle:
+			if (size % sizeof(double) != 0)
+				return false;
+			values.resize(start + size / sizeof(double));
+			UnshuffleBytes(data, size / sizeof(double), sizeof(double), reinterpret_cast<unsigned char*>(values.data() + start));
+			return true;
+		case CodecFloat32:
+		{
+			if (size % sizeof(float) != 0)
+				return false;
+			std::vector<float> floats(size / sizeof(float));
+			if (size > 0)
+				memcpy(floats.data(), data, size);
+			values.resize(start + floats.size());
+			DecodeFloat(floats.data(), floats.size(), values.data() + start);
+			return true;
+		}
+		case CodecFloat16:
+		{
+			if (size < sizeof(double) || (size - sizeof(double)) % sizeof(unsigned short) != 0)
+				return false;
+			double scale;
+			memcpy(&scale, data, sizeof(double));
+			std::vector<unsigned short> halves((size - sizeof(double)) / sizeof(unsigned short));
+			if (!halves.empty())
+				memcpy(halves.data(), data + sizeof(double), halves.size() * sizeof(unsigned short));
+			values.resize(start + halves.size());
+			DecodeHalf(halves.data(), halves.size(), scale, values.data() + start);
+			return true;
+		}
+		}
+		return false;
+	}
+
+}
@@ -0,0 +1,792 @@
+/* ComBackend.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "ComBackend.h"
+
+using namespace MSFileReaderLib;
+
+namespace RawFile {
+
+	// Create the COM reader, the preferred instance first then the backup
+	static HRESULT CreateRawFileInstance(IXRawfile5Ptr& instance)
+	{
+		HRESULT result = instance.CreateInstance(RAW_FILE_INSTANCE);
+
+		if (result != 0)
+		{
+			// If that failed, try the backup instance
+			result = instance.CreateInstance(RAW_FILE_INSTANCE_BACKUP);
+		}
+
+		return result;
+	}
+
+	// Copy a BSTR returned by the reader as UTF-8 and free it
+	static bool TakeString(BSTR value, std::string& text)
+	{
+		text.clear();
+		if (value == NULL)
+			return true;
+		AppendUtf8(value, SysStringLen(value), text);
+		SysFreeString(value);
+		return true;
+	}
+
+	// A label or filter given as UTF-8, as the reader expects it
+	static _bstr_t WideString(const std::string& text)
+	{
+		std::wstring wide;
+		AppendWide(text, wide);
+		return _bstr_t(wide.c_str());
+	}
+
+	// Copy an array of BSTRs, the variant is cleared
+	static void ReadStrings(VARIANT* items, long size, std::vector<std::string>& strings)
+	{
+		strings.resize(size > 0 ? size : 0);
+		if (size > 0 && items->parray != NULL)
+		{
+			BSTR* pItems = NULL;
+			SafeArrayAccessData(items->parray, (void**)(&pItems));
+			for (long i = 0; i < size; i++)
+			{
+				strings[i].clear();
+				if (pItems[i] != NULL)
+					AppendUtf8(pItems[i], SysStringLen(pItems[i]), strings[i]);
+			}
+			SafeArrayUnaccessData(items->parray);
+		}
+		VariantClear(items);
+	}
+
+	// Convert a typed variant, leaving it as it is
+	static void VariantValue(const VARIANT* value, ReaderValue& result)
+	{
+		result.Type = ValueNumber;
+		result.Number = 0;
+		result.Text.clear();
+
+		switch (value->vt)
+		{
+		case VT_BSTR:
+			result.Type = ValueString;
+			if (value->bstrVal != NULL)
+				AppendUtf8(value->bstrVal, SysStringLen(value->bstrVal), result.Text);
+			break;
+		case VT_R4:
+			result.Number = value->fltVal;
+			break;
+		case VT_R8:
+			result.Number = value->dblVal;
+			break;
+		case VT_I4:
+			result.Number = value->lVal;
+			break;
+		case VT_I2:
+			result.Number = value->iVal;
+			break;
+		case VT_BOOL:
+			result.Type = ValueBoolean;
+			result.Number = value->boolVal ? 1 : 0;
+			break;
+		case VT_UI1:
+			result.Number = value->bVal;
+			break;
+		default:
+			result.Type = ValueNil;
+			break;
+		}
+	}
+
+	// Convert a typed variant, the variant is cleared
+	static void VariantToValue(VARIANT* value, ReaderValue& result)
+	{
+		VariantValue(value, result);
+		VariantClear(value);
+	}
+
+	// Convert an array of variants, or of values of one type, the variant is cleared
+	static void ReadValues(VARIANT* items, long size, std::vector<ReaderValue>& values)
+	{
+		values.resize(size > 0 ? size : 0);
+		if (size > 0 && (items->vt & VT_ARRAY) != 0 && items->parray != NULL)
+		{
+			VARTYPE type = (VARTYPE)(items->vt & ~VT_ARRAY);
+			unsigned char* data = NULL;
+			SafeArrayAccessData(items->parray, (void**)(&data));
+			for (long i = 0; i < size; i++)
+			{
+				if (type == VT_VARIANT)
+				{
+					VariantValue(reinterpret_cast<VARIANT*>(data) + i, values[i]);
+					continue;
+				}
+
+				VARIANT item;
+				VariantInit(&item);
+				item.vt = type;
+				switch (type)
+				{
+				case VT_BSTR: item.bstrVal = reinterpret_cast<BSTR*>(data)[i]; break;
+				case VT_R4: item.fltVal = reinterpret_cast<float*>(data)[i]; break;
+				case VT_R8: item.dblVal = reinterpret_cast<double*>(data)[i]; break;
+				case VT_I4: item.lVal = reinterpret_cast<long*>(data)[i]; break;
+				case VT_I2: item.iVal = reinterpret_cast<short*>(data)[i]; break;
+				default: item.vt = VT_EMPTY; break;
+				}
+				VariantValue(&item, values[i]);
+			}
+			SafeArrayUnaccessData(items->parray);
+		}
+		VariantClear(items);
+	}
+
+	ComBackend::ComBackend()
+	{
+		CoInitialize(NULL);
+
+		// Try to create an instance of the preferred Rawfile
+		Init = CreateRawFileInstance(Raw);
+	}
+
+	ComBackend::~ComBackend()
+	{
+		Raw.Release();
+		CoUninitialize();
+	}
+
+	bool ComBackend::Open(const char* fileName)
+	{
+		try {
+			return SUCCEEDED(Raw->Open(fileName));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	void ComBackend::Close()
+	{
+		try {
+			Raw->Close();
+		}
+		catch (...) {}
+	}
+
+	bool ComBackend::SetCurrentController(long type, long index)
+	{
+		try {
+			return SUCCEEDED(Raw->SetCurrentController(type, index));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetNumberOfControllers(long& count)
+	{
+		try {
+			return SUCCEEDED(Raw->GetNumberOfControllers(&count));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetControllerType(long index, long& type)
+	{
+		try {
+			return SUCCEEDED(Raw->GetControllerType(index, &type));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetFirstSpectrumNumber(long& sn)
+	{
+		try {
+			return SUCCEEDED(Raw->GetFirstSpectrumNumber(&sn));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetLastSpectrumNumber(long& sn)
+	{
+		try {
+			return SUCCEEDED(Raw->GetLastSpectrumNumber(&sn));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::InAcquisition(bool& inAcquisition)
+	{
+		long inAcq = 0;
+		try {
+			if (FAILED(Raw->InAcquisition(&inAcq)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		inAcquisition = inAcq != 0;
+		return true;
+	}
+
+	// Each reader has an XRawfile instance of its own
+	bool ComBackend::SupportsParallelReads(bool& parallel)
+	{
+		parallel = true;
+		return true;
+	}
+
+	bool ComBackend::RefreshViewOfFile()
+	{
+		try {
+			return SUCCEEDED(Raw->RefreshViewOfFile());
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetTuneData(long index, LabelValues& entries)
+	{
+		VARIANT labels;
+		VARIANT values;
+		VariantInit(&labels);
+		VariantInit(&values);
+		long size = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetTuneData(index, &labels, &values, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+		ReadStrings(&labels, ok ? size : 0, entries.Labels);
+		ReadStrings(&values, ok ? size : 0, entries.Values);
+		return ok;
+	}
+
+	bool ComBackend::GetTuneDataValue(long index, const std::string& label, ReaderValue& value)
+	{
+		VARIANT varValue;
+		VariantInit(&varValue);
+		try {
+			if (FAILED(Raw->GetTuneDataValue(index, WideString(label), &varValue)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		VariantToValue(&varValue, value);
+		return true;
+	}
+
+	bool ComBackend::GetTrailerExtra(long sn, LabelValues& entries)
+	{
+		VARIANT labels;
+		VARIANT values;
+		VariantInit(&labels);
+		VariantInit(&values);
+		long size = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetTrailerExtraForScanNum(sn, &labels, &values, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+		ReadStrings(&labels, ok ? size : 0, entries.Labels);
+		ReadStrings(&values, ok ? size : 0, entries.Values);
+		return ok;
+	}
+
+	bool ComBackend::GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value)
+	{
+		VARIANT varValue;
+		VariantInit(&varValue);
+		try {
+			if (FAILED(Raw->GetTrailerExtraValueForScanNum(sn, WideString(label), &varValue)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		VariantToValue(&varValue, value);
+		return true;
+	}
+
+	bool ComBackend::GetStatusLog(long sn, double& rt, LabelValues& entries)
+	{
+		VARIANT labels;
+		VARIANT values;
+		VariantInit(&labels);
+		VariantInit(&values);
+		long size = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetStatusLogForScanNum(sn, &rt, &labels, &values, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+		ReadStrings(&labels, ok ? size : 0, entries.Labels);
+		ReadStrings(&values, ok ? size : 0, entries.Values);
+		return ok;
+	}
+
+	bool ComBackend::GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value)
+	{
+		VARIANT varValue;
+		VariantInit(&varValue);
+		try {
+			if (FAILED(Raw->GetStatusLogValueForScanNum(sn, WideString(label), &rt, &varValue)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		VariantToValue(&varValue, value);
+		return true;
+	}
+
+	bool ComBackend::GetNumStatusLog(long& count)
+	{
+		try {
+			return SUCCEEDED(Raw->GetNumStatusLog(&count));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values)
+	{
+		VARIANT varRT;
+		VARIANT varValues;
+		VariantInit(&varRT);
+		VariantInit(&varValues);
+		long size = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetStatusLogForPos(pos, &varRT, &varValues, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+
+		ReaderValue time;
+		VariantToValue(&varRT, time);
+		rt = time.Number;
+		ReadValues(&varValues, ok ? size : 0, values);
+		return ok;
+	}
+
+	bool ComBackend::GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices)
+	{
+		VARIANT varLabels;
+		VARIANT varIndices;
+		VariantInit(&varLabels);
+		VariantInit(&varIndices);
+		long size = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetStatusLogPlottableIndex(&varLabels, &varIndices, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+
+		std::vector<ReaderValue> values;
+		ReadStrings(&varLabels, ok ? size : 0, labels);
+		ReadValues(&varIndices, ok ? size : 0, values);
+		indices.resize(values.size());
+		for (size_t i = 0; i < values.size(); i++)
+			indices[i] = (long)values[i].Number;
+		return ok;
+	}
+
+	bool ComBackend::GetScanHeader(long sn, ScanHeader& header)
+	{
+		try {
+			return SUCCEEDED(Raw->GetScanHeaderInfoForScanNum(sn, &header.NumPackets, &header.StartTime, &header.LowMass, &header.HighMass,
+				&header.TIC, &header.BasePeakMass, &header.BasePeakIntensity, &header.NumChannels, &header.UniformTime, &header.Frequency));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetFilter(long sn, std::string& filter)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetFilterForScanNum(sn, &value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, filter);
+	}
+
+	bool ComBackend::GetSegmentAndEvent(long sn, long& segment, long& scanEvent)
+	{
+		try {
+			return SUCCEEDED(Raw->GetSegmentAndEventForScanNum(sn, &segment, &scanEvent));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::RTFromScanNum(long sn, double& rt)
+	{
+		try {
+			return SUCCEEDED(Raw->RTFromScanNum(sn, &rt));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::ScanNumFromRT(double rt, long& sn)
+	{
+		try {
+			return SUCCEEDED(Raw->ScanNumFromRT(rt, &sn));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetMSOrder(long sn, long& msOrder)
+	{
+		try {
+			return SUCCEEDED(Raw->GetMSOrderForScanNum(sn, &msOrder));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::IsCentroidScan(long sn, bool& centroid)
+	{
+		long value = 0;
+		try {
+			if (FAILED(Raw->IsCentroidScanForScanNum(sn, &value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		centroid = value != 0;
+		return true;
+	}
+
+	bool ComBackend::GetIsolationWidth(long sn, long msOrder, double& width)
+	{
+		try {
+			return SUCCEEDED(Raw->GetIsolationWidthForScanNum(sn, msOrder, &width));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetPrecursorMass(long sn, long msOrder, double& mass)
+	{
+		try {
+			return SUCCEEDED(Raw->GetPrecursorMassForScanNum(sn, msOrder, &mass));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	// Copy a returned mass list and release the arrays
+	static void ReadPeaks(VARIANT* massList, VARIANT* peakFlags, long size, std::vector<DataPeak>& peaks)
+	{
+		peaks.resize(size > 0 ? size : 0);
+		if (size > 0 && massList->parray != NULL)
+		{
+			DataPeak* pDataPeaks = NULL;
+			SafeArrayAccessData(massList->parray, (void**)(&pDataPeaks));
+			std::copy(pDataPeaks, pDataPeaks + size, peaks.begin());
+			SafeArrayUnaccessData(massList->parray);
+		}
+		VariantClear(massList);
+		VariantClear(peakFlags);
+	}
+
+	bool ComBackend::GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks)
+	{
+		VARIANT massList;
+		VariantInit(&massList);
+		VARIANT peakFlags;
+		VariantInit(&peakFlags);
+		long size = 0;
+		double centroidPeakWidth = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetMassListFromScanNum(&sn, (LPCTSTR)NULL, 0, 0, 0, centroid ? 1 : 0, &centroidPeakWidth, &massList, &peakFlags, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+		ReadPeaks(&massList, &peakFlags, ok ? size : 0, peaks);
+		return ok;
+	}
+
+	bool ComBackend::GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags)
+	{
+		VARIANT labelsVariant;
+		VARIANT flagsVariant;
+		VariantInit(&labelsVariant);
+		VariantInit(&flagsVariant);
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetLabelData(&labelsVariant, &flagsVariant, &sn));
+		}
+		catch (...) {
+			ok = false;
+		}
+
+		labels.clear();
+		flags.clear();
+		if (ok && labelsVariant.parray != NULL)
+		{
+			long size = labelsVariant.parray->rgsabound[0].cElements;
+			LabelData* pValues = NULL;
+			SafeArrayAccessData(labelsVariant.parray, (void**)(&pValues));
+			labels.assign(pValues, pValues + size);
+			SafeArrayUnaccessData(labelsVariant.parray);
+
+			flags.resize(size);
+			if (flagsVariant.parray != NULL)
+			{
+				LabelFlags* pFlags = NULL;
+				SafeArrayAccessData(flagsVariant.parray, (void**)(&pFlags));
+				flags.assign(pFlags, pFlags + size);
+				SafeArrayUnaccessData(flagsVariant.parray);
+			}
+		}
+		VariantClear(&labelsVariant);
+		VariantClear(&flagsVariant);
+		return ok;
+	}
+
+	bool ComBackend::GetAveragedSpectrum(const std::vector<long>& scans, bool sum, std::vector<DataPeak>& peaks)
+	{
+		if (scans.empty())
+			return false;
+
+		std::vector<long> scanNumbers(scans);
+		VARIANT massList;
+		VariantInit(&massList);
+		VARIANT peakFlags;
+		VariantInit(&peakFlags);
+		long size = 0;
+		bool ok = true;
+		try {
+			if (sum)
+				ok = SUCCEEDED(Raw->GetSummedMassSpectrum(&scanNumbers[0], (long)scanNumbers.size(), 0, &massList, &peakFlags, &size));
+			else
+				ok = SUCCEEDED(Raw->GetAveragedMassSpectrum(&scanNumbers[0], (long)scanNumbers.size(), 0, &massList, &peakFlags, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+		ReadPeaks(&massList, &peakFlags, ok ? size : 0, peaks);
+		return ok;
+	}
+
+	bool ComBackend::GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points)
+	{
+		VARIANT chroData;
+		VARIANT flags;
+		VariantInit(&chroData);
+		VariantInit(&flags);
+		long size = 0;
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetChroData(settings.Type, settings.Operator, settings.Type2, WideString(settings.Filter),
+				settings.MassRange1.c_str(), settings.MassRange2.c_str(), settings.Delay, &startTime, &endTime,
+				settings.SmoothingType, settings.SmoothingValue, &chroData, &flags, &size));
+		}
+		catch (...) {
+			ok = false;
+		}
+
+		points.resize(ok && size > 0 ? size : 0);
+		if (!points.empty() && chroData.parray != NULL)
+		{
+			ChroPeak* pValues = NULL;
+			SafeArrayAccessData(chroData.parray, (void**)(&pValues));
+			std::copy(pValues, pValues + size, points.begin());
+			SafeArrayUnaccessData(chroData.parray);
+		}
+		VariantClear(&chroData);
+		VariantClear(&flags);
+		return ok;
+	}
+
+	bool ComBackend::GetNumInstMethods(long& count)
+	{
+		try {
+			return SUCCEEDED(Raw->GetNumInstMethods(&count));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetInstMethod(long index, std::string& method)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetInstMethod(index, &value)) || value == NULL)
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, method);
+	}
+
+	bool ComBackend::GetInstMethodNames(std::vector<std::string>& names)
+	{
+		long number = 0;
+		VARIANT namesVariant;
+		VariantInit(&namesVariant);
+		bool ok = true;
+		try {
+			ok = SUCCEEDED(Raw->GetInstMethodNames(&number, &namesVariant));
+		}
+		catch (...) {
+			ok = false;
+		}
+		ReadStrings(&namesVariant, ok ? number : 0, names);
+		return ok;
+	}
+
+	bool ComBackend::GetLowMass(double& mass)
+	{
+		try {
+			return SUCCEEDED(Raw->GetLowMass(&mass));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetHighMass(double& mass)
+	{
+		try {
+			return SUCCEEDED(Raw->GetHighMass(&mass));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetInstName(std::string& name)
+	{
+		BSTR value = NULL; // the assignment to null is needed for some odd reason
+		try {
+			if (FAILED(Raw->GetInstName(&value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, name);
+	}
+
+	bool ComBackend::GetInstSoftwareVersion(std::string& version)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetInstSoftwareVersion(&value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, version);
+	}
+
+	bool ComBackend::GetInstSerialNumber(std::string& serialNumber)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetInstSerialNumber(&value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, serialNumber);
+	}
+
+	bool ComBackend::GetInstHardwareVersion(std::string& version)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetInstHardwareVersion(&value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, version);
+	}
+
+	bool ComBackend::GetInstModel(std::string& model)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetInstModel(&value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, model);
+	}
+
+	bool ComBackend::GetNumErrorLog(long& count)
+	{
+		try {
+			return SUCCEEDED(Raw->GetNumErrorLog(&count));
+		}
+		catch (...) {
+			return false;
+		}
+	}
+
+	bool ComBackend::GetErrorLogItem(long index, double& rt, std::string& message)
+	{
+		BSTR value = NULL;
+		try {
+			if (FAILED(Raw->GetErrorLogItem(index, &rt, &value)))
+				return false;
+		}
+		catch (...) {
+			return false;
+		}
+		return TakeString(value, message);
+	}
+
+}
@@ -58,8 +58,8 @@ local function GetMethodParameterBelow(rawFile, below, label, partial)
     return nil
   end
 	-- If partial is not set, then we've matched the full label and can just
-	-- return what's between the label and the end of the line
-	if not partial then return trim(l_method:sub(l_end + 1, l_eol - 1)) end
+	-- return what's between the label and the end of the line, less the separator
+	if not partial then return trim(l_method:sub(l_end + 1, l_eol - 1):gsub("^%s*[=:]", "")) end
 	-- if 'partial' is set, then we've matched only a partial piece of the label in the method report
 	-- therefore, to find the value we need to find the separator
   local l_parameter = l_method:sub(l_end + 1, l_eol - 1)
@@ -77,6 +77,16 @@ local function GetMethodParameterBelow(rawFile, below, label, partial)
   return trim(l_parameter:sub(l_lastStart))
 end
 
+-- Look the parameter up in the natively parsed method tree, or search
+-- the method text where the core has no tree.  Both give the value
+-- without its separator, nil when it isn't found.
+local function FindMethodParameter(rawFile, below, label, partial)
+  if rawFile.FindMethodParameter then
+    return (rawFile:FindMethodParameter(below, label, partial))
+  end
+  return GetMethodParameterBelow(rawFile, below, label, partial)
+end
+
 -- handy way to get the rawfile metatable to wrap your own functions
 local rawFileMT = RawFile.GetRawFileMetaTable()
 
@@ -102,7 +112,7 @@ function rawFileMT:GetMethodScanParameter(l_args)
   l_args.experiment = l_args.experiment or 1          -- default to experiment 1
   local l_below = {string.format("Experiment %s", tostring(l_args.experiment)),
                     string.format("Scan %s", tostring(l_args.event))}
-  return GetMethodParameterBelow(self, l_below, l_args.label, l_args.partial)
+  return FindMethodParameter(self, l_below, l_args.label, l_args.partial)
 end
 
 function rawFileMT:GetMethodExperimentParameter(l_args)
@@ -114,7 +124,7 @@ function rawFileMT:GetMethodExperimentParameter(l_args)
   end
   l_args.experiment = l_args.experiment or 1          -- default to experiment 1
   local l_below = {string.format("Experiment %s", tostring(l_args.experiment))}
-  return GetMethodParameterBelow(self, l_below, l_args.label, l_args.partial)
+  return FindMethodParameter(self, l_below, l_args.label, l_args.partial)
 end
 
 -- Get a global parameter from the method
@@ -126,7 +136,7 @@ function rawFileMT:GetMethodGlobalParameter(l_args)
     return nil
   end
   local l_below = {"Global Settings"}
-  return GetMethodParameterBelow(self, l_below, l_args.label, l_args.partial)
+  return FindMethodParameter(self, l_below, l_args.label, l_args.partial)
 end
 
 function rawFileMT:GetArrayOfMethodMatches( pattern, converter )
@@ -137,6 +147,8 @@ function rawFileMT:GetArrayOfMethodMatches( pattern, converter )
 	return matches
 end
 
+-- Matches the pattern in the method text, which GetMethodValues' exact
+-- keys don't reproduce, so it reads the text as it always did
 function rawFileMT:GetMaxInjectTimes()
 	return self:GetArrayOfMethodMatches("Maximum Injection Time %(ms%) = (%d+.?%d*)", tonumber)
 end
@@ -0,0 +1,615 @@
+/* MemoryBackend.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "MemoryBackend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace RawFile {
+
+	#define MEMORY_MAX_TUNE_DATA		64		// tune data indices tried when loading
+
+	MemoryBackend::MemoryBackend(const std::string& source)
+		: Source(source), IsOpen(false), FirstScan(1), LowMass(0), HighMass(0)
+	{
+	}
+
+	// A value given as text is a number when all of it parses as one
+	static void ValueFromText(const std::string& text, ReaderValue& value)
+	{
+		char* end = NULL;
+		double number = strtod(text.c_str(), &end);
+		value.Text.clear();
+		value.Number = 0;
+		if (!text.empty() && end != NULL && *end == '\0')
+		{
+			value.Type = ValueNumber;
+			value.Number = number;
+		}
+		else
+		{
+			value.Type = ValueString;
+			value.Text = text;
+		}
+	}
+
+	static bool FindValue(const LabelValues& entries, const std::string& label, ReaderValue& value)
+	{
+		for (size_t i = 0; i < entries.Labels.size() && i < entries.Values.size(); i++)
+		{
+			if (entries.Labels[i] == label)
+			{
+				ValueFromText(entries.Values[i], value);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool MemoryBackend::Load(RawFileBackend& source)
+	{
+		long first = 0;
+		long last = 0;
+		if (!source.SetCurrentController(0, 1) || !source.GetFirstSpectrumNumber(first) || !source.GetLastSpectrumNumber(last))
+			return false;
+
+		FirstScan = first;
+		Scans.resize(last >= first ? last - first + 1 : 0);
+		for (long sn = first; sn <= last; sn++)
+		{
+			MemoryScan& scan = Scans[sn - first];
+			memset(&scan.Header, 0, sizeof(scan.Header));
+			source.GetScanHeader(sn, scan.Header);
+			source.GetFilter(sn, scan.Filter);
+			scan.MSOrder = 0;
+			source.GetMSOrder(sn, scan.MSOrder);
+			scan.Centroid = false;
+			source.IsCentroidScan(sn, scan.Centroid);
+			scan.Segment = 0;
+			scan.Event = 0;
+			source.GetSegmentAndEvent(sn, scan.Segment, scan.Event);
+
+			for (long stage = 2; stage <= scan.MSOrder; stage++)
+			{
+				double mass = 0;
+				double width = 0;
+				source.GetPrecursorMass(sn, stage, mass);
+				source.GetIsolationWidth(sn, stage, width);
+				scan.PrecursorMass.push_back(mass);
+				scan.IsolationWidth.push_back(width);
+			}
+
+			source.GetMassList(sn, false, scan.Peaks);
+			if (!scan.Centroid)
+				source.GetMassList(sn, true, scan.Centroids);
+			source.GetLabelData(sn, scan.Labels, scan.Flags);
+			source.GetTrailerExtra(sn, scan.Trailer);
+
+			// Consecutive scans usually share a status log entry
+			MemoryStatusLog status;
+			status.RetentionTime = 0;
+			source.GetStatusLog(sn, status.RetentionTime, status.Entries);
+			if (StatusLogs.empty() || StatusLogs.back().RetentionTime != status.RetentionTime || StatusLogs.back().Entries.Values != status.Entries.Values)
+				StatusLogs.push_back(status);
+			scan.StatusLog = StatusLogs.size() - 1;
+		}
+
+		// Every status log record, or where the reader can't list them, those of the scans
+		long records = 0;
+		if (source.GetNumStatusLog(records) && records > 0)
+		{
+			StatusRecords.resize(records);
+			for (long pos = 0; pos < records; pos++)
+			{
+				StatusRecords[pos].RetentionTime = 0;
+				source.GetStatusLogForPos(pos, StatusRecords[pos].RetentionTime, StatusRecords[pos].Values);
+			}
+			source.GetStatusLogPlottableIndex(PlottableLabels, PlottableIndices);
+		}
+		else
+		{
+			StatusRecords.resize(StatusLogs.size());
+			for (size_t i = 0; i < StatusLogs.size(); i++)
+			{
+				const LabelValues& entries = StatusLogs[i].Entries;
+				StatusRecords[i].RetentionTime = StatusLogs[i].RetentionTime;
+				StatusRecords[i].Values.resize(entries.Values.size());
+				for (size_t v = 0; v < entries.Values.size(); v++)
+					ValueFromText(entries.Values[v], StatusRecords[i].Values[v]);
+			}
+			if (!StatusLogs.empty())
+			{
+				for (size_t v = 0; v < StatusRecords[0].Values.size() && v < StatusLogs[0].Entries.Labels.size(); v++)
+				{
+					if (StatusRecords[0].Values[v].Type != ValueNumber)
+						continue;
+					PlottableLabels.push_back(StatusLogs[0].Entries.Labels[v]);
+					PlottableIndices.push_back((long)v);
+				}
+			}
+		}
+
+		for (long index = 0; index < MEMORY_MAX_TUNE_DATA; index++)
+		{
+			LabelValues entries;
+			if (!source.GetTuneData(index, entries) || entries.Labels.empty())
+				break;
+			TuneData.push_back(entries);
+		}
+
+		long count = 0;
+		if (source.GetNumInstMethods(count))
+		{
+			for (long index = 0; index < count; index++)
+			{
+				std::string method;
+				source.GetInstMethod(index, method);
+				Methods.push_back(method);
+			}
+		}
+		source.GetInstMethodNames(MethodNames);
+
+		// Keep the error log by index, whichever base the reader uses
+		count = 0;
+		source.GetNumErrorLog(count);
+		for (long index = 0; index <= count; index++)
+		{
+			double rt = 0;
+			std::string message;
+			if (source.GetErrorLogItem(index, rt, message))
+				ErrorLog[index] = std::make_pair(rt, message);
+		}
+
+		source.GetLowMass(LowMass);
+		source.GetHighMass(HighMass);
+		source.GetInstName(InstName);
+		source.GetInstSoftwareVersion(InstSoftwareVersion);
+		source.GetInstSerialNumber(InstSerialNumber);
+		source.GetInstHardwareVersion(InstHardwareVersion);
+		source.GetInstModel(InstModel);
+		return true;
+	}
+
+	bool MemoryBackend::Open(const char* fileName)
+	{
+		Close();
+		if (Source.compare(0, 6, "memory") == 0)
+			return false;
+
+		int error = 0;
+		std::unique_ptr<RawFileBackend> source(CreateBackend(Source.c_str(), error));
+		if (!source || !source->Open(fileName))
+			return false;
+
+		bool loaded = Load(*source);
+		source->Close();
+		if (!loaded)
+		{
+			Close();
+			return false;
+		}
+
+		IsOpen = true;
+		return true;
+	}
+
+	void MemoryBackend::Close()
+	{
+		IsOpen = false;
+		Scans.clear();
+		StatusLogs.clear();
+		StatusRecords.clear();
+		PlottableLabels.clear();
+		PlottableIndices.clear();
+		TuneData.clear();
+		Methods.clear();
+		MethodNames.clear();
+		ErrorLog.clear();
+		LowMass = 0;
+		HighMass = 0;
+		InstName.clear();
+		InstSoftwareVersion.clear();
+		InstSerialNumber.clear();
+		InstHardwareVersion.clear();
+		InstModel.clear();
+	}
+
+	const MemoryScan* MemoryBackend::Scan(long sn) const
+	{
+		if (!IsOpen || sn < FirstScan || sn - FirstScan >= (long)Scans.size())
+			return NULL;
+		return &Scans[sn - FirstScan];
+	}
+
+	bool MemoryBackend::SetCurrentController(long type, long index)
+	{
+		return IsOpen && type == 0 && index == 1;
+	}
+
+	bool MemoryBackend::GetNumberOfControllers(long& count)
+	{
+		count = IsOpen ? 1 : 0;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetControllerType(long index, long& type)
+	{
+		if (!IsOpen || index != 0)
+			return false;
+		type = 0;
+		return true;
+	}
+
+	bool MemoryBackend::GetFirstSpectrumNumber(long& sn)
+	{
+		sn = FirstScan;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetLastSpectrumNumber(long& sn)
+	{
+		sn = FirstScan + (long)Scans.size() - 1;
+		return IsOpen;
+	}
+
+	// The run is a snapshot taken at Open
+	bool MemoryBackend::InAcquisition(bool& inAcquisition)
+	{
+		inAcquisition = false;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::RefreshViewOfFile()
+	{
+		return IsOpen;
+	}
+
+	// Another reader would load the whole run again
+	bool MemoryBackend::SupportsParallelReads(bool& parallel)
+	{
+		parallel = false;
+		return true;
+	}
+
+	bool MemoryBackend::GetTuneData(long index, LabelValues& entries)
+	{
+		if (!IsOpen || index < 0 || index >= (long)TuneData.size())
+			return false;
+		entries = TuneData[index];
+		return true;
+	}
+
+	bool MemoryBackend::GetTuneDataValue(long index, const std::string& label, ReaderValue& value)
+	{
+		if (!IsOpen || index < 0 || index >= (long)TuneData.size())
+			return false;
+		return FindValue(TuneData[index], label, value);
+	}
+
+	bool MemoryBackend::GetTrailerExtra(long sn, LabelValues& entries)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		entries = scan->Trailer;
+		return true;
+	}
+
+	bool MemoryBackend::GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value)
+	{
+		const MemoryScan* scan = Scan(sn);
+		return scan != NULL && FindValue(scan->Trailer, label, value);
+	}
+
+	bool MemoryBackend::GetStatusLog(long sn, double& rt, LabelValues& entries)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		rt = StatusLogs[scan->StatusLog].RetentionTime;
+		entries = StatusLogs[scan->StatusLog].Entries;
+		return true;
+	}
+
+	bool MemoryBackend::GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		rt = StatusLogs[scan->StatusLog].RetentionTime;
+		return FindValue(StatusLogs[scan->StatusLog].Entries, label, value);
+	}
+
+	bool MemoryBackend::GetNumStatusLog(long& count)
+	{
+		count = (long)StatusRecords.size();
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values)
+	{
+		if (pos < 0 || (size_t)pos >= StatusRecords.size())
+			return false;
+		rt = StatusRecords[pos].RetentionTime;
+		values = StatusRecords[pos].Values;
+		return true;
+	}
+
+	bool MemoryBackend::GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices)
+	{
+		labels = PlottableLabels;
+		indices = PlottableIndices;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetScanHeader(long sn, ScanHeader& header)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		header = scan->Header;
+		return true;
+	}
+
+	bool MemoryBackend::GetFilter(long sn, std::string& filter)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		filter = scan->Filter;
+		return true;
+	}
+
+	bool MemoryBackend::GetSegmentAndEvent(long sn, long& segment, long& scanEvent)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		segment = scan->Segment;
+		scanEvent = scan->Event;
+		return true;
+	}
+
+	bool MemoryBackend::RTFromScanNum(long sn, double& rt)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		rt = scan->Header.StartTime;
+		return true;
+	}
+
+	static bool ScanStartLess(const MemoryScan& scan, double rt) { return scan.Header.StartTime < rt; }
+
+	// The scan closest in time
+	bool MemoryBackend::ScanNumFromRT(double rt, long& sn)
+	{
+		if (!IsOpen || Scans.empty())
+			return false;
+		std::vector<MemoryScan>::const_iterator it = std::lower_bound(Scans.begin(), Scans.end(), rt, ScanStartLess);
+		if (it == Scans.end() || (it != Scans.begin() && rt - (it - 1)->Header.StartTime <= it->Header.StartTime - rt))
+			--it;
+		sn = FirstScan + (long)(it - Scans.begin());
+		return true;
+	}
+
+	bool MemoryBackend::GetMSOrder(long sn, long& msOrder)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		msOrder = scan->MSOrder;
+		return true;
+	}
+
+	bool MemoryBackend::IsCentroidScan(long sn, bool& centroid)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		centroid = scan->Centroid;
+		return true;
+	}
+
+	bool MemoryBackend::GetIsolationWidth(long sn, long msOrder, double& width)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		width = msOrder >= 2 && msOrder - 2 < (long)scan->IsolationWidth.size() ? scan->IsolationWidth[msOrder - 2] : 0;
+		return true;
+	}
+
+	bool MemoryBackend::GetPrecursorMass(long sn, long msOrder, double& mass)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		mass = msOrder >= 2 && msOrder - 2 < (long)scan->PrecursorMass.size() ? scan->PrecursorMass[msOrder - 2] : 0;
+		return true;
+	}
+
+	// The label peaks are the centroids of a profile scan
+	bool MemoryBackend::GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+		{
+			peaks.clear();
+			return false;
+		}
+
+		peaks = centroid && !scan->Centroid ? scan->Centroids : scan->Peaks;
+		return true;
+	}
+
+	bool MemoryBackend::GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags)
+	{
+		const MemoryScan* scan = Scan(sn);
+		if (scan == NULL)
+		{
+			labels.clear();
+			flags.clear();
+			return false;
+		}
+		labels = scan->Labels;
+		flags = scan->Flags;
+		return true;
+	}
+
+	// Averaging profile data needs the reader's resampling, the bindings merge centroids themselves
+	bool MemoryBackend::GetAveragedSpectrum(const std::vector<long>&, bool, std::vector<DataPeak>&)
+	{
+		return false;
+	}
+
+	bool MemoryBackend::GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points)
+	{
+		points.clear();
+		if (!IsOpen || settings.Type < 0 || settings.Type > 2 || settings.Operator != 0)
+			return false;
+
+		// Mass range "low-high", or a single mass +/- 0.5
+		double low = 0;
+		double high = 0;
+		if (settings.Type == 0)
+		{
+			char* end = NULL;
+			low = strtod(settings.MassRange1.c_str(), &end);
+			if (end == settings.MassRange1.c_str())
+				return false;
+			high = *end == '-' ? strtod(end + 1, NULL) : low + 0.5;
+			if (*end != '-')
+				low -= 0.5;
+		}
+
+		double from = startTime;
+		double to = endTime > 0 ? endTime : 1e300;
+		for (size_t i = 0; i < Scans.size(); i++)
+		{
+			const MemoryScan& scan = Scans[i];
+			double rt = scan.Header.StartTime;
+			if (rt < from || rt > to)
+				continue;
+			if (!settings.Filter.empty() && scan.Filter.find(settings.Filter) == std::string::npos)
+				continue;
+
+			double value = 0;
+			if (settings.Type == 1)
+			{
+				value = scan.Header.TIC;
+			}
+			else if (settings.Type == 2)
+			{
+				value = scan.Header.BasePeakIntensity;
+			}
+			else
+			{
+				// Summed over the centroids, as the native reader does
+				const std::vector<DataPeak>& peaks = scan.Centroid ? scan.Peaks : scan.Centroids;
+				for (size_t p = 0; p < peaks.size(); p++)
+				{
+					if (peaks[p].Mass >= low && peaks[p].Mass <= high)
+						value += peaks[p].Intensity;
+				}
+			}
+
+			ChroPeak point = { rt, value };
+			points.push_back(point);
+		}
+
+		if (!points.empty())
+		{
+			startTime = points.front().dTime;
+			endTime = points.back().dTime;
+		}
+		return true;
+	}
+
+	bool MemoryBackend::GetNumInstMethods(long& count)
+	{
+		count = (long)Methods.size();
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetInstMethod(long index, std::string& method)
+	{
+		if (!IsOpen || index < 0 || index >= (long)Methods.size())
+			return false;
+		method = Methods[index];
+		return true;
+	}
+
+	bool MemoryBackend::GetInstMethodNames(std::vector<std::string>& names)
+	{
+		names = MethodNames;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetLowMass(double& mass)
+	{
+		mass = LowMass;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetHighMass(double& mass)
+	{
+		mass = HighMass;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetInstName(std::string& name)
+	{
+		name = InstName;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetInstSoftwareVersion(std::string& version)
+	{
+		version = InstSoftwareVersion;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetInstSerialNumber(std::string& serialNumber)
+	{
+		serialNumber = InstSerialNumber;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetInstHardwareVersion(std::string& version)
+	{
+		version = InstHardwareVersion;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetInstModel(std::string& model)
+	{
+		model = InstModel;
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetNumErrorLog(long& count)
+	{
+		count = (long)ErrorLog.size();
+		return IsOpen;
+	}
+
+	bool MemoryBackend::GetErrorLogItem(long index, double& rt, std::string& message)
+	{
+		std::map<long, std::pair<double, std::string> >::const_iterator it = ErrorLog.find(index);
+		if (it == ErrorLog.end())
+			return false;
+		rt = it->second.first;
+		message = it->second.second;
+		return true;
+	}
+
+}
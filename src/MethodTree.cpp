@@ -0,0 +1,138 @@
+/* MethodTree.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "MethodTree.h"
+
+#include <algorithm>
+
+namespace RawFile {
+
+	static std::string Trim(const std::string& s)
+	{
+		size_t start = s.find_first_not_of(" \t\r\n");
+		if (start == std::string::npos)
+			return "";
+		size_t end = s.find_last_not_of(" \t\r\n");
+		return s.substr(start, end - start + 1);
+	}
+
+	std::string MethodTree::NormalizeKey(const std::string& label)
+	{
+		std::string key = Trim(label);
+		while (!key.empty() && (key[key.size() - 1] == '=' || key[key.size() - 1] == ':'))
+			key = Trim(key.substr(0, key.size() - 1));
+		return key;
+	}
+
+	MethodTree::MethodTree(const std::string& text)
+	{
+		MethodNode root;
+		root.Indent = -1;
+		root.Parent = 0;
+		root.FirstParameter = 0;
+		Nodes.push_back(root);
+
+		std::vector<size_t> open(1, 0);
+		size_t lineStart = 0;
+		while (lineStart < text.size())
+		{
+			size_t lineEnd = text.find('\n', lineStart);
+			if (lineEnd == std::string::npos)
+				lineEnd = text.size();
+			std::string line = text.substr(lineStart, lineEnd - lineStart);
+			lineStart = lineEnd + 1;
+
+			int indent = 0;
+			while (indent < (int)line.size() && (line[indent] == ' ' || line[indent] == '\t'))
+				indent += line[indent] == '\t' ? 4 : 1;
+
+			std::string content = Trim(line);
+			if (content.empty())
+				continue;
+
+			// Parameters are "key = value" or "key: value", anything else starts a section
+			size_t separator = content.find('=');
+			if (separator == std::string::npos)
+				separator = content.find(':');
+			bool header = separator == std::string::npos || (content[separator] == ':' && Trim(content.substr(separator + 1)).empty());
+
+			// Close the sections this line is not nested in
+			while (open.size() > 1 && Nodes[open.back()].Indent >= indent)
+			{
+				Nodes[open.back()].EndParameter = Parameters.size();
+				open.pop_back();
+			}
+
+			if (header)
+			{
+				MethodNode node;
+				node.Name = NormalizeKey(content);
+				node.Indent = indent;
+				node.Parent = open.back();
+				node.FirstParameter = Parameters.size();
+				node.EndParameter = Parameters.size();
+
+				size_t index = Nodes.size();
+				SectionIndex[node.Name].push_back(index);
+				Nodes[node.Parent].Children.push_back(index);
+				Nodes.push_back(node);
+				open.push_back(index);
+			}
+			else
+			{
+				MethodParameter parameter;
+				parameter.Key = Trim(content.substr(0, separator));
+				parameter.Value = Trim(content.substr(separator + 1));
+				parameter.Node = open.back();
+
+				ParameterIndex[parameter.Key].push_back(Parameters.size());
+				Parameters.push_back(parameter);
+			}
+		}
+
+		for (size_t i = 0; i < open.size(); i++)
+			Nodes[open[i]].EndParameter = Parameters.size();
+	}
+
+	const MethodNode* MethodTree::Find(const std::vector<std::string>& path) const
+	{
+		size_t node = 0;
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			std::unordered_map<std::string, std::vector<size_t> >::const_iterator it = SectionIndex.find(NormalizeKey(path[i]));
+			if (it == SectionIndex.end())
+				return NULL;
+			std::vector<size_t>::const_iterator next = std::upper_bound(it->second.begin(), it->second.end(), node);
+			if (next == it->second.end())
+				return NULL;
+			node = *next;
+		}
+		return &Nodes[node];
+	}
+
+	const MethodParameter* MethodTree::Lookup(const MethodNode* node, const std::string& label, bool partial) const
+	{
+		std::string key = NormalizeKey(label);
+		if (partial)
+		{
+			for (size_t i = node->FirstParameter; i < Parameters.size(); i++)
+			{
+				if (Parameters[i].Key.find(key) != std::string::npos)
+					return &Parameters[i];
+			}
+			return NULL;
+		}
+
+		std::unordered_map<std::string, std::vector<size_t> >::const_iterator it = ParameterIndex.find(key);
+		if (it == ParameterIndex.end())
+			return NULL;
+		std::vector<size_t>::const_iterator next = std::lower_bound(it->second.begin(), it->second.end(), node->FirstParameter);
+		return next != it->second.end() ? &Parameters[*next] : NULL;
+	}
+
+}
@@ -0,0 +1,1455 @@
+/* NativeBackend.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "NativeBackend.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RawFile {
+
+	#define NATIVE_MAGIC					0xa101
+	#define NATIVE_VERSION					66		// the only layout decoded
+	#define NATIVE_FILE_HEADER				1356	// a file header, the raw file and its method file start with one
+	#define NATIVE_INFO_PREAMBLE			1856	// the raw file info ahead of its heading texts
+	#define NATIVE_INFO_RUN_HEADER			0x338	// in the preamble, the run header address of the first controller
+	#define NATIVE_RUN_HEADER_ADDRESSES		0x1cf0	// in the run header, the scan index address and the others after it
+	#define NATIVE_RUN_HEADER_INST_ID		0x1d98	// in the run header, the instrument id followed by the status log header
+	#define NATIVE_INDEX_ENTRY				88
+	#define NATIVE_EVENT_PREAMBLE			136
+	#define NATIVE_EVENT_REACTION			56
+	#define NATIVE_EVENT_TAIL				12
+	#define NATIVE_PACKET_HEADER			40
+	#define NATIVE_NO_INDEX					0xffff	// segment or event not recorded in the scan index
+
+	#define CFB_MAX_REGULAR					0xfffffffa
+	#define CFB_DIRECTORY_ENTRY				128
+	#define CFB_HEADER_DIFAT				109
+
+	// Bounds checked little endian reads from the mapped file.  A read past the
+	// end fails the cursor and returns zeros, so decoding checks Ok once done.
+	class NativeCursor
+	{
+	public:
+		NativeCursor(const unsigned char* data, size_t size, size_t at)
+			: Data(data), Size(size), At(at), Ok(data != NULL && at <= size)
+		{
+		}
+
+		const unsigned char* Take(size_t count, size_t size = 1)
+		{
+			if (!Ok || (size != 0 && count > (Size - At) / size))
+			{
+				Ok = false;
+				return NULL;
+			}
+			const unsigned char* p = Data + At;
+			At += count * size;
+			return p;
+		}
+
+		template<typename T> T Read()
+		{
+			T value = T();
+			const unsigned char* p = Take(sizeof(T));
+			if (p != NULL)
+				memcpy(&value, p, sizeof(T));
+			return value;
+		}
+
+		unsigned char U8() { return Read<unsigned char>(); }
+		unsigned short U16() { return Read<unsigned short>(); }
+		unsigned int U32() { return Read<unsigned int>(); }
+		unsigned long long U64() { return Read<unsigned long long>(); }
+		float F32() { return Read<float>(); }
+		double F64() { return Read<double>(); }
+		std::string Text();
+
+		const unsigned char* Data;
+		size_t Size;
+		size_t At;
+		bool Ok;
+	};
+
+	template<typename T> static T ReadAt(const unsigned char* p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	// UTF-16 text up to its end or a terminating zero as UTF-8
+	static std::string WideText(const unsigned char* p, size_t chars)
+	{
+		std::string text;
+		AppendUtf8(p, chars, text);
+		return text;
+	}
+
+	// A character count and that many UTF-16 characters
+	std::string NativeCursor::Text()
+	{
+		unsigned int chars = U32();
+		return WideText(Take(chars, 2), chars);
+	}
+
+	// The size in a record of each generic data type
+	static bool FieldSize(const NativeField& field, size_t& size)
+	{
+		switch (field.Type)
+		{
+		case 0:									// a label without a value
+			size = 0;
+			return true;
+		case 1: case 2: case 3: case 4: case 5:	// char, true/false, yes/no, on/off, unsigned char
+			size = 1;
+			return true;
+		case 6: case 7:							// short, unsigned short
+			size = 2;
+			return true;
+		case 8: case 9: case 10:				// long, unsigned long, float
+			size = 4;
+			return true;
+		case 11:								// double
+			size = 8;
+			return true;
+		case 12:								// ASCII text
+			size = field.Length;
+			return true;
+		case 13:								// UTF-16 text
+			size = 2 * (size_t)field.Length;
+			return true;
+		}
+		return false;
+	}
+
+	// A generic data header: the field count, then type, length and label of each
+	static void ReadFields(NativeCursor& in, NativeRecords& records)
+	{
+		records.Fields.clear();
+		records.RecordSize = 0;
+		unsigned int count = in.U32();
+		for (unsigned int i = 0; i < count && in.Ok; i++)
+		{
+			NativeField field;
+			field.Type = in.U32();
+			field.Length = in.U32();
+			field.Label = in.Text();
+			field.Offset = records.RecordSize;
+
+			size_t size = 0;
+			if (!FieldSize(field, size))
+			{
+				in.Ok = false;
+				return;
+			}
+			records.RecordSize += size;
+			records.Fields.push_back(field);
+		}
+	}
+
+	// Records of the given layout, the stride apart from the address
+	static bool SetRecords(NativeRecords& records, size_t address, size_t stride, size_t count, size_t fileSize)
+	{
+		records.Address = address;
+		records.Stride = stride;
+		records.Count = count;
+		return stride >= records.RecordSize && address <= fileSize && (stride == 0 || count <= (fileSize - address) / stride);
+	}
+
+	static void FieldValue(const NativeField& field, const unsigned char* p, ReaderValue& value)
+	{
+		value.Type = ValueNumber;
+		value.Number = 0;
+		value.Text.clear();
+
+		switch (field.Type)
+		{
+		case 0:
+			value.Type = ValueString;
+			break;
+		case 1:
+			value.Type = ValueString;
+			if (p[0] != 0)
+				value.Text.assign(1, (char)p[0]);
+			break;
+		case 2: case 3: case 4:
+			value.Type = ValueBoolean;
+			value.Number = p[0] != 0 ? 1 : 0;
+			break;
+		case 5:
+			value.Number = p[0];
+			break;
+		case 6:
+			value.Number = ReadAt<short>(p);
+			break;
+		case 7:
+			value.Number = ReadAt<unsigned short>(p);
+			break;
+		case 8:
+			value.Number = ReadAt<int>(p);
+			break;
+		case 9:
+			value.Number = ReadAt<unsigned int>(p);
+			break;
+		case 10:
+			value.Number = ReadAt<float>(p);
+			break;
+		case 11:
+			value.Number = ReadAt<double>(p);
+			break;
+		case 12:
+			value.Type = ValueString;
+			value.Text.assign((const char*)p, std::find(p, p + field.Length, 0) - p);
+			break;
+		case 13:
+			value.Type = ValueString;
+			value.Text = WideText(p, field.Length);
+			break;
+		}
+	}
+
+	// The value as the reader shows it, floats to the field's precision
+	static std::string FieldText(const NativeField& field, const ReaderValue& value)
+	{
+		char buffer[64];
+		switch (field.Type)
+		{
+		case 2:
+			return value.Number != 0 ? "True" : "False";
+		case 3:
+			return value.Number != 0 ? "Yes" : "No";
+		case 4:
+			return value.Number != 0 ? "On" : "Off";
+		case 5: case 6: case 7: case 8: case 9:
+			snprintf(buffer, sizeof(buffer), "%.0f", value.Number);
+			return buffer;
+		case 10: case 11:
+			snprintf(buffer, sizeof(buffer), "%.*f", (int)(std::min)(field.Length, 15UL), value.Number);
+			return buffer;
+		}
+		return value.Text;
+	}
+
+	// The scan event ahead of each scan's data: the settings the filter shows,
+	// the reactions of MSn scans, mass ranges and the FT conversion coefficients
+	static void ReadEvent(NativeCursor& in, NativeEvent& event)
+	{
+		const unsigned char* preamble = in.Take(NATIVE_EVENT_PREAMBLE);
+		if (preamble != NULL)
+		{
+			event.Polarity = preamble[4];
+			event.ScanMode = preamble[5];
+			event.MSOrder = preamble[6];
+			event.ScanType = preamble[7];
+			event.Dependent = preamble[10];
+			event.Ionization = preamble[11];
+			event.Analyzer = preamble[40];
+		}
+
+		unsigned int count = in.U32();
+		const unsigned char* p = in.Take(count, NATIVE_EVENT_REACTION);
+		event.Reactions.resize(p != NULL ? count : 0);
+		for (size_t i = 0; i < event.Reactions.size(); i++, p += NATIVE_EVENT_REACTION)
+		{
+			event.Reactions[i].PrecursorMass = ReadAt<double>(p);
+			event.Reactions[i].IsolationWidth = ReadAt<double>(p + 8);
+			event.Reactions[i].Energy = ReadAt<double>(p + 16);
+			event.Reactions[i].Flags = ReadAt<unsigned int>(p + 24);
+		}
+
+		count = in.U32();
+		p = in.Take(count, 2 * sizeof(double));
+		event.MassRanges.resize(p != NULL ? count : 0);
+		for (size_t i = 0; i < event.MassRanges.size(); i++, p += 2 * sizeof(double))
+			event.MassRanges[i] = std::make_pair(ReadAt<double>(p), ReadAt<double>(p + 8));
+
+		count = in.U32();
+		p = in.Take(count, sizeof(double));
+		event.Coefficients.resize(p != NULL ? count : 0);
+		for (size_t i = 0; i < event.Coefficients.size(); i++, p += sizeof(double))
+			event.Coefficients[i] = ReadAt<double>(p);
+
+		in.Take(NATIVE_EVENT_TAIL);
+	}
+
+	static const char* const Analyzers[] = { "ITMS", "TQMS", "SQMS", "TOFMS", "FTMS", "Sector" };
+	static const char* const Ionizations[] = { "EI", "CI", "FAB", "ESI", "APCI", "NSI", "TSP", "FD", "MALDI", "GD" };
+	static const char* const ScanTypes[] = { "Full", "Z", "SIM", "SRM", "CRM", "", "Q1MS", "Q3MS" };
+	static const char* const Activations[] = { "cid", "mpd", "ecd", "pqd", "etd", "hcd", "any", "sa", "ptr", "netd", "nptr", "uvpd" };
+
+	#define NAME_OF(names, index)	((index) < sizeof(names) / sizeof(names[0]) ? names[index] : "")
+
+	// The scan filter as the reader writes it, e.g. "FTMS + p ESI Full ms [150.0000-1000.0000]"
+	static std::string EventFilter(const NativeEvent& event)
+	{
+		char buffer[64];
+		std::string filter = NAME_OF(Analyzers, event.Analyzer);
+		filter += event.Polarity != 0 ? " + " : " - ";
+		filter += event.ScanMode != 0 ? "p " : "c ";
+		filter += NAME_OF(Ionizations, event.Ionization);
+		if (event.Dependent != 0)
+			filter += " d";
+		filter += " ";
+		filter += NAME_OF(ScanTypes, event.ScanType);
+		filter += " ms";
+		if (event.MSOrder > 1)
+		{
+			snprintf(buffer, sizeof(buffer), "%d", (int)event.MSOrder);
+			filter += buffer;
+		}
+
+		for (size_t i = 0; i < event.Reactions.size(); i++)
+		{
+			const NativeReaction& reaction = event.Reactions[i];
+			snprintf(buffer, sizeof(buffer), " %.4f@%s", reaction.PrecursorMass, NAME_OF(Activations, reaction.Flags >> 1));
+			filter += buffer;
+			if ((reaction.Flags & 1) != 0)
+			{
+				snprintf(buffer, sizeof(buffer), "%.2f", reaction.Energy);
+				filter += buffer;
+			}
+		}
+
+		for (size_t i = 0; i < event.MassRanges.size(); i++)
+		{
+			snprintf(buffer, sizeof(buffer), "%s%.4f-%.4f", i == 0 ? " [" : ", ", event.MassRanges[i].first, event.MassRanges[i].second);
+			filter += buffer;
+		}
+		if (!event.MassRanges.empty())
+			filter += "]";
+		return filter;
+	}
+
+	// The header of a scan's data packet and where its streams start: the
+	// profile, the centroid peaks, a descriptor per peak, the peak resolutions
+	// and the (mass, noise, baseline) points the noise is interpolated from
+	typedef struct _nativePacket
+	{
+		size_t ProfileSize;
+		size_t PeakListSize;
+		unsigned int Layout;					// profile chunks carry a correction when set
+		size_t DescriptorSize;
+		size_t ResolutionSize;
+		size_t NoiseSize;
+		const unsigned char* Profile;
+		const unsigned char* PeakList;
+		const unsigned char* Descriptors;
+		const unsigned char* Resolutions;
+		const unsigned char* Noise;
+	} NativePacket;
+
+	static bool ReadPacket(const unsigned char* data, size_t size, NativePacket& packet)
+	{
+		NativeCursor in(data, size, 0);
+		in.U32();
+		packet.ProfileSize = 4 * (size_t)in.U32();
+		packet.PeakListSize = 4 * (size_t)in.U32();
+		packet.Layout = in.U32();
+		packet.DescriptorSize = 4 * (size_t)in.U32();
+		packet.ResolutionSize = 4 * (size_t)in.U32();
+		packet.NoiseSize = 4 * (size_t)in.U32();
+		in.At = NATIVE_PACKET_HEADER;
+		packet.Profile = in.Take(packet.ProfileSize);
+		packet.PeakList = in.Take(packet.PeakListSize);
+		packet.Descriptors = in.Take(packet.DescriptorSize);
+		packet.Resolutions = in.Take(packet.ResolutionSize);
+		packet.Noise = in.Take(packet.NoiseSize);
+		return in.Ok;
+	}
+
+	static size_t PeakCount(const NativePacket& packet)
+	{
+		if (packet.PeakListSize < 4)
+			return 0;
+		size_t count = ReadAt<unsigned int>(packet.PeakList);
+		return count <= (packet.PeakListSize - 4) / 8 ? count : 0;
+	}
+
+	// The points stored in the profile chunks
+	static size_t ProfileCount(const NativePacket& packet)
+	{
+		NativeCursor in(packet.Profile, packet.ProfileSize, 16);
+		unsigned int chunks = in.U32();
+		in.U32();
+		size_t count = 0;
+		for (unsigned int i = 0; i < chunks && in.Ok; i++)
+		{
+			in.U32();
+			unsigned int points = in.U32();
+			in.Take(packet.Layout > 0 ? 4 : 0);
+			if (in.Take(points, sizeof(float)) != NULL)
+				count += points;
+		}
+		return count;
+	}
+
+	// The compound (OLE) file holding the instrument methods, read far enough
+	// to get at a stream of a storage below the root
+	class NativeCompoundFile
+	{
+	public:
+		NativeCompoundFile(const unsigned char* data, size_t size);
+		bool Stream(const std::string& storage, const std::string& name, std::vector<unsigned char>& bytes) const;
+
+	private:
+		bool Chain(const std::vector<unsigned int>& table, unsigned int start, size_t size, bool mini, std::vector<unsigned char>& bytes) const;
+		long Child(long parent, const std::string& name) const;
+		const unsigned char* Entry(long index) const { return &Directory[index * CFB_DIRECTORY_ENTRY]; }
+		long Entries() const { return (long)(Directory.size() / CFB_DIRECTORY_ENTRY); }
+		size_t EntrySize(long index) const;
+
+		const unsigned char* Data;
+		size_t Size;
+		size_t SectorSize;
+		size_t MiniSectorSize;
+		size_t MiniStreamCutoff;
+		std::vector<unsigned int> Fat;
+		std::vector<unsigned int> MiniFat;
+		std::vector<unsigned char> Directory;
+		std::vector<unsigned char> MiniStream;
+	};
+
+	static void AppendTable(const unsigned char* p, size_t count, std::vector<unsigned int>& table)
+	{
+		for (size_t i = 0; i < count; i++)
+			table.push_back(ReadAt<unsigned int>(p + 4 * i));
+	}
+
+	NativeCompoundFile::NativeCompoundFile(const unsigned char* data, size_t size)
+		: Data(data), Size(size), SectorSize(0), MiniSectorSize(0), MiniStreamCutoff(0)
+	{
+		static const unsigned char signature[] = { 0xd0, 0xcf, 0x11, 0xe0, 0xa1, 0xb1, 0x1a, 0xe1 };
+		if (size < 512 || memcmp(data, signature, sizeof(signature)) != 0)
+			return;
+
+		unsigned int sectorShift = ReadAt<unsigned short>(data + 0x1e);
+		unsigned int miniSectorShift = ReadAt<unsigned short>(data + 0x20);
+		if (sectorShift < 9 || sectorShift > 16 || miniSectorShift > sectorShift)
+			return;
+		SectorSize = (size_t)1 << sectorShift;
+		MiniSectorSize = (size_t)1 << miniSectorShift;
+		MiniStreamCutoff = ReadAt<unsigned int>(data + 0x38);
+
+		// The FAT sectors are listed in the header, then in a chain of DIFAT sectors
+		std::vector<unsigned int> fatSectors;
+		AppendTable(data + 0x4c, CFB_HEADER_DIFAT, fatSectors);
+		unsigned int difat = ReadAt<unsigned int>(data + 0x44);
+		for (unsigned int i = 0; i < ReadAt<unsigned int>(data + 0x48) && difat < CFB_MAX_REGULAR; i++)
+		{
+			size_t at = ((size_t)difat + 1) * SectorSize;
+			if (at > size || SectorSize > size - at)
+				return;
+			AppendTable(data + at, SectorSize / 4 - 1, fatSectors);
+			difat = ReadAt<unsigned int>(data + at + SectorSize - 4);
+		}
+
+		for (size_t i = 0; i < fatSectors.size(); i++)
+		{
+			if (fatSectors[i] >= CFB_MAX_REGULAR)
+				continue;
+			size_t at = ((size_t)fatSectors[i] + 1) * SectorSize;
+			if (at > size || SectorSize > size - at)
+				return;
+			AppendTable(data + at, SectorSize / 4, Fat);
+		}
+
+		std::vector<unsigned char> bytes;
+		if (!Chain(Fat, ReadAt<unsigned int>(data + 0x30), size, false, Directory) || Entries() == 0)
+			return;
+		if (Chain(Fat, ReadAt<unsigned int>(data + 0x3c), size, false, bytes))
+			AppendTable(bytes.empty() ? NULL : &bytes[0], bytes.size() / 4, MiniFat);
+		Chain(Fat, ReadAt<unsigned int>(Entry(0) + 0x74), EntrySize(0), false, MiniStream);
+	}
+
+	// Version 3 files only use the low half of the stream size
+	size_t NativeCompoundFile::EntrySize(long index) const
+	{
+		unsigned long long size = ReadAt<unsigned long long>(Entry(index) + 0x78);
+		if (SectorSize == 512)
+			size &= 0xffffffff;
+		return size < Size ? (size_t)size : Size;
+	}
+
+	// Follow a sector chain, up to size bytes or its end
+	bool NativeCompoundFile::Chain(const std::vector<unsigned int>& table, unsigned int start, size_t size, bool mini, std::vector<unsigned char>& bytes) const
+	{
+		size_t sectorSize = mini ? MiniSectorSize : SectorSize;
+		bytes.clear();
+		size_t steps = 0;
+		for (unsigned int sector = start; sector < CFB_MAX_REGULAR && bytes.size() < size; sector = table[sector])
+		{
+			if (sector >= table.size() || ++steps > table.size())
+				return false;
+
+			size_t at = mini ? sector * sectorSize : ((size_t)sector + 1) * sectorSize;
+			size_t available = mini ? MiniStream.size() : Size;
+			if (at > available || sectorSize > available - at)
+				return false;
+			const unsigned char* p = mini ? &MiniStream[at] : Data + at;
+			bytes.insert(bytes.end(), p, p + (std::min)(sectorSize, size - bytes.size()));
+		}
+		return true;
+	}
+
+	// The entry of that name among the children of a storage
+	long NativeCompoundFile::Child(long parent, const std::string& name) const
+	{
+		std::vector<long> pending(1, (long)ReadAt<unsigned int>(Entry(parent) + 0x4c));
+		for (long visited = 0; !pending.empty() && visited < Entries(); visited++)
+		{
+			long index = pending.back();
+			pending.pop_back();
+			if (index < 0 || index >= Entries())
+				continue;
+
+			const unsigned char* entry = Entry(index);
+			size_t nameSize = (std::min)((size_t)ReadAt<unsigned short>(entry + 0x40), (size_t)64);
+			if (WideText(entry, nameSize / 2) == name)
+				return index;
+			pending.push_back((long)ReadAt<unsigned int>(entry + 0x44));
+			pending.push_back((long)ReadAt<unsigned int>(entry + 0x48));
+		}
+		return -1;
+	}
+
+	bool NativeCompoundFile::Stream(const std::string& storage, const std::string& name, std::vector<unsigned char>& bytes) const
+	{
+		bytes.clear();
+		if (Entries() == 0)
+			return false;
+		long parent = Child(0, storage);
+		long index = parent >= 0 ? Child(parent, name) : -1;
+		if (index < 0)
+			return false;
+
+		size_t size = EntrySize(index);
+		unsigned int start = ReadAt<unsigned int>(Entry(index) + 0x74);
+		return size < MiniStreamCutoff ? Chain(MiniFat, start, size, true, bytes) : Chain(Fat, start, size, false, bytes);
+	}
+
+	NativeBackend::NativeBackend()
+		: Data(NULL), Size(0), File(NULL), Mapping(NULL), IsOpen(false)
+	{
+		Close();
+	}
+
+	NativeBackend::~NativeBackend()
+	{
+		Close();
+	}
+
+	bool NativeBackend::Map(const char* fileName)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		HANDLE mapping = NULL;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (unsigned long long)size.QuadPart <= (size_t)-1)
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		const void* data = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (data == NULL)
+		{
+			if (mapping != NULL)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+		File = file;
+		Mapping = mapping;
+		Data = (const unsigned char*)data;
+		Size = (size_t)size.QuadPart;
+#else
+		int file = open(fileName, O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat status;
+		void* data = MAP_FAILED;
+		if (fstat(file, &status) == 0 && status.st_size > 0 && (unsigned long long)status.st_size <= (size_t)-1)
+			data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+		close(file);
+		if (data == MAP_FAILED)
+			return false;
+		Data = (const unsigned char*)data;
+		Size = (size_t)status.st_size;
+#endif
+		return true;
+	}
+
+	void NativeBackend::Unmap()
+	{
+		if (Data == NULL)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(Data);
+		CloseHandle((HANDLE)Mapping);
+		CloseHandle((HANDLE)File);
+#else
+		munmap((void*)Data, Size);
+#endif
+		Data = NULL;
+		Size = 0;
+		File = NULL;
+		Mapping = NULL;
+	}
+
+	// Ask for part of the file to be paged in ahead of use
+	void NativeBackend::ReadAhead(size_t address, size_t size) const
+	{
+#ifndef _WIN32
+		if (Data == NULL || address >= Size || size == 0)
+			return;
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t start = address - address % page;
+		size_t end = (std::min)(Size, address + size);
+		madvise((void*)(Data + start), end - start, MADV_WILLNEED);
+#endif
+	}
+
+	bool NativeBackend::Open(const char* fileName)
+	{
+		Close();
+		if (fileName == NULL || !Map(fileName))
+			return false;
+
+		if (!Decode())
+		{
+			Close();
+			return false;
+		}
+
+		// Spectra are mostly read in order, let the kernel read ahead through the data
+#ifndef _WIN32
+		madvise((void*)Data, Size, MADV_SEQUENTIAL);
+#endif
+		IsOpen = true;
+		return true;
+	}
+
+	bool NativeBackend::Decode()
+	{
+		static const char finnigan[] = "Finnigan";
+		NativeCursor in(Data, Size, 0);
+		if (in.U16() != NATIVE_MAGIC)
+			return false;
+		const unsigned char* signature = in.Take(sizeof(finnigan) - 1, 2);
+		if (signature == NULL || WideText(signature, sizeof(finnigan) - 1) != finnigan)
+			return false;
+		in.At = 0x24;
+		if (in.U32() != NATIVE_VERSION)
+			return false;
+
+		// The sequence row: injection data, then its texts
+		in.At = NATIVE_FILE_HEADER;
+		in.Take(64);
+		for (int i = 0; i < 16; i++)
+			in.Text();
+		in.U32();
+		for (int i = 0; i < 15; i++)
+			in.Text();
+
+		// The autosampler info, then the raw file info
+		in.Take(24);
+		in.Text();
+		size_t info = in.At;
+		bool hasMethods = in.U32() != 0;
+		in.At = info + NATIVE_INFO_RUN_HEADER;
+		size_t runHeader = (size_t)in.U64();
+		in.At = info + NATIVE_INFO_PREAMBLE;
+		for (int i = 0; i < 6; i++)
+			in.Text();
+		if (!in.Ok)
+			return false;
+		if (hasMethods)
+			DecodeMethods(in.At);
+
+		// The run header: scan range, mass range and where everything else is
+		NativeCursor header(Data, Size, runHeader);
+		header.Take(8);
+		FirstScan = (long)header.U32();
+		LastScan = (long)header.U32();
+		size_t statusLogCount = header.U32();
+		header.At = runHeader + 0x38;
+		LowMass = header.F64();
+		HighMass = header.F64();
+		header.At = runHeader + NATIVE_RUN_HEADER_ADDRESSES;
+		size_t scanIndex = (size_t)header.U64();
+		DataAddress = (size_t)header.U64();
+		size_t statusLog = (size_t)header.U64();
+		size_t errorLog = (size_t)header.U64();
+		header.U64();
+		size_t scanEvents = (size_t)header.U64();
+		size_t trailers = (size_t)header.U64();
+		if (!header.Ok || LastScan < FirstScan || scanIndex > Size || scanEvents > Size || trailers > Size)
+			return false;
+		ReadAhead(runHeader, Size - runHeader);
+
+		header.At = runHeader + NATIVE_RUN_HEADER_INST_ID;
+		header.Take(12);
+		InstModel = header.Text();
+		InstName = header.Text();
+		InstSerialNumber = header.Text();
+		InstSoftwareVersion = header.Text();
+		InstHardwareVersion = header.Text();
+		for (int i = 0; i < 3; i++)
+			header.Text();
+
+		// The status log records each lead with their retention time
+		ReadFields(header, StatusLogs);
+		if (!header.Ok || !SetRecords(StatusLogs, statusLog, StatusLogs.RecordSize + sizeof(float), statusLogCount, Size))
+			return false;
+
+		// The error log, the scan event templates by segment, then the trailer and tune data headers
+		NativeCursor logs(Data, Size, errorLog);
+		unsigned int count = logs.U32();
+		for (unsigned int i = 0; i < count && logs.Ok; i++)
+		{
+			double rt = logs.F32();
+			ErrorLog.push_back(std::make_pair(rt, logs.Text()));
+		}
+		unsigned int segments = logs.U32();
+		for (unsigned int i = 0; i < segments && logs.Ok; i++)
+		{
+			unsigned int events = logs.U32();
+			for (unsigned int j = 0; j < events && logs.Ok; j++)
+			{
+				NativeEvent event;
+				ReadEvent(logs, event);
+			}
+		}
+		ReadFields(logs, Trailers);
+		ReadFields(logs, TuneData);
+		if (!logs.Ok || logs.At > scanIndex)
+			return false;
+		size_t tuneCount = TuneData.RecordSize > 0 ? (scanIndex - logs.At) / TuneData.RecordSize : 0;
+		if (!SetRecords(TuneData, logs.At, TuneData.RecordSize, tuneCount, Size))
+			return false;
+
+		size_t scans = (size_t)(LastScan - FirstScan + 1);
+		if (!SetRecords(Trailers, trailers, Trailers.RecordSize, Trailers.RecordSize > 0 ? scans : 0, Size))
+			return false;
+		if (scans > (Size - scanIndex) / NATIVE_INDEX_ENTRY)
+			return false;
+
+		Scans.resize(scans);
+		for (size_t i = 0; i < scans; i++)
+		{
+			const unsigned char* entry = Data + scanIndex + i * NATIVE_INDEX_ENTRY;
+			NativeScan& scan = Scans[i];
+			memset(&scan.Header, 0, sizeof(scan.Header));
+			unsigned short event = ReadAt<unsigned short>(entry + 8);
+			unsigned short segment = ReadAt<unsigned short>(entry + 10);
+			scan.Event = event != NATIVE_NO_INDEX ? event + 1 : 1;
+			scan.Segment = segment != NATIVE_NO_INDEX ? segment + 1 : 1;
+			scan.PacketType = ReadAt<unsigned int>(entry + 16);
+			scan.Size = ReadAt<unsigned int>(entry + 20);
+			scan.Header.StartTime = ReadAt<double>(entry + 24);
+			scan.Header.TIC = ReadAt<double>(entry + 32);
+			scan.Header.BasePeakIntensity = ReadAt<double>(entry + 40);
+			scan.Header.BasePeakMass = ReadAt<double>(entry + 48);
+			scan.Header.LowMass = ReadAt<double>(entry + 56);
+			scan.Header.HighMass = ReadAt<double>(entry + 64);
+			unsigned long long offset = ReadAt<unsigned long long>(entry + 72);
+			if (DataAddress > Size || offset > Size - DataAddress || scan.Size > Size - DataAddress - offset)
+				return false;
+			scan.Address = DataAddress + (size_t)offset;
+		}
+
+		NativeCursor events(Data, Size, scanEvents);
+		events.U32();
+		Events.resize(scans);
+		for (size_t i = 0; i < scans && events.Ok; i++)
+			ReadEvent(events, Events[i]);
+		return events.Ok;
+	}
+
+	// The method file: its header, the instrument names and the compound file
+	// with a storage per instrument, the method text in its Text stream
+	bool NativeBackend::DecodeMethods(size_t address)
+	{
+		NativeCursor in(Data, Size, address);
+		in.Take(NATIVE_FILE_HEADER);
+		size_t size = in.U32();
+		in.Text();
+		unsigned int count = in.U32();
+		std::vector<std::string> storages;
+		for (unsigned int i = 0; i < count && in.Ok; i++)
+		{
+			MethodNames.push_back(in.Text());
+			storages.push_back(in.Text());
+		}
+		const unsigned char* compound = in.Take(size);
+		if (compound == NULL)
+		{
+			MethodNames.clear();
+			return false;
+		}
+
+		NativeCompoundFile file(compound, size);
+		for (size_t i = 0; i < storages.size(); i++)
+		{
+			std::vector<unsigned char> text;
+			file.Stream(storages[i], "Text", text);
+			Methods.push_back(WideText(text.empty() ? NULL : &text[0], text.size() / 2));
+		}
+		return true;
+	}
+
+	void NativeBackend::Close()
+	{
+		Unmap();
+		IsOpen = false;
+		FirstScan = 1;
+		LastScan = 0;
+		DataAddress = 0;
+		Scans.clear();
+		Events.clear();
+		Trailers = NativeRecords();
+		StatusLogs = NativeRecords();
+		TuneData = NativeRecords();
+		ErrorLog.clear();
+		Methods.clear();
+		MethodNames.clear();
+		LowMass = 0;
+		HighMass = 0;
+		InstName.clear();
+		InstSoftwareVersion.clear();
+		InstSerialNumber.clear();
+		InstHardwareVersion.clear();
+		InstModel.clear();
+	}
+
+	const NativeScan* NativeBackend::Scan(long sn) const
+	{
+		if (!IsOpen || sn < FirstScan || sn > LastScan)
+			return NULL;
+		return &Scans[sn - FirstScan];
+	}
+
+	const NativeEvent* NativeBackend::Event(long sn) const
+	{
+		if (!IsOpen || sn < FirstScan || sn > LastScan)
+			return NULL;
+		return &Events[sn - FirstScan];
+	}
+
+	bool NativeBackend::Record(const NativeRecords& records, size_t index, LabelValues& entries) const
+	{
+		entries.Labels.clear();
+		entries.Values.clear();
+		if (!IsOpen || index >= records.Count)
+			return false;
+
+		const unsigned char* record = Data + records.Address + index * records.Stride + (records.Stride - records.RecordSize);
+		entries.Labels.reserve(records.Fields.size());
+		entries.Values.reserve(records.Fields.size());
+		ReaderValue value;
+		for (size_t i = 0; i < records.Fields.size(); i++)
+		{
+			const NativeField& field = records.Fields[i];
+			FieldValue(field, record + field.Offset, value);
+			entries.Labels.push_back(field.Label);
+			entries.Values.push_back(FieldText(field, value));
+		}
+		return true;
+	}
+
+	bool NativeBackend::RecordValue(const NativeRecords& records, size_t index, const std::string& label, ReaderValue& value) const
+	{
+		if (!IsOpen || index >= records.Count)
+			return false;
+
+		const unsigned char* record = Data + records.Address + index * records.Stride + (records.Stride - records.RecordSize);
+		for (size_t i = 0; i < records.Fields.size(); i++)
+		{
+			if (records.Fields[i].Label == label)
+			{
+				FieldValue(records.Fields[i], record + records.Fields[i].Offset, value);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// The last status log record at or before the scan, else the first
+	long NativeBackend::StatusLogIndex(long sn) const
+	{
+		const NativeScan* scan = Scan(sn);
+		if (scan == NULL || StatusLogs.Count == 0)
+			return -1;
+
+		long index = 0;
+		for (size_t i = 1; i < StatusLogs.Count; i++)
+		{
+			if (ReadAt<float>(Data + StatusLogs.Address + i * StatusLogs.Stride) > scan->Header.StartTime)
+				break;
+			index = (long)i;
+		}
+		return index;
+	}
+
+	bool NativeBackend::SetCurrentController(long type, long index)
+	{
+		return IsOpen && type == 0 && index == 1;
+	}
+
+	bool NativeBackend::GetNumberOfControllers(long& count)
+	{
+		count = IsOpen ? 1 : 0;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetControllerType(long index, long& type)
+	{
+		if (!IsOpen || index != 0)
+			return false;
+		type = 0;
+		return true;
+	}
+
+	bool NativeBackend::GetFirstSpectrumNumber(long& sn)
+	{
+		sn = FirstScan;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetLastSpectrumNumber(long& sn)
+	{
+		sn = LastScan;
+		return IsOpen;
+	}
+
+	// The run as it was when opened
+	bool NativeBackend::InAcquisition(bool& inAcquisition)
+	{
+		inAcquisition = false;
+		return IsOpen;
+	}
+
+	bool NativeBackend::RefreshViewOfFile()
+	{
+		return IsOpen;
+	}
+
+	// Another reader maps the same pages
+	bool NativeBackend::SupportsParallelReads(bool& parallel)
+	{
+		parallel = true;
+		return true;
+	}
+
+	bool NativeBackend::GetTuneData(long index, LabelValues& entries)
+	{
+		return index >= 0 && Record(TuneData, (size_t)index, entries);
+	}
+
+	bool NativeBackend::GetTuneDataValue(long index, const std::string& label, ReaderValue& value)
+	{
+		return index >= 0 && RecordValue(TuneData, (size_t)index, label, value);
+	}
+
+	bool NativeBackend::GetTrailerExtra(long sn, LabelValues& entries)
+	{
+		return Scan(sn) != NULL && Record(Trailers, (size_t)(sn - FirstScan), entries);
+	}
+
+	bool NativeBackend::GetTrailerExtraValue(long sn, const std::string& label, ReaderValue& value)
+	{
+		return Scan(sn) != NULL && RecordValue(Trailers, (size_t)(sn - FirstScan), label, value);
+	}
+
+	bool NativeBackend::GetStatusLog(long sn, double& rt, LabelValues& entries)
+	{
+		long index = StatusLogIndex(sn);
+		if (index < 0)
+			return false;
+		rt = ReadAt<float>(Data + StatusLogs.Address + index * StatusLogs.Stride);
+		return Record(StatusLogs, (size_t)index, entries);
+	}
+
+	bool NativeBackend::GetStatusLogValue(long sn, const std::string& label, double& rt, ReaderValue& value)
+	{
+		long index = StatusLogIndex(sn);
+		if (index < 0)
+			return false;
+		rt = ReadAt<float>(Data + StatusLogs.Address + index * StatusLogs.Stride);
+		return RecordValue(StatusLogs, (size_t)index, label, value);
+	}
+
+	// The index has the scan's statistics, the packet its point count
+	bool NativeBackend::GetNumStatusLog(long& count)
+	{
+		count = (long)StatusLogs.Count;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetStatusLogForPos(long pos, double& rt, std::vector<ReaderValue>& values)
+	{
+		values.clear();
+		if (!IsOpen || pos < 0 || (size_t)pos >= StatusLogs.Count)
+			return false;
+
+		const unsigned char* record = Data + StatusLogs.Address + pos * StatusLogs.Stride;
+		rt = ReadAt<float>(record);
+		record += StatusLogs.Stride - StatusLogs.RecordSize;
+		values.resize(StatusLogs.Fields.size());
+		for (size_t i = 0; i < StatusLogs.Fields.size(); i++)
+			FieldValue(StatusLogs.Fields[i], record + StatusLogs.Fields[i].Offset, values[i]);
+		return true;
+	}
+
+	// The numeric fields, booleans and text aren't plotted
+	bool NativeBackend::GetStatusLogPlottableIndex(std::vector<std::string>& labels, std::vector<long>& indices)
+	{
+		labels.clear();
+		indices.clear();
+		for (size_t i = 0; i < StatusLogs.Fields.size(); i++)
+		{
+			if (StatusLogs.Fields[i].Type < 5 || StatusLogs.Fields[i].Type > 11)
+				continue;
+			labels.push_back(StatusLogs.Fields[i].Label);
+			indices.push_back((long)i);
+		}
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetScanHeader(long sn, ScanHeader& header)
+	{
+		const NativeScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		header = scan->Header;
+
+		NativePacket packet;
+		if (ReadPacket(Data + scan->Address, scan->Size, packet))
+			header.NumPackets = (long)(packet.ProfileSize > 0 ? ProfileCount(packet) : PeakCount(packet));
+		return true;
+	}
+
+	bool NativeBackend::GetFilter(long sn, std::string& filter)
+	{
+		const NativeEvent* event = Event(sn);
+		if (event == NULL)
+			return false;
+		filter = EventFilter(*event);
+		return true;
+	}
+
+	bool NativeBackend::GetSegmentAndEvent(long sn, long& segment, long& scanEvent)
+	{
+		const NativeScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		segment = scan->Segment;
+		scanEvent = scan->Event;
+		return true;
+	}
+
+	bool NativeBackend::RTFromScanNum(long sn, double& rt)
+	{
+		const NativeScan* scan = Scan(sn);
+		if (scan == NULL)
+			return false;
+		rt = scan->Header.StartTime;
+		return true;
+	}
+
+	static bool ScanStartLess(const NativeScan& scan, double rt) { return scan.Header.StartTime < rt; }
+
+	// The scan closest in time
+	bool NativeBackend::ScanNumFromRT(double rt, long& sn)
+	{
+		if (!IsOpen || Scans.empty())
+			return false;
+		std::vector<NativeScan>::const_iterator it = std::lower_bound(Scans.begin(), Scans.end(), rt, ScanStartLess);
+		if (it == Scans.end() || (it != Scans.begin() && rt - (it - 1)->Header.StartTime <= it->Header.StartTime - rt))
+			--it;
+		sn = FirstScan + (long)(it - Scans.begin());
+		return true;
+	}
+
+	bool NativeBackend::GetMSOrder(long sn, long& msOrder)
+	{
+		const NativeEvent* event = Event(sn);
+		if (event == NULL)
+			return false;
+		msOrder = event->MSOrder;
+		return true;
+	}
+
+	bool NativeBackend::IsCentroidScan(long sn, bool& centroid)
+	{
+		const NativeEvent* event = Event(sn);
+		if (event == NULL)
+			return false;
+		centroid = event->ScanMode == 0;
+		return true;
+	}
+
+	bool NativeBackend::GetIsolationWidth(long sn, long msOrder, double& width)
+	{
+		const NativeEvent* event = Event(sn);
+		if (event == NULL)
+			return false;
+		width = msOrder >= 2 && msOrder - 2 < (long)event->Reactions.size() ? event->Reactions[msOrder - 2].IsolationWidth : 0;
+		return true;
+	}
+
+	bool NativeBackend::GetPrecursorMass(long sn, long msOrder, double& mass)
+	{
+		const NativeEvent* event = Event(sn);
+		if (event == NULL)
+			return false;
+		mass = msOrder >= 2 && msOrder - 2 < (long)event->Reactions.size() ? event->Reactions[msOrder - 2].PrecursorMass : 0;
+		return true;
+	}
+
+	static bool PeakMassLess(const DataPeak& a, const DataPeak& b) { return a.Mass < b.Mass; }
+
+	// The centroid peaks and, when asked for, their labels
+	bool NativeBackend::ReadPeaks(const NativeScan& scan, std::vector<DataPeak>& peaks, std::vector<LabelData>* labels, std::vector<LabelFlags>* flags) const
+	{
+		NativePacket packet;
+		if (!ReadPacket(Data + scan.Address, scan.Size, packet))
+			return false;
+
+		size_t count = PeakCount(packet);
+		peaks.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			peaks[i].Mass = ReadAt<float>(packet.PeakList + 4 + 8 * i);
+			peaks[i].Intensity = ReadAt<float>(packet.PeakList + 8 + 8 * i);
+		}
+		if (labels == NULL || flags == NULL)
+			return true;
+
+		// Descriptors hold the flags and charge of each peak, the resolutions
+		// follow a leading count, and noise and baseline are interpolated
+		bool described = packet.DescriptorSize == 4 * count;
+		bool resolved = packet.ResolutionSize == 4 * (count + 1);
+		size_t noisePoints = packet.NoiseSize / 12;
+		labels->resize(count);
+		flags->resize(count);
+		size_t point = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			LabelData& label = (*labels)[i];
+			LabelFlags& flag = (*flags)[i];
+			memset(&label, 0, sizeof(label));
+			memset(&flag, 0, sizeof(flag));
+			label.Mass = peaks[i].Mass;
+			label.Intensity = peaks[i].Intensity;
+			if (resolved)
+				label.Resolution = ReadAt<float>(packet.Resolutions + 4 + 4 * i);
+
+			if (described)
+			{
+				unsigned char bits = packet.Descriptors[4 * i + 2];
+				label.Charge = packet.Descriptors[4 * i + 3];
+				flag.Saturated = (bits & 0x01) != 0;
+				flag.Fragmented = (bits & 0x02) != 0;
+				flag.Merged = (bits & 0x04) != 0;
+				flag.Exception = (bits & 0x08) != 0;
+				flag.Modified = (bits & 0x20) != 0;
+			}
+
+			if (noisePoints > 0)
+			{
+				while (point + 1 < noisePoints && ReadAt<float>(packet.Noise + 12 * (point + 1)) < label.Mass)
+					point++;
+				const unsigned char* a = packet.Noise + 12 * point;
+				const unsigned char* b = packet.Noise + 12 * (std::min)(point + 1, noisePoints - 1);
+				double from = ReadAt<float>(a);
+				double to = ReadAt<float>(b);
+				double t = to > from ? (std::max)(0.0, (std::min)(1.0, (label.Mass - from) / (to - from))) : 0;
+				label.Noise = ReadAt<float>(a + 4) + t * (ReadAt<float>(b + 4) - ReadAt<float>(a + 4));
+				label.Baseline = ReadAt<float>(a + 8) + t * (ReadAt<float>(b + 8) - ReadAt<float>(a + 8));
+			}
+		}
+		return true;
+	}
+
+	// The profile points, in chunks of consecutive bins.  FT scans store
+	// frequencies, converted with the event's coefficients (conversion
+	// parameters A, B and C of the trailer) as A + B/f^2 + C/f^4, the small
+	// per chunk correction of some layouts is not applied.
+	bool NativeBackend::ReadProfile(const NativeScan& scan, const NativeEvent& event, std::vector<DataPeak>& peaks) const
+	{
+		NativePacket packet;
+		if (!ReadPacket(Data + scan.Address, scan.Size, packet))
+			return false;
+
+		const std::vector<double>& c = event.Coefficients;
+		bool frequencies = !c.empty();
+		if (frequencies && (c.size() < 5 || c[0] != 0 || c[1] != 0 || (c.size() > 5 && c[5] != 0) || (c.size() > 6 && c[6] != 0)))
+			return false;
+
+		NativeCursor in(packet.Profile, packet.ProfileSize, 0);
+		double first = in.F64();
+		double step = in.F64();
+		unsigned int chunks = in.U32();
+		in.U32();
+		peaks.clear();
+		for (unsigned int i = 0; i < chunks && in.Ok; i++)
+		{
+			unsigned int bin = in.U32();
+			unsigned int count = in.U32();
+			if (packet.Layout > 0)
+				in.F32();
+			const unsigned char* p = in.Take(count, sizeof(float));
+			for (unsigned int k = 0; p != NULL && k < count; k++)
+			{
+				double value = first + ((double)bin + k) * step;
+				DataPeak peak;
+				if (frequencies)
+				{
+					double squared = value * value;
+					peak.Mass = squared != 0 ? c[2] + c[3] / squared + c[4] / (squared * squared) : 0;
+				}
+				else
+				{
+					peak.Mass = value;
+				}
+				peak.Intensity = ReadAt<float>(p + 4 * k);
+				peaks.push_back(peak);
+			}
+		}
+
+		if (!std::is_sorted(peaks.begin(), peaks.end(), PeakMassLess))
+			std::sort(peaks.begin(), peaks.end(), PeakMassLess);
+		return in.Ok;
+	}
+
+	// Peaks at the local maxima of profile points, at the intensity weighted
+	// mass of the apex and its neighbours, with the apex height
+	static void CentroidProfile(const std::vector<DataPeak>& profile, std::vector<DataPeak>& peaks)
+	{
+		peaks.clear();
+		size_t count = profile.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			double apex = profile[i].Intensity;
+			if (apex <= 0 || (i > 0 && profile[i - 1].Intensity > apex) || (i + 1 < count && profile[i + 1].Intensity >= apex))
+				continue;
+
+			double weightedMass = 0;
+			double intensity = 0;
+			for (size_t j = i > 0 ? i - 1 : i; j <= i + 1 && j < count; j++)
+			{
+				weightedMass += profile[j].Mass * profile[j].Intensity;
+				intensity += profile[j].Intensity;
+			}
+			DataPeak peak = { weightedMass / intensity, apex };
+			peaks.push_back(peak);
+		}
+	}
+
+	// Centroids are those the file has, a profile scan without them is
+	// centroided at the maxima of its profile
+	bool NativeBackend::GetMassList(long sn, bool centroid, std::vector<DataPeak>& peaks)
+	{
+		const NativeScan* scan = Scan(sn);
+		NativePacket packet;
+		if (scan == NULL || !ReadPacket(Data + scan->Address, scan->Size, packet))
+		{
+			peaks.clear();
+			return false;
+		}
+
+		bool ok = false;
+		if (packet.ProfileSize > 0 && !centroid)
+			ok = ReadProfile(*scan, *Event(sn), peaks);
+		else if (packet.ProfileSize > 0 && PeakCount(packet) == 0)
+		{
+			std::vector<DataPeak> profile;
+			ok = ReadProfile(*scan, *Event(sn), profile);
+			CentroidProfile(profile, peaks);
+		}
+		else
+			ok = ReadPeaks(*scan, peaks, NULL, NULL);
+		if (sn < LastScan)
+			ReadAhead(Scans[sn + 1 - FirstScan].Address, Scans[sn + 1 - FirstScan].Size);
+		return ok;
+	}
+
+	bool NativeBackend::GetLabelData(long sn, std::vector<LabelData>& labels, std::vector<LabelFlags>& flags)
+	{
+		const NativeScan* scan = Scan(sn);
+		std::vector<DataPeak> peaks;
+		if (scan == NULL || !ReadPeaks(*scan, peaks, &labels, &flags))
+		{
+			labels.clear();
+			flags.clear();
+			return false;
+		}
+		if (sn < LastScan)
+			ReadAhead(Scans[sn + 1 - FirstScan].Address, Scans[sn + 1 - FirstScan].Size);
+		return true;
+	}
+
+	// Averaging profile data needs the reader's resampling, the bindings merge centroids themselves
+	bool NativeBackend::GetAveragedSpectrum(const std::vector<long>&, bool, std::vector<DataPeak>&)
+	{
+		return false;
+	}
+
+	// Computed from the scans as the memory reader does: mass range (type 0),
+	// TIC (1) and base peak (2), where the filter selects the scans whose filter contains it
+	bool NativeBackend::GetChroData(const ChroSettings& settings, double& startTime, double& endTime, std::vector<ChroPeak>& points)
+	{
+		points.clear();
+		if (!IsOpen || settings.Type < 0 || settings.Type > 2 || settings.Operator != 0)
+			return false;
+
+		// Mass range "low-high", or a single mass +/- 0.5
+		double low = 0;
+		double high = 0;
+		if (settings.Type == 0)
+		{
+			char* end = NULL;
+			low = strtod(settings.MassRange1.c_str(), &end);
+			if (end == settings.MassRange1.c_str())
+				return false;
+			high = *end == '-' ? strtod(end + 1, NULL) : low + 0.5;
+			if (*end != '-')
+				low -= 0.5;
+		}
+
+		double from = startTime;
+		double to = endTime > 0 ? endTime : 1e300;
+		std::vector<DataPeak> peaks;
+		for (long sn = FirstScan; sn <= LastScan; sn++)
+		{
+			const NativeScan& scan = Scans[sn - FirstScan];
+			double rt = scan.Header.StartTime;
+			if (rt < from || rt > to)
+				continue;
+			if (!settings.Filter.empty() && EventFilter(Events[sn - FirstScan]).find(settings.Filter) == std::string::npos)
+				continue;
+
+			double value = 0;
+			if (settings.Type == 1)
+			{
+				value = scan.Header.TIC;
+			}
+			else if (settings.Type == 2)
+			{
+				value = scan.Header.BasePeakIntensity;
+			}
+			else if (GetMassList(sn, true, peaks))
+			{
+				for (size_t p = 0; p < peaks.size(); p++)
+				{
+					if (peaks[p].Mass >= low && peaks[p].Mass <= high)
+						value += peaks[p].Intensity;
+				}
+			}
+
+			ChroPeak point = { rt, value };
+			points.push_back(point);
+		}
+
+		if (!points.empty())
+		{
+			startTime = points.front().dTime;
+			endTime = points.back().dTime;
+		}
+		return true;
+	}
+
+	bool NativeBackend::GetNumInstMethods(long& count)
+	{
+		count = (long)Methods.size();
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetInstMethod(long index, std::string& method)
+	{
+		if (!IsOpen || index < 0 || index >= (long)Methods.size())
+			return false;
+		method = Methods[index];
+		return true;
+	}
+
+	bool NativeBackend::GetInstMethodNames(std::vector<std::string>& names)
+	{
+		names = MethodNames;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetLowMass(double& mass)
+	{
+		mass = LowMass;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetHighMass(double& mass)
+	{
+		mass = HighMass;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetInstName(std::string& name)
+	{
+		name = InstName;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetInstSoftwareVersion(std::string& version)
+	{
+		version = InstSoftwareVersion;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetInstSerialNumber(std::string& serialNumber)
+	{
+		serialNumber = InstSerialNumber;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetInstHardwareVersion(std::string& version)
+	{
+		version = InstHardwareVersion;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetInstModel(std::string& model)
+	{
+		model = InstModel;
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetNumErrorLog(long& count)
+	{
+		count = (long)ErrorLog.size();
+		return IsOpen;
+	}
+
+	bool NativeBackend::GetErrorLogItem(long index, double& rt, std::string& message)
+	{
+		if (!IsOpen || index < 0 || index >= (long)ErrorLog.size())
+			return false;
+		rt = ErrorLog[index].first;
+		message = ErrorLog[index].second;
+		return true;
+	}
+
+}
@@ -10,13 +10,20 @@
  */
 
 #include "RawFile.h"
-#include "comutil.h"
 
 namespace RawFile {
 
 	static const struct luaL_Reg luaRawFile_l[] = {
 		{ "New", newRawFile },	
 		{ "GetRawFileMetaTable", getMetaTable },
+		{ "LoadLibrary", loadLibrary },
+		{ "Summarize", summarize },
+		{ NULL, NULL }
+	};
+
+	static const struct luaL_Reg luaCodec_l[] = {
+		{ "Encode", codecEncode },
+		{ "Decode", codecDecode },
 		{ NULL, NULL }
 	};
 		
@@ -29,6 +36,27 @@ namespace RawFile {
 		lua_pushstring(L, Version);
 		lua_setfield(L, -2, "Version");
 
+		// Bits of the columnar label data Flags mask
+		lua_createtable(L, 0, 5);
+		luaD_setNumber(L, LABEL_FLAG_SATURATED, "Saturated");
+		luaD_setNumber(L, LABEL_FLAG_FRAGMENTED, "Fragmented");
+		luaD_setNumber(L, LABEL_FLAG_MERGED, "Merged");
+		luaD_setNumber(L, LABEL_FLAG_EXCEPTION, "Exception");
+		luaD_setNumber(L, LABEL_FLAG_MODIFIED, "Modified");
+		lua_setfield(L, -2, "LabelFlags");
+
+		// The reader names accepted by New, the first is the default
+		lua_createtable(L, 0, 0);
+		for (int i = 0; BackendNames[i] != NULL; i++)
+		{
+			lua_pushstring(L, BackendNames[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "Backends");
+
+		luaL_newlib(L, luaCodec_l);
+		lua_setfield(L, -2, "Codec");
+
 		return 1;
 	}
 
@@ -65,43 +93,30 @@ namespace RawFile {
 		return !s.empty() && it == s.end();
 	}
 
-	static int ListToTable(lua_State* L, VARIANT* items, int size)
+	static int ListToTable(lua_State* L, const std::vector<std::string>& items)
 	{
+		int size = (int)items.size();
 		lua_createtable(L, size, 0);
 
-		BSTR* pItems = NULL;
-		SAFEARRAY FAR* itemsSA = items->parray;
-		SafeArrayAccessData(itemsSA, (void**)(&pItems));
 		for (int i = 0; i < size; i++)
 		{
-			CStringA value = (CStringA)pItems[i];
-			std::string sValue((LPCTSTR)value);
-			lua_pushstring(L, sValue.c_str());
+			lua_pushlstring(L, items[i].data(), items[i].size());
 			lua_rawseti(L, -2, i + 1);
 		}
-		SafeArrayUnaccessData(itemsSA);
-		SafeArrayDestroy(itemsSA);
 
 		return 1;
 	}
 
-	static int MapToStack(lua_State* L, VARIANT* labels, VARIANT* values, int size)
+	static int MapToStack(lua_State* L, const LabelValues& entries)
 	{
+		int size = (int)(std::min)(entries.Labels.size(), entries.Values.size());
 		lua_createtable(L, 0, size);
-		BSTR* pLabels = NULL;
-		BSTR* pValues = NULL;
-
-		SAFEARRAY FAR* labelSA = labels->parray;
-		SafeArrayAccessData(labelSA, (void**)(&pLabels));
-		SAFEARRAY FAR* valueSA = values->parray;
-		SafeArrayAccessData(valueSA, (void**)(&pValues));
 
 		for (int i = 0; i < size; i++)
-		{		
-			lua_pushstring(L, (CStringA)pLabels[i]);
+		{
+			lua_pushlstring(L, entries.Labels[i].data(), entries.Labels[i].size());
 
-			CStringA value = (CStringA)pValues[i];
-			std::string sValue((LPCTSTR)value);
+			const std::string& sValue = entries.Values[i];
 
 			if (is_number(sValue))
 			{
@@ -109,81 +124,95 @@ namespace RawFile {
 			}
 			else
 			{
-				lua_pushstring(L, sValue.c_str());
+				lua_pushlstring(L, sValue.data(), sValue.size());
 			}
 		
-			lua_settable(L, 3);
+			lua_settable(L, -3);
 		}
 
-		SafeArrayUnaccessData(labelSA);
-		SafeArrayDestroy(labelSA);
-		SafeArrayUnaccessData(valueSA);
-		SafeArrayDestroy(valueSA);
 		return 1;
 	}
 
-	static void VariantToStack(lua_State* L, VARIANT* value)
+	static void ValueToStack(lua_State* L, const ReaderValue& value)
 	{
-		switch (value->vt)
+		switch (value.Type)
 		{
-		case VT_BSTR:
-
-			lua_pushstring(L, _bstr_t(value->bstrVal));
-			break;
-		case VT_R4:
-			lua_pushnumber(L, value->fltVal);
+		case ValueString:
+			lua_pushlstring(L, value.Text.data(), value.Text.size());
 			break;
-		case VT_R8:
-			lua_pushnumber(L, value->dblVal);
+		case ValueNumber:
+			lua_pushnumber(L, value.Number);
 			break;
-		case VT_I4:
-			lua_pushnumber(L, value->lVal);
+		case ValueBoolean:
+			lua_pushboolean(L, value.Number != 0);
 			break;
-		case VT_I2:
-			lua_pushnumber(L, value->iVal);
-			break;
-		case VT_BOOL:
-			lua_pushboolean(L, value->boolVal);
-			break;
-		case VT_UI1:
-			lua_pushnumber(L, value->bVal);
-			break;
-		case VT_ERROR:
-			lua_pushnumber(L, value->scode);
-		case VT_EMPTY:
-		case VT_NULL:
+		default:
 			lua_pushnil(L);
 			break;
+		}
+	}
+
+	// Convert a numeric (or numeric string) value
+	static bool ValueToNumber(const ReaderValue& value, double& number)
+	{
+		switch (value.Type)
+		{
+		case ValueString:
+			return sscanf(value.Text.c_str(), "%lf", &number) == 1;
+		case ValueNumber:
+		case ValueBoolean:
+			number = value.Number;
+			return true;
 		default:
-			luaL_error(L, "Unhandled VT type %d, tell Derek to support this. He'll know what to do :)", value->vt);
-			break;
+			return false;
 		}
-		VariantClear(value);
-	}	
+	}
+
+	// Read a numeric trailer value, false when the scan has no such label
+	static bool TrailerNumber(RawFile* rawFile, long spectrumNumber, const std::string& label, double& number)
+	{
+		ReaderValue value;
+		if (!rawFile->Reader->GetTrailerExtraValue(spectrumNumber, label, value))
+			return false;
+		return ValueToNumber(value, number);
+	}
 
 	/***
 	Create a new instance of the rawfile 
 
+	The file is read through the named reader, see Backends.  "com" is the
+	MS File Reader or Foundation COM component.  "memory" reads the whole
+	run through the default reader on Open and serves every later call from
+	memory, "memory:<reader>" loads it through another reader.
+
 	@function 		New
 	@string 		filePath The path to the rawfile
+	@string[opt="com"] backend The reader to use
 	@treturn 		rawFile The Lua wrapped access to the rawfile
 	*/
 	int newRawFile(lua_State* L)
 	{
-		const char* filePath = luaL_checkstring(L, -1);
+		// Also allow the method call form RawFile:New(filePath)
+		int base = lua_type(L, 1) == LUA_TSTRING ? 1 : 2;
+		const char* filePath = luaL_checkstring(L, base);
+		const char* backend = luaL_optstring(L, base + 1, BackendNames[0]);
 		
 		// Create the user data, just the size of a pointer to the struct
 		RawFile **rawFile = reinterpret_cast<RawFile**>(lua_newuserdata(L, sizeof(RawFile*)));
 
 		// Allocate the actual memory
-		*rawFile = new RawFile(filePath);
+		*rawFile = new RawFile(filePath, backend);
 
 		// Get the initialization error if present
 		int result = (*rawFile)->init;
 
-		if (result != 0)
+		if ((*rawFile)->Reader.Get() == NULL)
 		{
-			luaL_error(L, "Error creating rawfile instance from COM: %d", result);
+			delete *rawFile;
+			*rawFile = NULL;
+			if (result == 0)
+				return luaL_error(L, "Unknown backend: %s", backend);
+			return luaL_error(L, "Error creating %s reader: %d", backend, result);
 		}
 
 		// Set the metatable for the userdata (on top of the stack) to the rawfile metatable
@@ -191,14 +220,299 @@ namespace RawFile {
 		lua_setmetatable(L, -2);
 
 		lua_newtable(L);
-		lua_pushstring(L, (*rawFile)->FileName);
+		lua_pushstring(L, (*rawFile)->FileName.c_str());
 		lua_setfield(L, -2, "FilePath");
+		lua_pushstring(L, backend);
+		lua_setfield(L, -2, "Backend");
 		lua_setuservalue(L, -2);
 
 		// return the userdata
 		return 1;
 	}
 	
+	struct FileSummary
+	{
+		bool IsOpen;
+		std::string Model;
+		std::string SerialNumber;
+		long First;
+		long Last;
+		std::vector<long> ScanCounts;		// by MS order
+		double StartTime;
+		double EndTime;
+		double TIC;
+	};
+
+	// Open a file and summarize its MS controller, the reader is closed again
+	static void SummarizeFile(RawFileBackend* reader, const std::string& path, FileSummary& summary)
+	{
+		summary.IsOpen = reader->Open(path.c_str()) && reader->SetCurrentController(0, 1);
+		if (!summary.IsOpen)
+		{
+			reader->Close();
+			return;
+		}
+
+		reader->GetInstModel(summary.Model);
+		reader->GetInstSerialNumber(summary.SerialNumber);
+		reader->GetFirstSpectrumNumber(summary.First);
+		reader->GetLastSpectrumNumber(summary.Last);
+		reader->RTFromScanNum(summary.First, summary.StartTime);
+		reader->RTFromScanNum(summary.Last, summary.EndTime);
+
+		for (long sn = summary.First; sn <= summary.Last; sn++)
+		{
+			long msOrder = 0;
+			if (reader->GetMSOrder(sn, msOrder) && msOrder > 0)
+			{
+				if ((size_t)msOrder > summary.ScanCounts.size())
+					summary.ScanCounts.resize(msOrder, 0);
+				summary.ScanCounts[msOrder - 1]++;
+			}
+
+			ScanHeader header;
+			if (reader->GetScanHeader(sn, header))
+				summary.TIC += header.TIC;
+		}
+		reader->Close();
+	}
+
+	/***
+	Summarize many raw files at once
+
+	The files are shared out to worker threads, each with its own reader (and
+	so its own COM apartment), which open them one after another.  Files that
+	can't be opened have IsOpen false and no further values.
+
+	@function 		Summarize
+	@tab 			paths The raw file paths
+	@tab[opt] 		options workers (default the number of cores), backend (default "com")
+	@treturn 		table FilePath, IsOpen, InstrumentModel, SerialNumber, FirstSpectrumNumber,
+					LastSpectrumNumber, StartTime, EndTime, TIC and ScanCounts columns, the
+					scan counts of a file by MS order
+	*/
+	int summarize(lua_State* L)
+	{
+		luaL_checktype(L, 1, LUA_TTABLE);
+		long workers = (long)std::thread::hardware_concurrency();
+		std::string backend = BackendNames[0];
+		if (!lua_isnoneornil(L, 2))
+		{
+			luaL_checktype(L, 2, LUA_TTABLE);
+			lua_pushvalue(L, 2);
+			luaD_getLong(L, "workers", workers);
+			luaD_getString(L, "backend", backend);
+			lua_pop(L, 1);
+		}
+
+		// Copy the paths, the workers can't touch the Lua state
+		std::vector<std::string> paths(lua_rawlen(L, 1));
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			lua_rawgeti(L, 1, (int)i + 1);
+			size_t length = 0;
+			const char* path = lua_tolstring(L, -1, &length);
+			if (path == NULL)
+				return luaL_argerror(L, 1, "paths must be strings");
+			paths[i].assign(path, length);
+			lua_pop(L, 1);
+		}
+
+		// Each worker takes the next file until none are left
+		std::vector<FileSummary> summaries(paths.size());
+		std::atomic<size_t> next(0);
+		size_t nThreads = (std::min)((size_t)(std::max)(workers, 1L), (std::max)(paths.size(), (size_t)1));
+		std::vector<int> errors(nThreads, 0);
+		std::vector<char> started(nThreads, false);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < nThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				RawFileBackend* reader = CreateBackend(backend.c_str(), errors[t]);
+				if (reader == NULL)
+					return;
+				started[t] = true;
+				for (size_t i = next++; i < paths.size(); i = next++)
+				{
+					summaries[i] = FileSummary();
+					SummarizeFile(reader, paths[i], summaries[i]);
+				}
+				delete reader;
+			}));
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		if (std::find(started.begin(), started.end(), (char)true) == started.end())
+		{
+			if (errors[0] == 0)
+				return luaL_error(L, "Unknown backend: %s", backend.c_str());
+			return luaL_error(L, "Error creating %s reader: %d", backend.c_str(), errors[0]);
+		}
+
+		int size = (int)paths.size();
+		lua_createtable(L, 0, 10);
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushlstring(L, paths[i].data(), paths[i].size());
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "FilePath");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushboolean(L, summaries[i].IsOpen);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "IsOpen");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushlstring(L, summaries[i].Model.data(), summaries[i].Model.size());
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "InstrumentModel");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushlstring(L, summaries[i].SerialNumber.data(), summaries[i].SerialNumber.size());
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "SerialNumber");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushinteger(L, summaries[i].First);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "FirstSpectrumNumber");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushinteger(L, summaries[i].Last);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "LastSpectrumNumber");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushnumber(L, summaries[i].StartTime);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "StartTime");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushnumber(L, summaries[i].EndTime);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "EndTime");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			lua_pushnumber(L, summaries[i].TIC);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "TIC");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			if (!summaries[i].IsOpen) continue;
+			const std::vector<long>& counts = summaries[i].ScanCounts;
+			lua_createtable(L, (int)counts.size(), 0);
+			for (size_t o = 0; o < counts.size(); o++)
+			{
+				lua_pushinteger(L, counts[o]);
+				lua_rawseti(L, -2, (int)o + 1);
+			}
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "ScanCounts");
+
+		return 1;
+	}
+
+	/***
+	Encode numbers, e.g. the masses or intensities of a spectrum
+
+	numpressLinear, numpressPic and numpressSlof are MS-Numpress, as in
+	mzML.  deltaVarint and shuffle (the bytes of the doubles grouped by
+	position, for a general compressor to follow) are lossless, float32 and
+	float16 (relative to the largest value) keep about 7 and 3 digits.
+
+	@function 		Codec.Encode
+	@tab 			values The numbers
+	@string 		codec numpressLinear, numpressPic, numpressSlof, deltaVarint, shuffle,
+					float32 or float16
+	@number[opt] 	fixedPoint The Numpress linear or slof fixed point (default the best for the values)
+	@treturn 		string The encoded bytes
+	*/
+	int codecEncode(lua_State* L)
+	{
+		CodecType type = (CodecType)luaL_checkoption(L, 2, NULL, CodecNames);
+		double fixedPoint = luaL_optnumber(L, 3, 0);
+
+		luaL_checktype(L, 1, LUA_TTABLE);
+		std::vector<double> values(lua_rawlen(L, 1));
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			lua_rawgeti(L, 1, (int)i + 1);
+			values[i] = lua_tonumber(L, -1);
+			lua_pop(L, 1);
+		}
+
+		std::vector<unsigned char> bytes;
+		Encode(type, values.data(), values.size(), bytes, fixedPoint);
+		lua_pushlstring(L, reinterpret_cast<const char*>(bytes.data()), bytes.size());
+		return 1;
+	}
+
+	/***
+	Decode numbers encoded by Codec.Encode, or by another MS-Numpress implementation
+
+	@function 		Codec.Decode
+	@string 		bytes The encoded bytes
+	@string 		codec The codec they were encoded with
+	@treturn 		table The numbers
+	*/
+	int codecDecode(lua_State* L)
+	{
+		size_t size = 0;
+		const char* bytes = luaL_checklstring(L, 1, &size);
+		CodecType type = (CodecType)luaL_checkoption(L, 2, NULL, CodecNames);
+
+		std::vector<double> values;
+		if (!Decode(type, reinterpret_cast<const unsigned char*>(bytes), size, values))
+			return luaL_error(L, "Malformed %s data", CodecNames[type]);
+
+		int count = (int)values.size();
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; i++)
+		{
+			lua_pushnumber(L, values[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
 	/// a
 	// @type rawFile
 
@@ -207,20 +521,20 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);
 
-		HRESULT hr = rawFile->comRawFile->Open(rawFile->FileName);
-		if (FAILED(hr)) {
+		if (!rawFile->Reader->Open(rawFile->FileName.c_str())) {
 			lua_pushboolean(L, false);
 			return 1;
 		}
-		hr = rawFile->comRawFile->SetCurrentController(0, 1); // MS device, 1st device
+		rawFile->Reader->SetCurrentController(0, 1); // MS device, 1st device
 		rawFile->IsOpen = true;
 
 		// Handle read once properties
 
 		long firstScanNumber = 0;
 		long lastScanNumber = 0;
-		rawFile->comRawFile->GetFirstSpectrumNumber(&firstScanNumber);
-		rawFile->comRawFile->GetLastSpectrumNumber(&lastScanNumber);
+		rawFile->Reader->GetFirstSpectrumNumber(firstScanNumber);
+		rawFile->Reader->GetLastSpectrumNumber(lastScanNumber);
+		rawFile->LastScanSeen = firstScanNumber - 1;
 
 		// Get the user value for this userdata
 		lua_getuservalue(L, 1);
@@ -242,7 +556,13 @@ namespace RawFile {
 	int closeRawFile(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		rawFile->comRawFile->Close();
+		rawFile->CloseDevices();
+		delete rawFile->Method;
+		rawFile->Method = NULL;
+		rawFile->ScanIndex.clear();
+		delete rawFile->Store;
+		rawFile->Store = NULL;
+		rawFile->Reader->Close();
 		rawFile->IsOpen = false;
 
 		// Clear the user value table with a new one
@@ -258,7 +578,7 @@ namespace RawFile {
 	int rawFileToString(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		lua_pushfstring(L, "RawFile: %s", rawFile->FileName);
+		lua_pushfstring(L, "RawFile: %s", rawFile->FileName.c_str());
 		return 1;
 	}
 
@@ -271,30 +591,21 @@ namespace RawFile {
 		{
 			const char* key = luaL_checkstring(L, -1);
 
-			VARIANT varValue;
-			VariantInit(&varValue);
-			HRESULT hr = rawFile->comRawFile->GetTuneDataValue(spectrumNumber, _bstr_t(key), &varValue);
-			if (FAILED(hr))
+			ReaderValue value;
+			if (!rawFile->Reader->GetTuneDataValue(spectrumNumber, key, value))
 			{
 				return luaL_error(L, "Couldn't access key");
 			}
 
-			VariantToStack(L, &varValue);
-			VariantClear(&varValue);
+			ValueToStack(L, value);
 
 			return 1;
 		}
 
-		VARIANT labels;
-		VARIANT values;
-		VariantInit(&labels);
-		VariantInit(&values);
-
-		long size = 0;
-
-		rawFile->comRawFile->GetTuneData(spectrumNumber, &labels, &values, &size);
+		LabelValues entries;
+		rawFile->Reader->GetTuneData(spectrumNumber, entries);
 
-		MapToStack(L, &labels, &values, size);
+		MapToStack(L, entries);
 		return 1;
 	}
 
@@ -307,187 +618,751 @@ namespace RawFile {
 		{
 			const char* key = luaL_checkstring(L, 3);
 
-			VARIANT varValue;
-			VariantInit(&varValue);
-			HRESULT hr = rawFile->comRawFile->GetTrailerExtraValueForScanNum(spectrumNumber, _bstr_t(key), &varValue);
-			if (FAILED(hr))
+			ReaderValue value;
+			if (!rawFile->Reader->GetTrailerExtraValue(spectrumNumber, key, value))
 			{
 				return luaL_error(L, "Couldn't access key");
 			}
 
-			VariantToStack(L, &varValue);
-			VariantClear(&varValue);
+			ValueToStack(L, value);
 
 			return 1;
 		}
 
-		VARIANT labels;
-		VARIANT values;
-		VariantInit(&labels);
-		VariantInit(&values);
+		LabelValues entries;
+		rawFile->Reader->GetTrailerExtra(spectrumNumber, entries);
 
-		long size = 0;
-		rawFile->comRawFile->GetTrailerExtraForScanNum(spectrumNumber, &labels, &values, &size);
-
-		MapToStack(L, &labels, &values, size);
+		MapToStack(L, entries);
 		return 1;
 	}
 
-	int statusLog(lua_State* L)
+	// A range of scans read by one reader
+	typedef struct _scanShare
 	{
-		RawFile *rawFile = checkRawFile(L);
-		long spectrumNumber = (long)luaL_checkinteger(L, 2);
-
-		if (lua_gettop(L) == 3)
+		long First;
+		long Last;
+	} ScanShare;
+
+	// Split first to last into shares of at least a few hundred scans, one
+	// per worker at most, or a single share when the reader can't share out
+	// its reads
+	static std::vector<ScanShare> SplitScans(RawFile* rawFile, long first, long last, long workers)
+	{
+		const long minShare = 256;
+		long count = (std::max)(last - first + 1, 0L);
+		long nShares = (std::max)((std::min)(workers, count / minShare), 1L);
+		bool parallel = false;
+		if (!rawFile->Reader->SupportsParallelReads(parallel) || !parallel)
+			nShares = 1;
+
+		std::vector<ScanShare> shares(nShares);
+		for (long s = 0; s < nShares; s++)
 		{
-			const char* key = luaL_checkstring(L, 3);
-			VARIANT varValue;
-			VariantInit(&varValue);
-			double dRt = 0;
-			HRESULT hr = rawFile->comRawFile->GetStatusLogValueForScanNum(spectrumNumber, _bstr_t(key), &dRt, &varValue);
-			if (FAILED(hr))
-			{
-				return luaL_error(L, "Couldn't access key");
-			}
+			shares[s].First = first + count * s / nShares;
+			shares[s].Last = first + count * (s + 1) / nShares - 1;
+		}
+		return shares;
+	}
 
-			VariantToStack(L, &varValue);
-			VariantClear(&varValue);
+	// Call read for each share, the first on the reader of the file and the
+	// others on worker threads, each with a reader of its own.  Shares whose
+	// reader couldn't open the file are read on the reader of the file after.
+	static void ReadShares(RawFile* rawFile, size_t nShares, const std::function<void(TimedReader& reader, size_t share)>& read)
+	{
+		std::vector<char> done(nShares, 0);
+		std::string fileName = rawFile->FileName;
+		std::string backend = rawFile->BackendName;
+		std::vector<std::thread> threads;
+		for (size_t s = 1; s < nShares; s++)
+		{
+			threads.push_back(std::thread([&, s]() {
+				int error = 0;
+				TimedReader reader;
+				reader.Reset(CreateBackend(backend.c_str(), error));
+				if (reader.Get() == NULL)
+					return;
+				if (reader->Open(fileName.c_str()) && reader->SetCurrentController(0, 1))
+				{
+					read(reader, s);
+					done[s] = 1;
+				}
+				reader->Close();
+				reader.Reset(NULL);
+			}));
+		}
+		if (nShares > 0)
+		{
+			read(rawFile->Reader, 0);
+			done[0] = 1;
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
 
-			return 1;
+		for (size_t s = 1; s < nShares; s++)
+		{
+			if (!done[s])
+				read(rawFile->Reader, s);
 		}
+	}
 
-		VARIANT labels;
-		VARIANT values;
-		VariantInit(&labels);
-		VariantInit(&values);
+	// One trailer label over a range of scans.  Values that read as numbers
+	// are kept as numbers, others in a dictionary of their distinct texts.
+	struct TrailerColumn
+	{
+		std::string Label;
+		std::vector<double> Numbers;
+		std::vector<unsigned int> Codes;		// 1 based into Texts, only once a text is found
+		std::vector<char> Missing;
+		std::vector<std::string> Texts;
+		std::map<std::string, unsigned int> TextCodes;
+		bool Integral;
+	};
 
-		long size = 0;
-		double rt = 0;
+	// The trailers of a range of scans, read by one reader
+	struct TrailerShare
+	{
+		long First;
+		long Last;
+		std::vector<TrailerColumn> Columns;
+		std::map<std::string, size_t> ColumnIndex;
+	};
 
-		rawFile->comRawFile->GetStatusLogForScanNum(spectrumNumber, &rt, &labels, &values, &size);
+	static void AddTrailerValue(TrailerColumn& column, size_t i, const std::string& text)
+	{
+		size_t begin = text.find_first_not_of(" \t");
+		if (begin == std::string::npos)
+			return;
+		size_t end = text.find_last_not_of(" \t") + 1;
+
+		std::string value = text.substr(begin, end - begin);
+		char* rest = NULL;
+		double number = strtod(value.c_str(), &rest);
+		column.Missing[i] = 0;
+		if (rest != NULL && *rest == '\0')
+		{
+			column.Numbers[i] = number;
+			column.Integral = column.Integral && number == std::floor(number) && std::fabs(number) < 9007199254740992.0;
+			return;
+		}
 
-		MapToStack(L, &labels, &values, size);
-		return 1;
+		if (column.Codes.empty())
+			column.Codes.resize(column.Numbers.size(), 0);
+		std::map<std::string, unsigned int>::iterator it = column.TextCodes.find(value);
+		if (it == column.TextCodes.end())
+		{
+			column.Texts.push_back(value);
+			it = column.TextCodes.insert(std::make_pair(value, (unsigned int)column.Texts.size())).first;
+		}
+		column.Codes[i] = it->second;
 	}
 
-	int scanFilter(lua_State* L)
+	static void ReadTrailerShare(TimedReader& reader, TrailerShare& share)
 	{
-		RawFile *rawFile = checkRawFile(L);
-		long spectrumNumber = (long)luaL_checkinteger(L, 2);
-		BSTR filter = NULL;
-		rawFile->comRawFile->GetFilterForScanNum(spectrumNumber, &filter);
-		lua_pushstring(L, _bstr_t(filter));
-		SysFreeString(filter);
-		return 1;
+		size_t count = (size_t)(share.Last - share.First + 1);
+		LabelValues entries;
+		for (long sn = share.First; sn <= share.Last; sn++)
+		{
+			entries.Labels.clear();
+			entries.Values.clear();
+			reader->GetTrailerExtra(sn, entries);
+			for (size_t e = 0; e < entries.Labels.size() && e < entries.Values.size(); e++)
+			{
+				// The labels come in the same order for every scan
+				size_t c = e;
+				if (c >= share.Columns.size() || share.Columns[c].Label != entries.Labels[e])
+				{
+					std::map<std::string, size_t>::iterator it = share.ColumnIndex.find(entries.Labels[e]);
+					if (it == share.ColumnIndex.end())
+					{
+						it = share.ColumnIndex.insert(std::make_pair(entries.Labels[e], share.Columns.size())).first;
+						share.Columns.push_back(TrailerColumn());
+						TrailerColumn& column = share.Columns.back();
+						column.Label = entries.Labels[e];
+						column.Numbers.resize(count, 0);
+						column.Missing.resize(count, 1);
+						column.Integral = true;
+					}
+					c = it->second;
+				}
+				AddTrailerValue(share.Columns[c], (size_t)(sn - share.First), entries.Values[e]);
+			}
+		}
 	}
 
-	int scanHeader(lua_State* L)
+	/***
+	Get the trailers of many scans as one typed column per label
+
+	Each column has a Type: "integer" or "number" when every value given
+	reads as one, otherwise "string", with Values the 1 based indices into
+	its Dictionary of distinct texts.  Missing is true for scans without a
+	value (Values holds 0 there).  Blank values count as missing.  The scans
+	are shared out to workers, each with a reader of its own.
+
+	@function GetAllTrailers
+	@int[opt] 		first The first spectrum number (default FirstSpectrumNumber)
+	@int[opt] 		last The last spectrum number (default LastSpectrumNumber)
+	@tab[opt] 		options workers (default the number of cores)
+	@treturn 		table ScanNumber, Labels in trailer order and Columns by label
+	*/
+	int getAllTrailers(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		long spectrumNumber = (long)luaL_checkinteger(L, 2);
 
-		long nPackets = 0;
-		double dStartTime = 0;
-		double dLowMass = 0;
-		double dHighMass = 0;
-		double dTic = 0;
-		double dBPMass = 0;
-		double dBPIntensity = 0;
-		long nChannels = 0;
-		long nUniformTime = 0;
-		double dFrequency = 0;
+		lua_getuservalue(L, 1);
+		long first = 0;
+		long last = -1;
+		luaD_getLong(L, "FirstSpectrumNumber", first);
+		luaD_getLong(L, "LastSpectrumNumber", last);
+		lua_pop(L, 1);
 
-		rawFile->comRawFile->GetScanHeaderInfoForScanNum(spectrumNumber, &nPackets, &dStartTime, &dLowMass, &dHighMass,
-			&dTic, &dBPMass, &dBPIntensity, &nChannels, &nUniformTime, &dFrequency);
+		first = (long)luaL_optinteger(L, 2, first);
+		last = (long)luaL_optinteger(L, 3, last);
 
-		lua_createtable(L, 0, 10);
-		luaD_setNumber(L, nPackets, "NumPackets");
-		luaD_setNumber(L, dStartTime, "StartTime");
-		luaD_setNumber(L, dLowMass, "LowMass");
-		luaD_setNumber(L, dHighMass, "HighMass");
-		luaD_setNumber(L, dTic, "TIC");
-		luaD_setNumber(L, dBPMass, "BasePeakMass");
-		luaD_setNumber(L, dBPIntensity, "BasePeakIntensity");
-		luaD_setNumber(L, nChannels, "NumChannels");
-		luaD_setNumber(L, nUniformTime, "UniformTime");
-		luaD_setNumber(L, dFrequency, "Frequency");
+		long workers = (long)std::thread::hardware_concurrency();
+		if (lua_gettop(L) > 3) {
+			luaL_checktype(L, 4, LUA_TTABLE);
+			lua_pushvalue(L, 4);
+			luaD_getLong(L, "workers", workers);
+			lua_pop(L, 1);
+		}
 
-		return 1;
-	}
+		long count = (std::max)(last - first + 1, 0L);
+		std::vector<ScanShare> ranges = SplitScans(rawFile, first, last, workers);
+		long nShares = (long)ranges.size();
+		std::vector<TrailerShare> shares(nShares);
+		for (long s = 0; s < nShares; s++)
+		{
+			shares[s].First = ranges[s].First;
+			shares[s].Last = ranges[s].Last;
+		}
+		ReadShares(rawFile, shares.size(), [&](TimedReader& reader, size_t s) { ReadTrailerShare(reader, shares[s]); });
 
-	int getNumInstMethods(lua_State* L)
-	{
-		RawFile *rawFile = checkRawFile(L);
-		try {	
-			long number(0);			
-			HRESULT hr = rawFile->comRawFile->GetNumInstMethods(&number);
-			if (SUCCEEDED(hr)) {
-				lua_pushnumber(L, number);
-				return 1;
+		// The labels in the order first found
+		std::vector<std::string> labels;
+		std::map<std::string, bool> seen;
+		for (long s = 0; s < nShares; s++)
+		{
+			for (size_t c = 0; c < shares[s].Columns.size(); c++)
+			{
+				if (seen.insert(std::make_pair(shares[s].Columns[c].Label, true)).second)
+					labels.push_back(shares[s].Columns[c].Label);
 			}
 		}
-		catch (...) {}
-		lua_pushnil(L);
-		return 1;
-	}
 
-	int getInstrumentMethod(lua_State* L)
-	{
-		RawFile *rawFile = checkRawFile(L);
-		try {
-			int index = (int)luaL_checkinteger(L, -1) - 1;
+		lua_createtable(L, 0, 3);
 
-			BSTR str = NULL;
-			HRESULT hr = rawFile->comRawFile->GetInstMethod(index, &str);
-			if (SUCCEEDED(hr) && str != NULL) {
-				CStringA returnString = CStringA(str);
-				SysFreeString(str);
-				lua_pushstring(L, returnString);				
-				return 1;
-			}
+		lua_createtable(L, (int)count, 0);
+		for (long i = 0; i < count; i++)
+		{
+			lua_pushinteger(L, first + i);
+			lua_rawseti(L, -2, (int)i + 1);
 		}
-		catch (...) {}
-		lua_pushnil(L);
-		return 1;
-	}
+		lua_setfield(L, -2, "ScanNumber");
 
-	int getInstrumentMethodNames(lua_State* L)
-	{
-		RawFile *rawFile = checkRawFile(L);	
-				
-		try {		
-			long number(0);
-			VARIANT names;
-			VariantInit(&names);
-			HRESULT hr = rawFile->comRawFile->GetInstMethodNames(&number, &names);
-			if (SUCCEEDED(hr)) 
+		lua_createtable(L, (int)labels.size(), 0);
+		for (size_t l = 0; l < labels.size(); l++)
+		{
+			lua_pushlstring(L, labels[l].data(), labels[l].size());
+			lua_rawseti(L, -2, (int)l + 1);
+		}
+		lua_setfield(L, -2, "Labels");
+
+		lua_createtable(L, 0, (int)labels.size());
+		std::vector<const TrailerColumn*> parts(nShares);
+		for (size_t l = 0; l < labels.size(); l++)
+		{
+			bool anyText = false;
+			bool integral = true;
+			for (long s = 0; s < nShares; s++)
+			{
+				std::map<std::string, size_t>::const_iterator it = shares[s].ColumnIndex.find(labels[l]);
+				parts[s] = it == shares[s].ColumnIndex.end() ? NULL : &shares[s].Columns[it->second];
+				if (parts[s] == NULL)
+					continue;
+				anyText = anyText || !parts[s]->Texts.empty();
+				integral = integral && parts[s]->Integral;
+			}
+
+			lua_createtable(L, 0, 4);
+			lua_pushstring(L, anyText ? "string" : integral ? "integer" : "number");
+			lua_setfield(L, -2, "Type");
+
+			// Values, with the dictionary of a string column merged from the shares
+			std::vector<std::string> dictionary;
+			std::map<std::string, unsigned int> codes;
+			lua_createtable(L, (int)count, 0);
+			int row = 0;
+			for (long s = 0; s < nShares; s++)
+			{
+				const TrailerColumn* part = parts[s];
+				size_t size = (size_t)(shares[s].Last - shares[s].First + 1);
+				for (size_t i = 0; i < size; i++)
+				{
+					row++;
+					if (part == NULL || part->Missing[i])
+						lua_pushinteger(L, 0);
+					else if (!anyText && integral)
+						lua_pushinteger(L, (lua_Integer)part->Numbers[i]);
+					else if (!anyText)
+						lua_pushnumber(L, part->Numbers[i]);
+					else
+					{
+						// Numbers among texts are kept as text too
+						std::string text;
+						if (part->Codes.empty() || part->Codes[i] == 0)
+						{
+							char number[32];
+							sprintf(number, "%.15g", part->Numbers[i]);
+							text = number;
+						}
+						else
+							text = part->Texts[part->Codes[i] - 1];
+
+						std::map<std::string, unsigned int>::iterator it = codes.find(text);
+						if (it == codes.end())
+						{
+							dictionary.push_back(text);
+							it = codes.insert(std::make_pair(text, (unsigned int)dictionary.size())).first;
+						}
+						lua_pushinteger(L, it->second);
+					}
+					lua_rawseti(L, -2, row);
+				}
+			}
+			lua_setfield(L, -2, "Values");
+
+			lua_createtable(L, (int)count, 0);
+			row = 0;
+			for (long s = 0; s < nShares; s++)
 			{
-				ListToTable(L, &names, number);
-				VariantClear(&names);
-				lua_pushnumber(L, number);
-				return 2;
+				size_t size = (size_t)(shares[s].Last - shares[s].First + 1);
+				for (size_t i = 0; i < size; i++)
+				{
+					lua_pushboolean(L, parts[s] == NULL || parts[s]->Missing[i]);
+					lua_rawseti(L, -2, ++row);
+				}
 			}
-			VariantClear(&names);
+			lua_setfield(L, -2, "Missing");
+
+			if (anyText)
+			{
+				lua_createtable(L, (int)dictionary.size(), 0);
+				for (size_t d = 0; d < dictionary.size(); d++)
+				{
+					lua_pushlstring(L, dictionary[d].data(), dictionary[d].size());
+					lua_rawseti(L, -2, (int)d + 1);
+				}
+				lua_setfield(L, -2, "Dictionary");
+			}
+
+			lua_setfield(L, -2, labels[l].c_str());
 		}
-		catch (...) {}	
-		lua_pushnil(L);
+		lua_setfield(L, -2, "Columns");
+
 		return 1;
 	}
-	
-	int getIsolationWidthForScanNum(lua_State* L)
+
+	int statusLog(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		long sn = (long)luaL_checkinteger(L, 2);
-		long msOrder = 2;
+		long spectrumNumber = (long)luaL_checkinteger(L, 2);
 
-		if (lua_gettop(L) == 3) 
+		if (lua_gettop(L) == 3)
 		{
-			msOrder = (long)luaL_checkinteger(L, 3);
-		}
-
-		double width = 0;
-		rawFile->comRawFile->GetIsolationWidthForScanNum(sn, msOrder, &width);
-
+			const char* key = luaL_checkstring(L, 3);
+			ReaderValue value;
+			double dRt = 0;
+			if (!rawFile->Reader->GetStatusLogValue(spectrumNumber, key, dRt, value))
+			{
+				return luaL_error(L, "Couldn't access key");
+			}
+
+			ValueToStack(L, value);
+
+			return 1;
+		}
+
+		LabelValues entries;
+		double rt = 0;
+
+		rawFile->Reader->GetStatusLog(spectrumNumber, rt, entries);
+
+		MapToStack(L, entries);
+		return 1;
+	}
+
+	/***
+	Get status log values over the whole run
+
+	The status log records are read by position, each once, however many
+	scans share them.
+
+	@function GetStatusLogSeries
+	@param[opt] 	keys A label or a table of labels (default every plottable value)
+	@treturn 		table RetentionTime and a column of the typed values of each label
+	*/
+	int getStatusLogSeries(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		// The labels of the values in a record
+		long first = 0;
+		rawFile->Reader->GetFirstSpectrumNumber(first);
+		LabelValues entries;
+		double rt = 0;
+		rawFile->Reader->GetStatusLog(first, rt, entries);
+
+		std::vector<std::string> keys;
+		std::vector<long> indices;
+		if (lua_isnoneornil(L, 2))
+			rawFile->Reader->GetStatusLogPlottableIndex(keys, indices);
+		else
+		{
+			if (lua_istable(L, 2))
+			{
+				int count = (int)lua_rawlen(L, 2);
+				for (int i = 1; i <= count; i++)
+				{
+					lua_rawgeti(L, 2, i);
+					keys.push_back(luaL_checkstring(L, -1));
+					lua_pop(L, 1);
+				}
+			}
+			else
+				keys.push_back(luaL_checkstring(L, 2));
+
+			for (size_t k = 0; k < keys.size(); k++)
+			{
+				std::vector<std::string>::iterator it = std::find(entries.Labels.begin(), entries.Labels.end(), keys[k]);
+				if (it == entries.Labels.end())
+					return luaL_error(L, "Couldn't access key %s", keys[k].c_str());
+				indices.push_back((long)(it - entries.Labels.begin()));
+			}
+		}
+
+		long records = 0;
+		rawFile->Reader->GetNumStatusLog(records);
+
+		std::vector<double> times;
+		std::vector<std::vector<ReaderValue> > columns(keys.size());
+		std::vector<ReaderValue> values;
+		for (long pos = 0; pos < records; pos++)
+		{
+			if (!rawFile->Reader->GetStatusLogForPos(pos, rt, values))
+				continue;
+			times.push_back(rt);
+			for (size_t k = 0; k < keys.size(); k++)
+			{
+				columns[k].push_back(ReaderValue());
+				if ((size_t)indices[k] < values.size())
+					columns[k].back() = values[indices[k]];
+				else
+					columns[k].back().Type = ValueNil;
+			}
+		}
+
+		int size = (int)times.size();
+		lua_createtable(L, 0, (int)keys.size() + 1);
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushnumber(L, times[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "RetentionTime");
+
+		for (size_t k = 0; k < keys.size(); k++)
+		{
+			lua_createtable(L, size, 0);
+			for (int i = 0; i < size; i++)
+			{
+				ValueToStack(L, columns[k][i]);
+				lua_rawseti(L, -2, i + 1);
+			}
+			lua_setfield(L, -2, keys[k].c_str());
+		}
+
+		return 1;
+	}
+
+	int scanFilter(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long spectrumNumber = (long)luaL_checkinteger(L, 2);
+		std::string filter;
+		rawFile->Reader->GetFilter(spectrumNumber, filter);
+		lua_pushlstring(L, filter.data(), filter.size());
+		return 1;
+	}
+
+	// Push the table given as the into option of the options table at index,
+	// to be filled in place of a new result, else a new table of those sizes.
+	// True when the into table is reused.
+	static bool PushResultTable(lua_State* L, int options, int narr, int nrec)
+	{
+		if (options != 0 && lua_istable(L, options))
+		{
+			lua_getfield(L, options, "into");
+			if (lua_istable(L, -1))
+				return true;
+			if (!lua_isnil(L, -1))
+				luaL_argerror(L, options, "into must be a table");
+			lua_pop(L, 1);
+		}
+		lua_createtable(L, narr, nrec);
+		return false;
+	}
+
+	// Push row i of the array on top, reusing the table already there.  True when reused.
+	static bool PushRow(lua_State* L, int i, int nrec)
+	{
+		lua_rawgeti(L, -1, i);
+		if (lua_istable(L, -1))
+			return true;
+		lua_pop(L, 1);
+		lua_createtable(L, 0, nrec);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, i);
+		return false;
+	}
+
+	// Clear what an earlier fill left after the first count entries of the array on top
+	static void TruncateArray(lua_State* L, int count)
+	{
+		for (int i = (int)lua_rawlen(L, -1); i > count; i--)
+		{
+			lua_pushnil(L);
+			lua_rawseti(L, -2, i);
+		}
+	}
+
+	/***
+	Get the scan header of a spectrum
+
+	@function GetScanHeader
+	@int 			sn The spectrum number
+	@tab[opt] 		options into, a table to fill and return instead of a new one
+	@treturn 		table The scan header
+	*/
+	int scanHeader(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long spectrumNumber = (long)luaL_checkinteger(L, 2);
+		if (lua_gettop(L) > 2)
+			luaL_checktype(L, 3, LUA_TTABLE);
+
+		ScanHeader header = ScanHeader();
+		rawFile->Reader->GetScanHeader(spectrumNumber, header);
+
+		PushResultTable(L, lua_gettop(L) > 2 ? 3 : 0, 0, 10);
+		luaD_setNumber(L, header.NumPackets, "NumPackets");
+		luaD_setNumber(L, header.StartTime, "StartTime");
+		luaD_setNumber(L, header.LowMass, "LowMass");
+		luaD_setNumber(L, header.HighMass, "HighMass");
+		luaD_setNumber(L, header.TIC, "TIC");
+		luaD_setNumber(L, header.BasePeakMass, "BasePeakMass");
+		luaD_setNumber(L, header.BasePeakIntensity, "BasePeakIntensity");
+		luaD_setNumber(L, header.NumChannels, "NumChannels");
+		luaD_setNumber(L, header.UniformTime, "UniformTime");
+		luaD_setNumber(L, header.Frequency, "Frequency");
+
+		return 1;
+	}
+
+	int getNumInstMethods(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long number(0);
+		if (rawFile->Reader->GetNumInstMethods(number)) {
+			lua_pushnumber(L, number);
+			return 1;
+		}
+		lua_pushnil(L);
+		return 1;
+	}
+
+	int getInstrumentMethod(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		int index = (int)luaL_checkinteger(L, -1) - 1;
+
+		std::string method;
+		if (rawFile->Reader->GetInstMethod(index, method)) {
+			lua_pushlstring(L, method.data(), method.size());
+			return 1;
+		}
+		lua_pushnil(L);
+		return 1;
+	}
+
+	int getInstrumentMethodNames(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);	
+				
+		std::vector<std::string> names;
+		if (rawFile->Reader->GetInstMethodNames(names))
+		{
+			ListToTable(L, names);
+			lua_pushnumber(L, (lua_Number)names.size());
+			return 2;
+		}
+		lua_pushnil(L);
+		return 1;
+	}
+	
+	// The first instrument method parsed into a tree, cached for the open file
+	static MethodTree* GetMethod(RawFile* rawFile)
+	{
+		if (rawFile->Method != NULL)
+			return rawFile->Method;
+
+		std::string text;
+		if (!rawFile->Reader->GetInstMethod(0, text))
+			text.clear();
+
+		rawFile->Method = new MethodTree(text);
+		return rawFile->Method;
+	}
+
+	static void PushMethodNode(lua_State* L, const MethodTree* method, const MethodNode& node)
+	{
+		lua_createtable(L, 0, 4);
+		luaD_setString(L, node.Name.c_str(), "Name");
+
+		// Parameters maps each key to its first value, Keys holds them in document order
+		lua_createtable(L, 0, 0);
+		lua_createtable(L, 0, 0);
+		int c = 1;
+		for (size_t i = node.FirstParameter; i < node.EndParameter; i++)
+		{
+			const MethodParameter& parameter = method->Parameters[i];
+			if (&method->Nodes[parameter.Node] != &node)
+				continue;
+
+			lua_getfield(L, -2, parameter.Key.c_str());
+			bool seen = !lua_isnil(L, -1);
+			lua_pop(L, 1);
+			if (seen)
+				continue;
+
+			lua_pushstring(L, parameter.Key.c_str());
+			lua_rawseti(L, -2, c++);
+			lua_pushstring(L, parameter.Value.c_str());
+			lua_setfield(L, -3, parameter.Key.c_str());
+		}
+		lua_setfield(L, -3, "Keys");
+		lua_setfield(L, -2, "Parameters");
+
+		lua_createtable(L, (int)node.Children.size(), 0);
+		for (size_t i = 0; i < node.Children.size(); i++)
+		{
+			PushMethodNode(L, method, method->Nodes[node.Children[i]]);
+			lua_rawseti(L, -2, (int)i + 1);
+		}
+		lua_setfield(L, -2, "Children");
+	}
+
+	/***
+	Get the first instrument method as a tree of sections
+
+	Each node has a Name, the Parameters (key to value) with their Keys in
+	order, and the Children sections.  The root node has no name.
+
+	@function GetMethodTree
+	@treturn 		table The root node
+	*/
+	int getMethodTree(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		MethodTree* method = GetMethod(rawFile);
+		PushMethodNode(L, method, method->Nodes[0]);
+		return 1;
+	}
+
+	/***
+	Find a parameter of the first instrument method below a path of sections
+
+	As when searching the method text, each section of the path is the first
+	of that name after the one before, and the parameter the first after the
+	last, whether in that section or a later one.  The value is trimmed and
+	without the separator, "35" for "Maximum Injection Time (ms) = 35".
+
+	@function FindMethodParameter
+	@tab 			path The sections, for example {"Experiment 1", "Scan Event 1"}
+	@string 		label The parameter label, a trailing '=' or ':' is ignored
+	@bool[opt] 		partial Accept the first key containing the label
+	@treturn 		string The value, or nil if it wasn't found
+	@treturn 		string The matching key
+	*/
+	int findMethodParameter(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		luaL_checktype(L, 2, LUA_TTABLE);
+		const char* label = luaL_checkstring(L, 3);
+		bool partial = lua_toboolean(L, 4) != 0;
+
+		std::vector<std::string> path;
+		int size = (int)lua_rawlen(L, 2);
+		for (int i = 1; i <= size; i++)
+		{
+			lua_rawgeti(L, 2, i);
+			path.push_back(luaL_checkstring(L, -1));
+			lua_pop(L, 1);
+		}
+
+		MethodTree* method = GetMethod(rawFile);
+		const MethodNode* node = method->Find(path);
+		const MethodParameter* parameter = node != NULL ? method->Lookup(node, label, partial) : NULL;
+		if (parameter == NULL)
+		{
+			lua_pushnil(L);
+			return 1;
+		}
+
+		lua_pushstring(L, parameter->Value.c_str());
+		lua_pushstring(L, parameter->Key.c_str());
+		return 2;
+	}
+
+	/***
+	Get every value of a parameter in the first instrument method, in order
+
+	@function GetMethodValues
+	@string 		label The parameter label, a trailing '=' or ':' is ignored
+	@treturn 		table The values
+	*/
+	int getMethodValues(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		std::string key = MethodTree::NormalizeKey(luaL_checkstring(L, 2));
+
+		MethodTree* method = GetMethod(rawFile);
+		std::unordered_map<std::string, std::vector<size_t> >::const_iterator it = method->ParameterIndex.find(key);
+		int count = it != method->ParameterIndex.end() ? (int)it->second.size() : 0;
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; i++)
+		{
+			lua_pushstring(L, method->Parameters[it->second[i]].Value.c_str());
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	int getIsolationWidthForScanNum(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long sn = (long)luaL_checkinteger(L, 2);
+		long msOrder = 2;
+
+		if (lua_gettop(L) == 3) 
+		{
+			msOrder = (long)luaL_checkinteger(L, 3);
+		}
+
+		double width = 0;
+		rawFile->Reader->GetIsolationWidth(sn, msOrder, width);
+
 		lua_pushnumber(L, width);
 		lua_pushinteger(L, msOrder);
 		return 2;
@@ -498,7 +1373,7 @@ namespace RawFile {
 		RawFile *rawFile = checkRawFile(L);
 		long spectrumNumber = (long)luaL_checkinteger(L, 2);
 		double dRT = 0;
-		rawFile->comRawFile->RTFromScanNum(spectrumNumber, &dRT);
+		rawFile->Reader->RTFromScanNum(spectrumNumber, dRT);
 		lua_pushnumber(L, dRT);
 		return 1;
 	}
@@ -507,9 +1382,9 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);
 		double dRT = luaL_checknumber(L, 2);
-		long spectrumNumber;
-		rawFile->comRawFile->ScanNumFromRT(dRT, &spectrumNumber);
-		rawFile->comRawFile->RTFromScanNum(spectrumNumber, &dRT);
+		long spectrumNumber = 0;
+		rawFile->Reader->ScanNumFromRT(dRT, spectrumNumber);
+		rawFile->Reader->RTFromScanNum(spectrumNumber, dRT);
 		lua_pushinteger(L, spectrumNumber);
 		lua_pushnumber(L, dRT);
 		return 2;
@@ -520,7 +1395,7 @@ namespace RawFile {
 		RawFile *rawFile = checkRawFile(L);
 		long spectrumNumber = (long)luaL_checkinteger(L, 2);
 		long msnOrder = -1;
-		rawFile->comRawFile->GetMSOrderForScanNum(spectrumNumber, &msnOrder);
+		rawFile->Reader->GetMSOrder(spectrumNumber, msnOrder);
 		lua_pushinteger(L, msnOrder);
 		return 1;
 	}
@@ -529,12 +1404,21 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);
 		long spectrumNumber = (long)luaL_checkinteger(L, 2);
-		long centroid = 0;
-		rawFile->comRawFile->IsCentroidScanForScanNum(spectrumNumber, &centroid);
+		bool centroid = false;
+		rawFile->Reader->IsCentroidScan(spectrumNumber, centroid);
 		lua_pushboolean(L, centroid);
 		return 1;
 	}
 
+	/***
+	Get a chromatogram, see the MS File Reader GetChroData documentation
+
+	@function GetChroData
+	@tab 			parameters Type, StartTime, EndTime, Delay, Operator, Type2, Filter,
+					MassRange1, MassRange2, SmoothingType, SmoothingValue, and into, a
+					table to fill and return instead of a new one
+	@treturn 		table The {Time, Intensity} points with StartTime and EndTime
+	*/
 	int getChroData(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
@@ -579,19 +1463,19 @@ namespace RawFile {
 		lua_pop(L, 1);
 
 		lua_getfield(L, -1, "Filter");
-		_bstr_t filter = "";
+		std::string filter;
 		if (lua_isstring(L, -1))
 			filter = lua_tostring(L, -1);
 		lua_pop(L, 1);
 
 		lua_getfield(L, -1, "MassRange1");
-		_bstr_t massRange1 = "";
+		std::string massRange1;
 		if (lua_isstring(L, -1))
 			massRange1 = lua_tostring(L, -1);
 		lua_pop(L, 1);
 
 		lua_getfield(L, -1, "MassRange2");
-		_bstr_t massRange2 = "";
+		std::string massRange2;
 		if (lua_isstring(L, -1))
 			massRange2 = lua_tostring(L, -1);
 		lua_pop(L, 1);
@@ -608,223 +1492,2591 @@ namespace RawFile {
 			smoothingValue = (long)lua_tonumber(L, -1);
 		lua_pop(L, 1);
 
-		long size = 0;
-		VARIANT chroData;
-		VARIANT flags;
-		VariantInit(&chroData);
-		VariantInit(&flags);
-
-		HRESULT hr = rawFile->comRawFile->GetChroData(chroType, chroOperator, chroType2, filter, massRange1, massRange2, delay, &startTime, &endTime, smoothingType, smoothingValue, &chroData, &flags, &size);
-
-		lua_createtable(L, size, 2);
+		ChroSettings settings;
+		settings.Type = chroType;
+		settings.Operator = chroOperator;
+		settings.Type2 = chroType2;
+		settings.Filter = filter;
+		settings.MassRange1 = massRange1;
+		settings.MassRange2 = massRange2;
+		settings.Delay = delay;
+		settings.SmoothingType = smoothingType;
+		settings.SmoothingValue = smoothingValue;
+
+		std::vector<ChroPeak> points;
+		rawFile->Reader->GetChroData(settings, startTime, endTime, points);
+		int size = (int)points.size();
+
+		PushResultTable(L, 2, size, 2);
 		luaD_setNumber(L, startTime, "StartTime");
 		luaD_setNumber(L, endTime, "EndTime");
 
-		ChroPeak* pValues = NULL;
-		SAFEARRAY FAR* valueSA = chroData.parray;
-		SafeArrayAccessData(valueSA, (void**)(&pValues));
+		for (int i = 0; i < size; i++)
+		{
+			PushRow(L, i + 1, 2);
+			luaD_setNumber(L, points[i].dTime, "Time");
+			luaD_setNumber(L, points[i].dIntensity, "Intensity");
+			lua_pop(L, 1);
+		}
+		TruncateArray(L, size);
+
+		return 1;
+	}
+
+	// Copy the mass list of a spectrum into peaks, from the LoadAll store if it's there
+	static long ReadMassList(RawFile* rawFile, TimedReader& reader, long spectrumNumber, std::vector<DataPeak>& peaks, long centroid = 0)
+	{
+		if (centroid == 0 && rawFile->Store != NULL && rawFile->Store->Get(spectrumNumber, peaks))
+			return (long)peaks.size();
+		if (!reader->GetMassList(spectrumNumber, centroid != 0, peaks))
+			peaks.clear();
+		return (long)peaks.size();
+	}
+
+	static long ReadMassList(RawFile* rawFile, long spectrumNumber, std::vector<DataPeak>& peaks, long centroid = 0)
+	{
+		return ReadMassList(rawFile, rawFile->Reader, spectrumNumber, peaks, centroid);
+	}
+
+	static const char* const MassCodings[] = { "delta-mz", "float64", NULL };
+	static const char* const IntensityCodings[] = { "float16", "float32", "float64", NULL };
+
+	/***
+	Keep the mass lists of a run in memory, compressed
+
+	The selected scans are read once and later GetSpectrum calls, and
+	everything built on them, are served from memory.  The codec names the
+	mass and the intensity coding: masses as delta-mz, lossless zigzag varint
+	differences, or float64; intensities as float16 (relative to the largest
+	of the spectrum, about 3 significant digits), float32 or float64.  Loading
+	stops at maxBytes, the later scans are then read from the file as before.
+	Calling it again replaces the store, Close or LoadAll(false) drops it.
+
+	@function LoadAll
+	@tab[opt] 		options msOrder (default any), first, last spectrum numbers,
+					codec (default "delta-mz+float32"), maxBytes (default no limit)
+	@treturn 		table Scans, Bytes, RawBytes (as doubles) and Complete, false when
+					maxBytes stopped the loading
+	*/
+	int loadAll(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		long first = 0;
+		long last = -1;
+		rawFile->Reader->GetFirstSpectrumNumber(first);
+		rawFile->Reader->GetLastSpectrumNumber(last);
+
+		delete rawFile->Store;
+		rawFile->Store = NULL;
+		if (lua_isboolean(L, 2) && !lua_toboolean(L, 2))
+			return 0;
+
+		long msOrder = 0;
+		std::string codec = "delta-mz+float32";
+		double maxBytes = -1;
+		if (!lua_isnoneornil(L, 2))
+		{
+			luaL_checktype(L, 2, LUA_TTABLE);
+			lua_pushvalue(L, 2);
+			luaD_getLong(L, "msOrder", msOrder);
+			luaD_getLong(L, "first", first);
+			luaD_getLong(L, "last", last);
+			luaD_getString(L, "codec", codec);
+			luaD_getNumber(L, "maxBytes", maxBytes);
+			lua_pop(L, 1);
+		}
+
+		size_t plus = codec.find('+');
+		lua_pushstring(L, codec.substr(0, plus).c_str());
+		lua_pushstring(L, plus == std::string::npos ? IntensityCodings[1] : codec.substr(plus + 1).c_str());
+		MassCoding masses = (MassCoding)luaL_checkoption(L, -2, NULL, MassCodings);
+		IntensityCoding intensities = (IntensityCoding)luaL_checkoption(L, -1, NULL, IntensityCodings);
+		lua_pop(L, 2);
+
+		SpectrumStore* store = new SpectrumStore(masses, intensities);
+		size_t limit = maxBytes >= 0 && maxBytes < (double)(size_t)-1 ? (size_t)maxBytes : (size_t)-1;
+
+		bool complete = true;
+		std::vector<DataPeak> peaks;
+		for (long sn = first; sn <= last && complete; sn++)
+		{
+			long order = 0;
+			if (msOrder != 0 && (!rawFile->Reader->GetMSOrder(sn, order) || order != msOrder))
+				continue;
+			if (!rawFile->Reader->GetMassList(sn, false, peaks))
+				continue;
+			complete = store->Add(sn, peaks, limit);
+		}
+		store->Compact();
+		rawFile->Store = store;
+
+		lua_createtable(L, 0, 4);
+		luaD_setNumber(L, (double)store->Scans(), "Scans");
+		luaD_setNumber(L, (double)store->Bytes(), "Bytes");
+		luaD_setNumber(L, (double)store->RawBytes(), "RawBytes");
+		luaD_setBoolean(L, complete, "Complete");
+		return 1;
+	}
+
+	// Push a mass/intensity spectrum as two columns
+	static void PushSpectrumColumns(lua_State* L, const DataPeak* peaks, int size)
+	{
+		lua_createtable(L, 0, 2);
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushnumber(L, peaks[i].Mass);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "Mass");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushnumber(L, peaks[i].Intensity);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "Intensity");
+	}
+
+	// Push the values as an array and set it as key of the table below
+	static void SetColumn(lua_State* L, const std::vector<double>& values, const char* key)
+	{
+		int size = (int)values.size();
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushnumber(L, values[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, key);
+	}
+
+	static void SetColumn(lua_State* L, const std::vector<long>& values, const char* key)
+	{
+		int size = (int)values.size();
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushinteger(L, values[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, key);
+	}
+
+	/***
+	Get the mass list of a spectrum
+
+	@function GetSpectrum
+	@int 			sn The spectrum number
+	@tab[opt] 		options fm, lm mass range, and into, a table to fill and return instead of a new one
+	@treturn 		table The {Mass, Intensity} peaks
+	*/
+	int getSpectrumData(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long spectrumNumber = (long)luaL_checkinteger(L, 2);
+		int options = lua_gettop(L) > 2 ? 3 : 0;
+
+		double fm = 0;
+		double lm = 1000000000;
+
+		if (lua_gettop(L) > 2) {
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_getfield(L, 3, "fm");
+			if (lua_isnumber(L, -1))
+			{
+				fm = lua_tonumber(L, -1);
+			}
+			lua_getfield(L, 3, "lm");
+			if (lua_isnumber(L, -1))
+			{
+				lm = lua_tonumber(L, -1);
+			}
+			lua_pop(L, 2);
+		}
+
+		std::vector<DataPeak> peaks;
+		long size = ReadMassList(rawFile, spectrumNumber, peaks);
+		const DataPeak* pDataPeaks = peaks.data();
+	
+		PushResultTable(L, options, size, 0);
+		int c = 0;
+		for (int i = 0; i < size; i++)
+		{
+			double mass = pDataPeaks[i].Mass;
+			if (mass < fm || mass > lm)
+				continue;
+
+			PushRow(L, ++c, 2);
+			luaD_setNumber(L, mass, "Mass");
+			luaD_setNumber(L, pDataPeaks[i].Intensity, "Intensity");
+			lua_pop(L, 1);
+		}
+		TruncateArray(L, c);
+
+		return 1;
+	}
+
+	static unsigned char PackLabelFlags(const LabelFlags& flags)
+	{
+		unsigned char mask = 0;
+		if (flags.Saturated) mask |= LABEL_FLAG_SATURATED;
+		if (flags.Fragmented) mask |= LABEL_FLAG_FRAGMENTED;
+		if (flags.Merged) mask |= LABEL_FLAG_MERGED;
+		if (flags.Exception) mask |= LABEL_FLAG_EXCEPTION;
+		if (flags.Modified) mask |= LABEL_FLAG_MODIFIED;
+		return mask;
+	}
+
+	static double LabelFieldValue(const LabelData& label, int field)
+	{
+		switch (field)
+		{
+		case LabelMass: return label.Mass;
+		case LabelIntensity: return label.Intensity;
+		case LabelResolution: return label.Resolution;
+		case LabelBaseline: return label.Baseline;
+		case LabelNoise: return label.Noise;
+		default: return label.Charge;
+		}
+	}
+
+	// Push the array at key of the table on top, reusing the one already there
+	static void PushColumn(lua_State* L, const char* key, int size)
+	{
+		lua_getfield(L, -1, key);
+		if (lua_istable(L, -1))
+			return;
+		lua_pop(L, 1);
+		lua_createtable(L, size, 0);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -3, key);
+	}
+
+	static void SetLabelFlag(lua_State* L, bool set, bool clear, const char* key)
+	{
+		if (!set && !clear)
+			return;
+		if (set)
+			lua_pushboolean(L, true);
+		else
+			lua_pushnil(L);
+		lua_setfield(L, -2, key);
+	}
+
+	/***
+	Get the label (centroid) data of a spectrum
+
+	By default each peak is returned as its own table.  When the options table
+	has `columnar = true` or a `fields` list, one array per requested field
+	is returned instead, as with GetHeaderSeries: Mass, Intensity,
+	Resolution, Baseline, Noise and Charge as numbers, and Flags as integers
+	from 0 to 255, each the packed LABEL_FLAG bitmask of its peak.
+
+	With `into` set to the result of an earlier call, that table and its peak
+	tables or columns are overwritten and returned, so a loop over the scans
+	stops allocating once they are large enough.
+
+	@function GetLabelData
+	@int 			sn The spectrum number
+	@tab[opt] 		options fm, lm mass range, columnar, fields, into
+	@treturn 		table The label peaks or the label columns
+	*/
+	int getLabelData(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long spectrumNumber = (long)luaL_checkinteger(L, 2);
+		int options = lua_gettop(L) > 2 ? 3 : 0;
+
+		double fm = 0;
+		double lm = 1000000000;
+		bool columnar = false;
+		bool selected[LabelFieldCount] = { false };
+
+		if (lua_gettop(L) > 2) {
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_getfield(L, 3, "fm");
+			if (lua_isnumber(L, -1))
+			{
+				fm = lua_tonumber(L, -1);
+			}
+			lua_getfield(L, 3, "lm");
+			if (lua_isnumber(L, -1))
+			{
+				lm = lua_tonumber(L, -1);
+			}
+			lua_pop(L, 2);
+
+			lua_getfield(L, 3, "columnar");
+			if (lua_toboolean(L, -1))
+			{
+				columnar = true;
+				for (int f = 0; f < LabelFieldCount; f++)
+					selected[f] = true;
+			}
+			lua_pop(L, 1);
+
+			lua_getfield(L, 3, "fields");
+			if (lua_istable(L, -1))
+			{
+				columnar = true;
+				int nFields = (int)lua_rawlen(L, -1);
+				for (int i = 1; i <= nFields; i++)
+				{
+					lua_rawgeti(L, -1, i);
+					const char* name = luaL_checkstring(L, -1);
+					int f = 0;
+					while (f < LabelFieldCount && strcmp(name, LabelFieldNames[f]) != 0) f++;
+					if (f == LabelFieldCount)
+						return luaL_error(L, "Unknown label field: %s", name);
+					selected[f] = true;
+					lua_pop(L, 1);
+				}
+			}
+			lua_pop(L, 1);
+		}
+
+		std::vector<LabelData> labels;
+		std::vector<LabelFlags> flags;
+		if (!rawFile->Reader->GetLabelData(spectrumNumber, labels, flags))
+		{
+			labels.clear();
+			flags.clear();
+		}
+		flags.resize(labels.size(), LabelFlags());
+
+		LabelData* pValues = labels.data();
+		LabelFlags* pFlags = flags.data();
+
+		int size = (int)labels.size();
+
+		if (columnar)
+		{
+			// Label peaks are sorted by mass, so the requested range is contiguous
+			int first = 0;
+			while (first < size && pValues[first].Mass < fm) first++;
+			int last = first;
+			while (last < size && pValues[last].Mass <= lm) last++;
+			int count = last - first;
+
+			bool reused = PushResultTable(L, options, 0, LabelFieldCount);
+			for (int f = 0; f < LabelFieldCount; f++)
+			{
+				if (!selected[f])
+				{
+					if (reused)
+					{
+						lua_pushnil(L);
+						lua_setfield(L, -2, LabelFieldNames[f]);
+					}
+					continue;
+				}
+
+				PushColumn(L, LabelFieldNames[f], count);
+				for (int i = 0; i < count; i++)
+				{
+					if (f == LabelFlagMask)
+						lua_pushinteger(L, PackLabelFlags(pFlags[first + i]));
+					else
+						lua_pushnumber(L, LabelFieldValue(pValues[first + i], f));
+					lua_rawseti(L, -2, i + 1);
+				}
+				TruncateArray(L, count);
+				lua_pop(L, 1);
+			}
+		}
+		else
+		{
+			PushResultTable(L, options, size, 0);
+			int c = 0;
+			for (int i = 0; i < size; i++)
+			{
+				double mass = pValues[i].Mass;
+				if (mass < fm || mass > lm)
+					continue;
+
+				// Size for the optional flag fields so the table doesn't rehash
+				bool reused = PushRow(L, ++c, 6 + pFlags[i].Exception + pFlags[i].Fragmented + pFlags[i].Merged + pFlags[i].Modified + pFlags[i].Saturated);
+				luaD_setNumber(L, mass, "Mass");
+				luaD_setNumber(L, pValues[i].Intensity, "Intensity");
+				luaD_setNumber(L, pValues[i].Baseline, "Baseline");
+				luaD_setNumber(L, pValues[i].Noise, "Noise");
+				luaD_setNumber(L, pValues[i].Resolution, "Resolution");
+				luaD_setNumber(L, pValues[i].Charge, "Charge");
+
+				// Flags are only present when set, a reused peak loses those it had
+				SetLabelFlag(L, pFlags[i].Exception != 0, reused, "Exception");
+				SetLabelFlag(L, pFlags[i].Fragmented != 0, reused, "Fragmented");
+				SetLabelFlag(L, pFlags[i].Merged != 0, reused, "Merged");
+				SetLabelFlag(L, pFlags[i].Modified != 0, reused, "Modified");
+				SetLabelFlag(L, pFlags[i].Saturated != 0, reused, "Saturated");
+				lua_pop(L, 1);
+			}
+			TruncateArray(L, c);
+		}
+
+		return 1;
+	}
+
+	// Read a non-empty array of spectrum numbers at the given stack index
+	static int CheckScanList(lua_State* L, int index, std::vector<long>& scanNumbers)
+	{
+		luaL_checktype(L, index, LUA_TTABLE);
+		int nScans = (int)lua_rawlen(L, index);
+		if (nScans == 0)
+			return luaL_argerror(L, index, "Expecting at least one spectrum number");
+
+		scanNumbers.resize(nScans);
+		for (int i = 0; i < nScans; i++)
+		{
+			lua_rawgeti(L, index, i + 1);
+			scanNumbers[i] = (long)luaL_checkinteger(L, -1);
+			lua_pop(L, 1);
+		}
+		return nScans;
+	}
+
+	struct MergeCursor
+	{
+		double Mass;
+		size_t Spectrum;
+		size_t Position;
+		bool operator>(const MergeCursor& other) const { return Mass > other.Mass; }
+	};
+
+	// k-way merge of sorted centroid lists.  A cluster takes the peaks within
+	// ppm of its first (lowest) mass, so it doesn't drift as peaks join, and
+	// is reported at their intensity weighted mass.
+	static void MergeSpectra(const std::vector<std::vector<DataPeak> >& spectra, double ppm, double scale, std::vector<DataPeak>& merged)
+	{
+		std::priority_queue<MergeCursor, std::vector<MergeCursor>, std::greater<MergeCursor> > heap;
+		size_t total = 0;
+		for (size_t s = 0; s < spectra.size(); s++)
+		{
+			total += spectra[s].size();
+			if (!spectra[s].empty())
+			{
+				MergeCursor cursor = { spectra[s][0].Mass, s, 0 };
+				heap.push(cursor);
+			}
+		}
+
+		merged.clear();
+		merged.reserve(total);
+
+		double weightedMass = 0;
+		double intensity = 0;
+		double seedMass = -1;
+		while (!heap.empty())
+		{
+			MergeCursor cursor = heap.top();
+			heap.pop();
+
+			const DataPeak& peak = spectra[cursor.Spectrum][cursor.Position];
+			if (seedMass >= 0 && (peak.Mass - seedMass) > seedMass * ppm * 1e-6)
+			{
+				DataPeak result = { intensity > 0 ? weightedMass / intensity : seedMass, intensity * scale };
+				merged.push_back(result);
+				weightedMass = 0;
+				intensity = 0;
+				seedMass = -1;
+			}
+
+			if (seedMass < 0)
+				seedMass = peak.Mass;
+			weightedMass += peak.Mass * peak.Intensity;
+			intensity += peak.Intensity;
+
+			if (++cursor.Position < spectra[cursor.Spectrum].size())
+			{
+				cursor.Mass = spectra[cursor.Spectrum][cursor.Position].Mass;
+				heap.push(cursor);
+			}
+		}
+
+		if (seedMass >= 0)
+		{
+			DataPeak result = { intensity > 0 ? weightedMass / intensity : seedMass, intensity * scale };
+			merged.push_back(result);
+		}
+	}
+
+	/***
+	Average or sum a list of spectra into one spectrum
+
+	When every spectrum is profile data the reader's own averaging (or summing)
+	is used.  Otherwise, or when the reader can't average, the centroids of
+	the spectra, the reader's for profile ones, are merged natively, each
+	cluster taking the peaks within `ppm` of its lowest mass.
+
+	@function AverageSpectra
+	@tab 			scanList The spectrum numbers to merge
+	@tab[opt] 		options ppm (default 5), mode "mean" (default) or "sum"
+	@treturn 		table The merged spectrum as Mass and Intensity arrays
+	*/
+	int averageSpectra(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		double ppm = 5;
+		bool sum = false;
+
+		if (lua_gettop(L) > 2) {
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_getfield(L, 3, "ppm");
+			if (lua_isnumber(L, -1))
+			{
+				ppm = lua_tonumber(L, -1);
+			}
+			lua_getfield(L, 3, "mode");
+			if (lua_isstring(L, -1))
+			{
+				const char* mode = lua_tostring(L, -1);
+				if (strcmp(mode, "sum") == 0)
+					sum = true;
+				else if (strcmp(mode, "mean") != 0)
+					return luaL_error(L, "Unknown averaging mode: %s", mode);
+			}
+			lua_pop(L, 2);
+		}
+
+		std::vector<long> scanNumbers;
+		int nScans = CheckScanList(L, 2, scanNumbers);
+
+		bool allProfile = true;
+		std::vector<char> profile(nScans, 0);
+		for (int i = 0; i < nScans; i++)
+		{
+			bool centroid = false;
+			rawFile->Reader->IsCentroidScan(scanNumbers[i], centroid);
+			profile[i] = !centroid;
+			if (centroid)
+				allProfile = false;
+		}
+
+		// Profile spectra are averaged by the reader when it can, otherwise centroided and merged below
+		std::vector<DataPeak> averaged;
+		if (allProfile && rawFile->Reader->GetAveragedSpectrum(scanNumbers, sum, averaged))
+		{
+			PushSpectrumColumns(L, averaged.data(), (int)averaged.size());
+			return 1;
+		}
+
+		std::vector<std::vector<DataPeak> > spectra(nScans);
+		for (int i = 0; i < nScans; i++)
+		{
+			ReadMassList(rawFile, scanNumbers[i], spectra[i], profile[i]);
+		}
+
+		std::vector<DataPeak> merged;
+		MergeSpectra(spectra, ppm, sum ? 1.0 : 1.0 / nScans, merged);
+
+		PushSpectrumColumns(L, merged.empty() ? NULL : &merged[0], (int)merged.size());
+		return 1;
+	}
+
+	// Write the matrix as a NumPy .npy (version 1.0) little endian float32 array
+	static bool SaveNpy(const Matrix* matrix, const char* fileName)
+	{
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file)
+			return false;
+
+		std::ostringstream header;
+		header << "{'descr': '<f4', 'fortran_order': False, 'shape': (" << matrix->Rows << ", " << matrix->Columns << "), }";
+		std::string dict = header.str();
+
+		// Pad with spaces so the data starts on a 64 byte boundary
+		size_t length = dict.size() + 1;
+		size_t total = 10 + length;
+		size_t padding = (64 - total % 64) % 64;
+		dict.append(padding, ' ');
+		dict.push_back('\n');
+
+		unsigned short headerLength = (unsigned short)dict.size();
+		file.write("\x93NUMPY\x01\x00", 8);
+		char lengthBytes[2] = { (char)(headerLength & 0xff), (char)(headerLength >> 8) };
+		file.write(lengthBytes, 2);
+		file.write(dict.c_str(), dict.size());
+		if (!matrix->Data.empty())
+			file.write(reinterpret_cast<const char*>(&matrix->Data[0]), matrix->Data.size() * sizeof(float));
+
+		return file.good();
+	}
+
+	// Bins per spectrum and in the whole matrix, 1 GB of floats
+	#define BIN_MAX_BINS				16777216.0
+	#define BIN_MAX_CELLS				268435456.0
+
+	enum BinNormalization { BinNone, BinSqrt, BinMax, BinUnit };
+
+	// Add the peaks in range to their bins, then normalize the row
+	static void BinRow(const std::vector<DataPeak>& peaks, double minMass, double maxMass, double binWidth,
+		BinNormalization normalization, float* bins, int nBins)
+	{
+		double inverseWidth = 1.0 / binWidth;
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			double mass = peaks[i].Mass;
+			if (mass < minMass || mass >= maxMass)
+				continue;
+			int bin = (int)((mass - minMass) * inverseWidth);
+			if (bin < nBins)
+				bins[bin] += (float)peaks[i].Intensity;
+		}
+
+		if (normalization == BinSqrt)
+		{
+			for (int b = 0; b < nBins; b++)
+				bins[b] = std::sqrt(bins[b]);
+		}
+		else if (normalization != BinNone)
+		{
+			float scale = 0;
+			for (int b = 0; b < nBins; b++)
+				scale = normalization == BinMax ? (std::max)(scale, bins[b]) : scale + bins[b] * bins[b];
+			if (normalization == BinUnit)
+				scale = std::sqrt(scale);
+			if (scale > 0)
+			{
+				float inverse = 1.0f / scale;
+				for (int b = 0; b < nBins; b++)
+					bins[b] *= inverse;
+			}
+		}
+	}
+
+	/***
+	Bin a list of spectra into a dense float32 matrix, one row per spectrum
+
+	The rows are shared out to workers, each with a reader of its own, unless
+	LoadAll keeps the spectra in memory.
+
+	@function BinSpectra
+	@tab 			scanList The spectrum numbers to bin
+	@tab[opt] 		options binWidth (default 1.0005), min (default 100), max (default 2000),
+					normalize "none" (default), "sqrt", "max" or "unit", file an .npy path to save to,
+					workers (default the number of cores).  At most 16M bins a spectrum and 256M in all.
+	@treturn 		matrix The binned spectra
+	*/
+	int binSpectra(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		double binWidth = 1.0005;
+		double minMass = 100;
+		double maxMass = 2000;
+		const char* normalize = "none";
+		const char* fileName = NULL;
+		long workers = (long)std::thread::hardware_concurrency();
+
+		std::vector<long> scanNumbers;
+		int nScans = CheckScanList(L, 2, scanNumbers);
+
+		if (lua_gettop(L) > 2) {
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_pushvalue(L, 3);
+			luaD_getNumber(L, "binWidth", binWidth);
+			luaD_getNumber(L, "min", minMass);
+			luaD_getNumber(L, "max", maxMass);
+			luaD_getString(L, "normalize", normalize);
+			luaD_getString(L, "file", fileName);
+			luaD_getLong(L, "workers", workers);
+			lua_pop(L, 1);
+		}
+
+		if (!std::isfinite(binWidth) || !std::isfinite(minMass) || !std::isfinite(maxMass) || binWidth <= 0 || maxMass <= minMass)
+			return luaL_argerror(L, 3, "invalid binning range");
+
+		// Counted as a double, which holds any bin count, then capped
+		double binCount = std::ceil((maxMass - minMass) / binWidth);
+		if (!(binCount >= 1 && binCount <= BIN_MAX_BINS && binCount * nScans <= BIN_MAX_CELLS))
+			return luaL_argerror(L, 3, "too many bins");
+
+		BinNormalization normalization = BinNone;
+		if (strcmp(normalize, "sqrt") == 0)
+			normalization = BinSqrt;
+		else if (strcmp(normalize, "max") == 0)
+			normalization = BinMax;
+		else if (strcmp(normalize, "unit") == 0)
+			normalization = BinUnit;
+		else if (strcmp(normalize, "none") != 0)
+			return luaL_error(L, "Unknown normalization: %s", normalize);
+
+		int nBins = (int)binCount;
+
+		// Allocated before its userdata, a failure leaves nothing for __gc
+		Matrix* binned = NULL;
+		try
+		{
+			binned = new Matrix(nScans, nBins);
+		}
+		catch (const std::bad_alloc&)
+		{
+			binned = NULL;
+		}
+		if (binned == NULL)
+			return luaL_error(L, "Not enough memory for %d x %d bins", nScans, nBins);
+
+		Matrix **matrix = reinterpret_cast<Matrix**>(lua_newuserdata(L, sizeof(Matrix*)));
+		*matrix = binned;
+		luaL_getmetatable(L, MatrixType);
+		lua_setmetatable(L, -2);
+
+		// The store decodes into buffers of its own, so it's read on one thread
+		if (rawFile->Store != NULL)
+			workers = 1;
+		std::vector<ScanShare> shares = SplitScans(rawFile, 0, nScans - 1, workers);
+		ReadShares(rawFile, shares.size(), [&](TimedReader& reader, size_t s) {
+			std::vector<DataPeak> peaks;
+			for (long row = shares[s].First; row <= shares[s].Last; row++)
+			{
+				ReadMassList(rawFile, reader, scanNumbers[row], peaks);
+				BinRow(peaks, minMass, maxMass, binWidth, normalization, binned->Row(row), nBins);
+			}
+		});
+
+		if (fileName != NULL && !SaveNpy(binned, fileName))
+			return luaL_error(L, "Couldn't write matrix to %s", fileName);
+
+		return 1;
+	}
+
+	// Scale intensities by their square root and to unit length
+	static void NormalizePeaks(std::vector<DataPeak>& peaks)
+	{
+		double norm = 0;
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			peaks[i].Intensity = std::sqrt((std::max)(peaks[i].Intensity, 0.0));
+			norm += peaks[i].Intensity * peaks[i].Intensity;
+		}
+		if (norm <= 0)
+			return;
+		norm = 1.0 / std::sqrt(norm);
+		for (size_t i = 0; i < peaks.size(); i++)
+			peaks[i].Intensity *= norm;
+	}
+
+	// Dot product of two normalized, mass sorted peak lists matching within tolerance
+	static double CosineScore(const std::vector<DataPeak>& a, const std::vector<DataPeak>& b, double tolerance)
+	{
+		double dot = 0;
+		size_t i = 0, j = 0;
+		while (i < a.size() && j < b.size())
+		{
+			double delta = a[i].Mass - b[j].Mass;
+			if (delta < -tolerance)
+				i++;
+			else if (delta > tolerance)
+				j++;
+			else
+				dot += a[i++].Intensity * b[j++].Intensity;
+		}
+		return dot;
+	}
+
+	static bool LibraryPrecursorLess(const LibrarySpectrum& spectrum, double mz) { return spectrum.PrecursorMz < mz; }
+	static bool LibrarySpectrumLess(const LibrarySpectrum& a, const LibrarySpectrum& b) { return a.PrecursorMz < b.PrecursorMz; }
+	static bool DataPeakMassLess(const DataPeak& a, const DataPeak& b) { return a.Mass < b.Mass; }
+
+	static void AddLibrarySpectrum(Library* library, LibrarySpectrum& spectrum)
+	{
+		if (spectrum.PrecursorMz > 0 && !spectrum.Peaks.empty())
+		{
+			std::sort(spectrum.Peaks.begin(), spectrum.Peaks.end(), DataPeakMassLess);
+			NormalizePeaks(spectrum.Peaks);
+			library->Spectra.push_back(spectrum);
+		}
+		spectrum = LibrarySpectrum();
+		spectrum.PrecursorMz = 0;
+	}
+
+	// Read an NIST style MSP file, entries without a precursor m/z are skipped
+	static bool ReadMsp(Library* library, const char* fileName)
+	{
+		std::ifstream file(fileName);
+		if (!file)
+			return false;
+
+		LibrarySpectrum spectrum;
+		spectrum.PrecursorMz = 0;
+		long peaksLeft = 0;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+
+			if (peaksLeft > 0)
+			{
+				// Peak lines hold one or more "mz intensity" pairs, optionally annotated
+				for (size_t i = 0; i < line.size(); i++)
+				{
+					if (line[i] == ';' || line[i] == ',' || line[i] == '\t')
+						line[i] = ' ';
+					else if (line[i] == '"')
+						line.erase(i);
+				}
+				std::istringstream values(line);
+				DataPeak peak;
+				while (peaksLeft > 0 && values >> peak.Mass >> peak.Intensity)
+				{
+					spectrum.Peaks.push_back(peak);
+					peaksLeft--;
+				}
+				continue;
+			}
+
+			size_t colon = line.find(':');
+			if (colon == std::string::npos)
+			{
+				if (line.find_first_not_of(" \t") == std::string::npos && !spectrum.Name.empty())
+					AddLibrarySpectrum(library, spectrum);
+				continue;
+			}
+
+			std::string key = line.substr(0, colon);
+			std::string value = line.substr(colon + 1);
+			for (size_t i = 0; i < key.size(); i++)
+				key[i] = (char)std::tolower((unsigned char)key[i]);
+			size_t start = value.find_first_not_of(" \t");
+			value = start == std::string::npos ? "" : value.substr(start);
+
+			if (key == "name")
+			{
+				if (!spectrum.Name.empty())
+					AddLibrarySpectrum(library, spectrum);
+				spectrum.Name = value;
+			}
+			else if (key == "precursormz" || key == "precursor_mz" || (key == "precursor" && spectrum.PrecursorMz == 0))
+			{
+				spectrum.PrecursorMz = atof(value.c_str());
+			}
+			else if (key == "comment" && spectrum.PrecursorMz == 0)
+			{
+				size_t parent = value.find("Parent=");
+				if (parent != std::string::npos)
+					spectrum.PrecursorMz = atof(value.c_str() + parent + 7);
+			}
+			else if (key == "num peaks" || key == "num_peaks")
+			{
+				peaksLeft = atol(value.c_str());
+			}
+		}
+		if (!spectrum.Name.empty())
+			AddLibrarySpectrum(library, spectrum);
+
+		std::stable_sort(library->Spectra.begin(), library->Spectra.end(), LibrarySpectrumLess);
+		return true;
+	}
+
+	/***
+	Load a spectral library (NIST MSP format) for SearchLibrary
+
+	@function LoadLibrary
+	@string 		filePath The path to the .msp file
+	@treturn 		library The library, sorted by precursor m/z
+	*/
+	int loadLibrary(lua_State* L)
+	{
+		const char* filePath = luaL_checkstring(L, 1);
+
+		Library **library = reinterpret_cast<Library**>(lua_newuserdata(L, sizeof(Library*)));
+		*library = new Library();
+		(*library)->FileName = filePath;
+		luaL_getmetatable(L, LibraryType);
+		lua_setmetatable(L, -2);
+
+		if (!ReadMsp(*library, filePath))
+			return luaL_error(L, "Couldn't read library %s", filePath);
+
+		return 1;
+	}
+
+	struct LibraryHit
+	{
+		long ScanNumber;
+		size_t Entry;
+		double Score;
+		bool operator>(const LibraryHit& other) const { return Score > other.Score; }
+	};
+
+	struct LibraryQuery
+	{
+		long ScanNumber;
+		double PrecursorMz;
+		std::vector<DataPeak> Peaks;
+		std::vector<LibraryHit> Hits;
+	};
+
+	static void ScoreLibraryQuery(const Library* library, LibraryQuery& query, double precursorPpm, double fragmentTolerance, double minScore, size_t topN)
+	{
+		double window = query.PrecursorMz * precursorPpm * 1e-6;
+		std::vector<LibrarySpectrum>::const_iterator it = std::lower_bound(library->Spectra.begin(), library->Spectra.end(), query.PrecursorMz - window, LibraryPrecursorLess);
+
+		query.Hits.clear();
+		for (; it != library->Spectra.end() && it->PrecursorMz <= query.PrecursorMz + window; ++it)
+		{
+			double score = CosineScore(query.Peaks, it->Peaks, fragmentTolerance);
+			if (score < minScore)
+				continue;
+			LibraryHit hit = { query.ScanNumber, (size_t)(it - library->Spectra.begin()), score };
+			query.Hits.push_back(hit);
+		}
+
+		std::sort(query.Hits.begin(), query.Hits.end(), std::greater<LibraryHit>());
+		if (query.Hits.size() > topN)
+			query.Hits.resize(topN);
+	}
+
+	/***
+	Search the MS2 spectra of the raw file against a spectral library
+
+	Spectra are read in batches, as centroids, the reader's for profile scans,
+	and each batch is scored on worker threads.
+
+	@function SearchLibrary
+	@tparam library	library The library from LoadLibrary
+	@tab[opt] 		options precursorPpm (default 10), fragmentTol (default 0.02), topN (default 1),
+					minScore (default 0), first, last spectrum numbers, workers
+	@treturn 		table ScanNumber, Entry, Name, PrecursorMz and Score columns
+	*/
+	int searchLibrary(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		Library *library = checkLibrary(L, 2);
+
+		double precursorPpm = 10;
+		double fragmentTolerance = 0.02;
+		double minScore = 0;
+		long topN = 1;
+		long workers = (long)std::thread::hardware_concurrency();
+
+		lua_getuservalue(L, 1);
+		long first = 0;
+		long last = 0;
+		luaD_getLong(L, "FirstSpectrumNumber", first);
+		luaD_getLong(L, "LastSpectrumNumber", last);
+		lua_pop(L, 1);
+
+		if (lua_gettop(L) > 2) {
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_pushvalue(L, 3);
+			luaD_getNumber(L, "precursorPpm", precursorPpm);
+			luaD_getNumber(L, "fragmentTol", fragmentTolerance);
+			luaD_getNumber(L, "minScore", minScore);
+			luaD_getLong(L, "topN", topN);
+			luaD_getLong(L, "first", first);
+			luaD_getLong(L, "last", last);
+			luaD_getLong(L, "workers", workers);
+			lua_pop(L, 1);
+		}
+
+		topN = (std::max)(topN, 1L);
+		workers = (std::max)(workers, 1L);
+
+		const size_t batchSize = 256;
+		std::vector<LibraryQuery> batch;
+		std::vector<LibraryHit> hits;
+
+		for (long sn = first; sn <= last; )
+		{
+			// Read a batch of MS2 spectra, COM access stays on this thread
+			batch.clear();
+			for (; sn <= last && batch.size() < batchSize; sn++)
+			{
+				long msOrder = 0;
+				rawFile->Reader->GetMSOrder(sn, msOrder);
+				if (msOrder != 2)
+					continue;
+
+				LibraryQuery query;
+				query.ScanNumber = sn;
+				query.PrecursorMz = 0;
+				rawFile->Reader->GetPrecursorMass(sn, 2, query.PrecursorMz);
+				if (query.PrecursorMz <= 0)
+					continue;
+
+				bool centroid = false;
+				rawFile->Reader->IsCentroidScan(sn, centroid);
+				ReadMassList(rawFile, sn, query.Peaks, centroid ? 0 : 1);
+				NormalizePeaks(query.Peaks);
+				batch.push_back(query);
+			}
+
+			// Score the batch in parallel, each worker takes an interleaved share
+			size_t nThreads = (std::min)((size_t)workers, batch.size());
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < nThreads; t++)
+			{
+				threads.push_back(std::thread([&, t]() {
+					for (size_t q = t; q < batch.size(); q += nThreads)
+						ScoreLibraryQuery(library, batch[q], precursorPpm, fragmentTolerance, minScore, (size_t)topN);
+				}));
+			}
+			for (size_t q = 0; q < batch.size(); q += (std::max)(nThreads, (size_t)1))
+				ScoreLibraryQuery(library, batch[q], precursorPpm, fragmentTolerance, minScore, (size_t)topN);
+			for (size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+
+			for (size_t q = 0; q < batch.size(); q++)
+				hits.insert(hits.end(), batch[q].Hits.begin(), batch[q].Hits.end());
+		}
+
+		int size = (int)hits.size();
+		lua_createtable(L, 0, 5);
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushinteger(L, hits[i].ScanNumber);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "ScanNumber");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushinteger(L, (lua_Integer)hits[i].Entry + 1);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "Entry");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			const std::string& name = library->Spectra[hits[i].Entry].Name;
+			lua_pushlstring(L, name.c_str(), name.size());
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "Name");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushnumber(L, library->Spectra[hits[i].Entry].PrecursorMz);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "PrecursorMz");
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushnumber(L, hits[i].Score);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "Score");
+
+		return 1;
+	}
+
+	/***
+	Get the precursor mass of a given MSn stage in a spectrum
+	@function GetPrecursorMass
+	@int 			sn The spectrum number
+	@int[opt=2] 	msn The precursor MSn stage
+	@treturn 		float The precursor mass at the given stage
+	*/
+	int getPrecursorMass(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long sn = (long)luaL_checkinteger(L, 2);
+		long msOrder = 2;
+
+		if (lua_gettop(L) == 3) {
+			 msOrder = (long)luaL_checkinteger(L, 3);
+		}
+	
+		double mass = 0;
+		int charge = 0;
+		rawFile->Reader->GetPrecursorMass(sn, msOrder, mass);	
+
+		lua_pushnumber(L, mass);
+		lua_pushinteger(L, msOrder);
+		return 2;
+	}
+
+	// Copy the label peaks of a spectrum
+	static long ReadLabelData(RawFile* rawFile, long spectrumNumber, std::vector<LabelData>& peaks)
+	{
+		std::vector<LabelFlags> flags;
+		if (!rawFile->Reader->GetLabelData(spectrumNumber, peaks, flags))
+			peaks.clear();
+		return (long)peaks.size();
+	}
+
+	struct IsotopeEnvelope
+	{
+		long ScanNumber;
+		double MonoisotopicMz;
+		double MonoisotopicMass;
+		long Charge;
+		double Intensity;
+		long NumPeaks;
+	};
+
+	static bool LabelMassLess(const LabelData& a, double mass) { return a.Mass < mass; }
+
+	// Index of the unassigned peak closest to mz within ppm, or -1
+	static long FindIsotopePeak(const std::vector<LabelData>& peaks, const std::vector<bool>& used, double mz, double ppm)
+	{
+		double tolerance = mz * ppm * 1e-6;
+		std::vector<LabelData>::const_iterator it = std::lower_bound(peaks.begin(), peaks.end(), mz - tolerance, LabelMassLess);
+		long best = -1;
+		double bestDelta = tolerance;
+		for (; it != peaks.end() && it->Mass <= mz + tolerance; ++it)
+		{
+			long index = (long)(it - peaks.begin());
+			double delta = std::fabs(it->Mass - mz);
+			if (!used[index] && delta <= bestDelta)
+			{
+				best = index;
+				bestDelta = delta;
+			}
+		}
+		return best;
+	}
+
+	// Walk the isotope chain from start at the given charge, returning the peak indices
+	static void IsotopeChain(const std::vector<LabelData>& peaks, const std::vector<bool>& used, size_t start, long charge, double ppm, std::vector<long>& chain)
+	{
+		chain.clear();
+		chain.push_back((long)start);
+		double mz = peaks[start].Mass;
+		for (;;)
+		{
+			mz += ISOTOPE_SPACING / charge;
+			long next = FindIsotopePeak(peaks, used, mz, ppm);
+			if (next < 0)
+				break;
+			chain.push_back(next);
+			mz = peaks[next].Mass;
+		}
+	}
+
+	// Group the mass sorted label peaks into isotope envelopes, lowest m/z first.
+	// The instrument assigned charge is used when present, otherwise the charge
+	// giving the longest chain wins.  Unassigned singletons are dropped.
+	static void DeisotopePeaks(long spectrumNumber, const std::vector<LabelData>& peaks, double ppm, long maxCharge, std::vector<IsotopeEnvelope>& envelopes)
+	{
+		std::vector<bool> used(peaks.size(), false);
+		std::vector<long> chain;
+		std::vector<long> best;
+
+		for (size_t i = 0; i < peaks.size(); i++)
+		{
+			if (used[i])
+				continue;
+
+			long labelCharge = (long)peaks[i].Charge;
+			long bestCharge = 0;
+			best.clear();
+			for (long z = labelCharge > 0 ? labelCharge : maxCharge; z >= 1; z--)
+			{
+				IsotopeChain(peaks, used, i, z, ppm, chain);
+				if (chain.size() > best.size() || (chain.size() == best.size() && bestCharge == 0))
+				{
+					best.swap(chain);
+					bestCharge = z;
+				}
+				if (labelCharge > 0)
+					break;
+			}
+
+			if (best.size() < 2 && labelCharge <= 0)
+				continue;
+
+			IsotopeEnvelope envelope = { spectrumNumber, peaks[i].Mass, (peaks[i].Mass - PROTON_MASS) * bestCharge, bestCharge, 0, (long)best.size() };
+			for (size_t j = 0; j < best.size(); j++)
+			{
+				used[best[j]] = true;
+				envelope.Intensity += peaks[best[j]].Intensity;
+			}
+			envelopes.push_back(envelope);
+		}
+	}
+
+	/***
+	Deisotope the label peaks of one or more spectra
+
+	Given a list of spectrum numbers the label data is read on this thread and
+	the envelopes are found on worker threads.
+
+	@function Deisotope
+	@tparam int|table	sn The spectrum number, or a list of them
+	@tab[opt] 		options ppm (default 5), maxCharge (default 8), workers
+	@treturn 		table ScanNumber, MonoisotopicMass, MonoisotopicMz, Charge,
+					Intensity and NumPeaks columns
+	*/
+	int deisotope(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		std::vector<long> scanNumbers;
+		if (lua_istable(L, 2))
+		{
+			CheckScanList(L, 2, scanNumbers);
+		}
+		else
+		{
+			scanNumbers.push_back((long)luaL_checkinteger(L, 2));
+		}
+
+		double ppm = 5;
+		long maxCharge = 8;
+		long workers = (long)std::thread::hardware_concurrency();
+
+		if (lua_gettop(L) > 2) {
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_pushvalue(L, 3);
+			luaD_getNumber(L, "ppm", ppm);
+			luaD_getLong(L, "maxCharge", maxCharge);
+			luaD_getLong(L, "workers", workers);
+			lua_pop(L, 1);
+		}
+
+		maxCharge = (std::max)(maxCharge, 1L);
+
+		size_t nScans = scanNumbers.size();
+		std::vector<std::vector<LabelData> > spectra(nScans);
+		for (size_t i = 0; i < nScans; i++)
+			ReadLabelData(rawFile, scanNumbers[i], spectra[i]);
+
+		std::vector<std::vector<IsotopeEnvelope> > results(nScans);
+		size_t nThreads = (std::min)((size_t)(std::max)(workers, 1L), nScans);
+		std::vector<std::thread> threads;
+		for (size_t t = 1; t < nThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]() {
+				for (size_t i = t; i < nScans; i += nThreads)
+					DeisotopePeaks(scanNumbers[i], spectra[i], ppm, maxCharge, results[i]);
+			}));
+		}
+		for (size_t i = 0; i < nScans; i += nThreads)
+			DeisotopePeaks(scanNumbers[i], spectra[i], ppm, maxCharge, results[i]);
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+
+		std::vector<long> scans, charges, numPeaks;
+		std::vector<double> masses, mzs, intensities;
+		for (size_t i = 0; i < nScans; i++)
+		{
+			for (size_t j = 0; j < results[i].size(); j++)
+			{
+				const IsotopeEnvelope& envelope = results[i][j];
+				scans.push_back(envelope.ScanNumber);
+				masses.push_back(envelope.MonoisotopicMass);
+				mzs.push_back(envelope.MonoisotopicMz);
+				charges.push_back(envelope.Charge);
+				intensities.push_back(envelope.Intensity);
+				numPeaks.push_back(envelope.NumPeaks);
+			}
+		}
+
+		lua_createtable(L, 0, 6);
+		SetColumn(L, scans, "ScanNumber");
+		SetColumn(L, masses, "MonoisotopicMass");
+		SetColumn(L, mzs, "MonoisotopicMz");
+		SetColumn(L, charges, "Charge");
+		SetColumn(L, intensities, "Intensity");
+		SetColumn(L, numPeaks, "NumPeaks");
+		return 1;
+	}
+
+	struct PrecursorContext
+	{
+		long ScanNumber;
+		long MSOrder;
+		long MasterScan;
+		double PrecursorMz;
+		double MS1Mz;
+		long Charge;
+		double IsolationWidth;
+		double Intensity;
+	};
+
+	static bool PrecursorContextMasterLess(const PrecursorContext* a, const PrecursorContext* b) { return a->MasterScan < b->MasterScan; }
+
+	// Intensity at mz: linear interpolation for profile data, the most intense
+	// peak within ppm for centroid data
+	static double PrecursorIntensity(const std::vector<DataPeak>& peaks, bool centroid, double mz, double ppm)
+	{
+		DataPeak target = { mz, 0 };
+		std::vector<DataPeak>::const_iterator upper = std::lower_bound(peaks.begin(), peaks.end(), target, DataPeakMassLess);
+
+		if (!centroid)
+		{
+			if (upper == peaks.begin() || upper == peaks.end())
+				return 0;
+			std::vector<DataPeak>::const_iterator lower = upper - 1;
+			double span = upper->Mass - lower->Mass;
+			if (span <= 0)
+				return lower->Intensity;
+			return lower->Intensity + (upper->Intensity - lower->Intensity) * (mz - lower->Mass) / span;
+		}
+
+		double tolerance = mz * ppm * 1e-6;
+		double intensity = 0;
+		for (std::vector<DataPeak>::const_iterator it = upper; it != peaks.end() && it->Mass <= mz + tolerance; ++it)
+			intensity = (std::max)(intensity, it->Intensity);
+		for (std::vector<DataPeak>::const_iterator it = upper; it != peaks.begin() && (it - 1)->Mass >= mz - tolerance; --it)
+			intensity = (std::max)(intensity, (it - 1)->Intensity);
+		return intensity;
+	}
+
+	// The scan header fields of GetHeaderSeries and GetScanHeaders
+	static const char* const HeaderFields[] = { "NumPackets", "StartTime", "LowMass", "HighMass", "TIC",
+		"BasePeakMass", "BasePeakIntensity", "NumChannels", "UniformTime", "Frequency", NULL };
+
+	static double HeaderField(const ScanHeader& header, int field)
+	{
+		switch (field)
+		{
+		case 0: return (double)header.NumPackets;
+		case 1: return header.StartTime;
+		case 2: return header.LowMass;
+		case 3: return header.HighMass;
+		case 4: return header.TIC;
+		case 5: return header.BasePeakMass;
+		case 6: return header.BasePeakIntensity;
+		case 7: return (double)header.NumChannels;
+		case 8: return (double)header.UniformTime;
+		default: return header.Frequency;
+		}
+	}
+
+	static void ReadIndexedScan(RawFile* rawFile, long sn, IndexedScan& scan)
+	{
+		scan.Header = ScanHeader();
+		scan.MSOrder = 0;
+		rawFile->Reader->GetScanHeader(sn, scan.Header);
+		rawFile->Reader->GetMSOrder(sn, scan.MSOrder);
+	}
+
+	// Extend the scan index up to the last spectrum number, scans written
+	// since it was read are added to it
+	static void ExtendScanIndex(RawFile* rawFile, long first, long last)
+	{
+		std::vector<IndexedScan>& index = rawFile->ScanIndex;
+		for (long sn = first + (long)index.size(); sn <= last; sn++)
+		{
+			index.push_back(IndexedScan());
+			ReadIndexedScan(rawFile, sn, index.back());
+		}
+	}
+
+	/***
+	Get scan header fields of a whole run as columns
+
+	The headers and MS orders are read in one pass and kept for the open file,
+	so later series, of other fields or MS orders, don't read them again.
+
+	@function GetHeaderSeries
+	@tab[opt] 		fields Any of NumPackets, StartTime, LowMass, HighMass, TIC, BasePeakMass,
+					BasePeakIntensity, NumChannels, UniformTime and Frequency (default all)
+	@tab[opt] 		options msOrder (default any), first, last spectrum numbers,
+					cache false to read the headers without keeping them
+	@treturn 		table ScanNumber and a column for each field
+	*/
+	int getHeaderSeries(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		std::vector<int> fields;
+		if (lua_isnoneornil(L, 2))
+		{
+			for (int f = 0; HeaderFields[f] != NULL; f++)
+				fields.push_back(f);
+		}
+		else
+		{
+			luaL_checktype(L, 2, LUA_TTABLE);
+			int count = (int)lua_rawlen(L, 2);
+			for (int i = 1; i <= count; i++)
+			{
+				lua_rawgeti(L, 2, i);
+				fields.push_back(luaL_checkoption(L, -1, NULL, HeaderFields));
+				lua_pop(L, 1);
+			}
+		}
+
+		long firstScan = 0;
+		long lastScan = -1;
+		rawFile->Reader->GetFirstSpectrumNumber(firstScan);
+		rawFile->Reader->GetLastSpectrumNumber(lastScan);
+
+		long msOrder = 0;
+		long first = firstScan;
+		long last = lastScan;
+		bool cache = true;
+		if (!lua_isnoneornil(L, 3))
+		{
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_pushvalue(L, 3);
+			luaD_getLong(L, "msOrder", msOrder);
+			luaD_getLong(L, "first", first);
+			luaD_getLong(L, "last", last);
+			luaD_getBoolean(L, "cache", cache);
+			lua_pop(L, 1);
+		}
+		first = (std::max)(first, firstScan);
+		last = (std::min)(last, lastScan);
+
+		std::vector<long> scans;
+		std::vector<const ScanHeader*> headers;
+		std::vector<IndexedScan> uncached;
+		if (cache)
+		{
+			ExtendScanIndex(rawFile, firstScan, last);
+			for (long sn = first; sn <= last; sn++)
+			{
+				const IndexedScan& scan = rawFile->ScanIndex[sn - firstScan];
+				if (msOrder != 0 && scan.MSOrder != msOrder)
+					continue;
+				scans.push_back(sn);
+				headers.push_back(&scan.Header);
+			}
+		}
+		else
+		{
+			uncached.resize((size_t)(std::max)(last - first + 1, 0L));
+			for (long sn = first; sn <= last; sn++)
+			{
+				IndexedScan& scan = uncached[sn - first];
+				ReadIndexedScan(rawFile, sn, scan);
+				if (msOrder != 0 && scan.MSOrder != msOrder)
+					continue;
+				scans.push_back(sn);
+				headers.push_back(&scan.Header);
+			}
+		}
+
+		int size = (int)scans.size();
+		lua_createtable(L, 0, (int)fields.size() + 1);
+
+		lua_createtable(L, size, 0);
+		for (int i = 0; i < size; i++)
+		{
+			lua_pushinteger(L, scans[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "ScanNumber");
+
+		for (size_t f = 0; f < fields.size(); f++)
+		{
+			lua_createtable(L, size, 0);
+			for (int i = 0; i < size; i++)
+			{
+				lua_pushnumber(L, HeaderField(*headers[i], fields[f]));
+				lua_rawseti(L, -2, i + 1);
+			}
+			lua_setfield(L, -2, HeaderFields[fields[f]]);
+		}
+
+		return 1;
+	}
+
+	/***
+	Get the scan headers of many scans as one typed column per field
+
+	NumPackets and NumChannels are integers, UniformTime a boolean and the
+	others numbers.  Headers already kept by GetHeaderSeries are used as they
+	are, otherwise the scans are shared out to workers, each with a reader of
+	its own.
+
+	@function GetScanHeaders
+	@int[opt] 		first The first spectrum number (default FirstSpectrumNumber)
+	@int[opt] 		last The last spectrum number (default LastSpectrumNumber)
+	@tab[opt] 		fields Any of NumPackets, StartTime, LowMass, HighMass, TIC, BasePeakMass,
+					BasePeakIntensity, NumChannels, UniformTime and Frequency (default all)
+	@tab[opt] 		options workers (default the number of cores)
+	@treturn 		table ScanNumber and a column for each field
+	*/
+	int getScanHeaders(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		long firstScan = 0;
+		long lastScan = -1;
+		rawFile->Reader->GetFirstSpectrumNumber(firstScan);
+		rawFile->Reader->GetLastSpectrumNumber(lastScan);
+
+		long first = (std::max)((long)luaL_optinteger(L, 2, firstScan), firstScan);
+		long last = (std::min)((long)luaL_optinteger(L, 3, lastScan), lastScan);
+
+		std::vector<int> fields;
+		if (lua_isnoneornil(L, 4))
+		{
+			for (int f = 0; HeaderFields[f] != NULL; f++)
+				fields.push_back(f);
+		}
+		else
+		{
+			luaL_checktype(L, 4, LUA_TTABLE);
+			int count = (int)lua_rawlen(L, 4);
+			for (int i = 1; i <= count; i++)
+			{
+				lua_rawgeti(L, 4, i);
+				fields.push_back(luaL_checkoption(L, -1, NULL, HeaderFields));
+				lua_pop(L, 1);
+			}
+		}
+
+		long workers = (long)std::thread::hardware_concurrency();
+		if (!lua_isnoneornil(L, 5))
+		{
+			luaL_checktype(L, 5, LUA_TTABLE);
+			lua_pushvalue(L, 5);
+			luaD_getLong(L, "workers", workers);
+			lua_pop(L, 1);
+		}
+
+		long count = (std::max)(last - first + 1, 0L);
+		std::vector<ScanHeader> headers((size_t)count);
+		if (count > 0 && firstScan + (long)rawFile->ScanIndex.size() > last)
+		{
+			for (long i = 0; i < count; i++)
+				headers[i] = rawFile->ScanIndex[first + i - firstScan].Header;
+		}
+		else if (count > 0)
+		{
+			std::vector<ScanShare> shares = SplitScans(rawFile, first, last, workers);
+			ReadShares(rawFile, shares.size(), [&](TimedReader& reader, size_t s) {
+				for (long sn = shares[s].First; sn <= shares[s].Last; sn++)
+					reader->GetScanHeader(sn, headers[sn - first]);
+			});
+		}
+
+		lua_createtable(L, 0, (int)fields.size() + 1);
+
+		lua_createtable(L, (int)count, 0);
+		for (long i = 0; i < count; i++)
+		{
+			lua_pushinteger(L, first + i);
+			lua_rawseti(L, -2, (int)i + 1);
+		}
+		lua_setfield(L, -2, "ScanNumber");
+
+		for (size_t f = 0; f < fields.size(); f++)
+		{
+			lua_createtable(L, (int)count, 0);
+			for (long i = 0; i < count; i++)
+			{
+				const ScanHeader& header = headers[i];
+				switch (fields[f])
+				{
+				case 0: lua_pushinteger(L, header.NumPackets); break;
+				case 7: lua_pushinteger(L, header.NumChannels); break;
+				case 8: lua_pushboolean(L, header.UniformTime != 0); break;
+				default: lua_pushnumber(L, HeaderField(header, fields[f])); break;
+				}
+				lua_rawseti(L, -2, (int)i + 1);
+			}
+			lua_setfield(L, -2, HeaderFields[fields[f]]);
+		}
+
+		return 1;
+	}
+
+	/***
+	Get the precursor context of every MSn spectrum in a range
+
+	Each parent MS1 spectrum is read once, after the MSn scans are grouped by it.
+
+	@function GetPrecursorContext
+	@int[opt] 		first The first spectrum number (default FirstSpectrumNumber)
+	@int[opt] 		last The last spectrum number (default LastSpectrumNumber)
+	@tab[opt] 		options ppm the centroid matching tolerance (default 10)
+	@treturn 		table ScanNumber, MSOrder, MasterScanNumber, PrecursorMz, Charge,
+					IsolationWidth and PrecursorIntensity columns
+	*/
+	int getPrecursorContext(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		lua_getuservalue(L, 1);
+		long first = 0;
+		long last = 0;
+		luaD_getLong(L, "FirstSpectrumNumber", first);
+		luaD_getLong(L, "LastSpectrumNumber", last);
+		lua_pop(L, 1);
+
+		first = (long)luaL_optinteger(L, 2, first);
+		last = (long)luaL_optinteger(L, 3, last);
+
+		double ppm = 10;
+		if (lua_gettop(L) > 3) {
+			luaL_checktype(L, 4, LUA_TTABLE);
+			lua_pushvalue(L, 4);
+			luaD_getNumber(L, "ppm", ppm);
+			lua_pop(L, 1);
+		}
+
+		const std::string monoLabel("Monoisotopic M/Z:");
+		const std::string chargeLabel("Charge State:");
+		const std::string masterLabel("Master Scan Number:");
+
+		// Find the MS1 scan preceding the range
+		long lastMS1 = 0;
+		for (long sn = first - 1; sn > 0 && lastMS1 == 0; sn--)
+		{
+			long msOrder = 0;
+			rawFile->Reader->GetMSOrder(sn, msOrder);
+			if (msOrder == 1)
+				lastMS1 = sn;
+		}
+
+		std::vector<PrecursorContext> contexts;
+		for (long sn = first; sn <= last; sn++)
+		{
+			long msOrder = 0;
+			rawFile->Reader->GetMSOrder(sn, msOrder);
+			if (msOrder <= 1)
+			{
+				if (msOrder == 1)
+					lastMS1 = sn;
+				continue;
+			}
+
+			PrecursorContext context = { sn, msOrder, lastMS1, 0, 0, 0, 0, 0 };
+
+			double value = 0;
+			if (TrailerNumber(rawFile, sn, masterLabel, value) && value > 0)
+			{
+				long masterOrder = 0;
+				rawFile->Reader->GetMSOrder((long)value, masterOrder);
+				if (masterOrder == 1)
+					context.MasterScan = (long)value;
+			}
+
+			if (TrailerNumber(rawFile, sn, monoLabel, value) && value > 0)
+				context.PrecursorMz = value;
+			else
+				rawFile->Reader->GetPrecursorMass(sn, msOrder, context.PrecursorMz);
+
+			if (TrailerNumber(rawFile, sn, chargeLabel, value))
+				context.Charge = (long)value;
+
+			rawFile->Reader->GetIsolationWidth(sn, msOrder, context.IsolationWidth);
+
+			// The MS1 precursor of deeper MSn stages is the MS2 precursor
+			context.MS1Mz = context.PrecursorMz;
+			if (msOrder > 2)
+				rawFile->Reader->GetPrecursorMass(sn, 2, context.MS1Mz);
+
+			contexts.push_back(context);
+		}
+
+		// Visit every parent MS1 spectrum once
+		std::vector<PrecursorContext*> byMaster(contexts.size());
+		for (size_t i = 0; i < contexts.size(); i++)
+			byMaster[i] = &contexts[i];
+		std::stable_sort(byMaster.begin(), byMaster.end(), PrecursorContextMasterLess);
+
+		std::vector<DataPeak> peaks;
+		for (size_t i = 0; i < byMaster.size(); )
+		{
+			long master = byMaster[i]->MasterScan;
+			size_t end = i;
+			while (end < byMaster.size() && byMaster[end]->MasterScan == master)
+				end++;
+
+			if (master > 0)
+			{
+				bool centroid = false;
+				rawFile->Reader->IsCentroidScan(master, centroid);
+				ReadMassList(rawFile, master, peaks);
+				for (size_t j = i; j < end; j++)
+					byMaster[j]->Intensity = PrecursorIntensity(peaks, centroid, byMaster[j]->MS1Mz, ppm);
+			}
+			i = end;
+		}
+
+		size_t size = contexts.size();
+		std::vector<long> scanNumbers(size), msOrders(size), masters(size), charges(size);
+		std::vector<double> mzs(size), widths(size), intensities(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			scanNumbers[i] = contexts[i].ScanNumber;
+			msOrders[i] = contexts[i].MSOrder;
+			masters[i] = contexts[i].MasterScan;
+			charges[i] = contexts[i].Charge;
+			mzs[i] = contexts[i].PrecursorMz;
+			widths[i] = contexts[i].IsolationWidth;
+			intensities[i] = contexts[i].Intensity;
+		}
+
+		lua_createtable(L, 0, 7);
+		SetColumn(L, scanNumbers, "ScanNumber");
+		SetColumn(L, msOrders, "MSOrder");
+		SetColumn(L, masters, "MasterScanNumber");
+		SetColumn(L, mzs, "PrecursorMz");
+		SetColumn(L, charges, "Charge");
+		SetColumn(L, widths, "IsolationWidth");
+		SetColumn(L, intensities, "PrecursorIntensity");
+		return 1;
+	}
+
+	// A distinct isolation window of a run, see GetIsolationScheme
+	struct IsolationWindow
+	{
+		double Center;
+		double Width;
+		long MSOrder;
+		long ScanEvent;						// of the first scan with the window
+		long Scans;
+	};
+
+	// The windows and cycles of a range of scans, with a window id (1 based,
+	// 0 for MS1 scans) and a cycle (1 based) for each scan
+	struct IsolationScheme
+	{
+		std::vector<IsolationWindow> Windows;
+		std::vector<long> ScanNumbers;
+		std::vector<double> RetentionTimes;
+		std::vector<long> WindowIds;
+		std::vector<long> CycleIds;
+		std::vector<long> CycleStarts;		// indices into the scans
+	};
+
+	// Windows closer than this in center and width are the same
+	#define ISOLATION_WINDOW_TOLERANCE	0.001
+
+	// A cycle starts at each MS1 scan or, in cycles without one, at the
+	// first window acquired again
+	static void ReadIsolationScheme(RawFile* rawFile, long first, long last, IsolationScheme& scheme)
+	{
+		typedef std::pair<long, std::pair<long long, long long> > WindowKey;
+		std::map<WindowKey, long> windowIds;
+		std::vector<char> inCycle;
+		bool cycleHasMS1 = false;
+
+		for (long sn = first; sn <= last; sn++)
+		{
+			long msOrder = 0;
+			double rt = 0;
+			rawFile->Reader->GetMSOrder(sn, msOrder);
+			rawFile->Reader->RTFromScanNum(sn, rt);
+
+			long id = 0;
+			if (msOrder > 1)
+			{
+				double center = 0;
+				double width = 0;
+				rawFile->Reader->GetPrecursorMass(sn, msOrder, center);
+				rawFile->Reader->GetIsolationWidth(sn, msOrder, width);
+
+				WindowKey key(msOrder, std::make_pair((long long)std::floor(center / ISOLATION_WINDOW_TOLERANCE + 0.5),
+					(long long)std::floor(width / ISOLATION_WINDOW_TOLERANCE + 0.5)));
+				std::map<WindowKey, long>::iterator it = windowIds.find(key);
+				if (it == windowIds.end())
+				{
+					long segment = 0;
+					long scanEvent = 0;
+					rawFile->Reader->GetSegmentAndEvent(sn, segment, scanEvent);
+					IsolationWindow window = { center, width, msOrder, scanEvent, 0 };
+					scheme.Windows.push_back(window);
+					inCycle.push_back(0);
+					it = windowIds.insert(std::make_pair(key, (long)scheme.Windows.size())).first;
+				}
+				id = it->second;
+				scheme.Windows[id - 1].Scans++;
+			}
+
+			bool newCycle = scheme.CycleStarts.empty() || msOrder == 1 || (id > 0 && !cycleHasMS1 && inCycle[id - 1]);
+			if (newCycle)
+			{
+				scheme.CycleStarts.push_back((long)scheme.ScanNumbers.size());
+				std::fill(inCycle.begin(), inCycle.end(), 0);
+				cycleHasMS1 = false;
+			}
+			if (msOrder == 1)
+				cycleHasMS1 = true;
+			if (id > 0)
+				inCycle[id - 1] = 1;
+
+			scheme.ScanNumbers.push_back(sn);
+			scheme.RetentionTimes.push_back(rt);
+			scheme.WindowIds.push_back(id);
+			scheme.CycleIds.push_back((long)scheme.CycleStarts.size());
+		}
+	}
+
+	/***
+	Get the isolation windows and acquisition cycles of a run
+
+	Windows are told apart by MS order, precursor mass and isolation width,
+	and numbered in the order first acquired.  A cycle starts at each MS1
+	scan or, when there are none, at the first window acquired again.
+
+	@function GetIsolationScheme
+	@int[opt] 		first The first spectrum number (default FirstSpectrumNumber)
+	@int[opt] 		last The last spectrum number (default LastSpectrumNumber)
+	@treturn 		table Windows (Center, Width, LowMz, HighMz, MSOrder, ScanEvent and
+					Scans columns), Cycles (FirstScan, LastScan and StartTime columns),
+					and a ScanNumber, RetentionTime, Window (0 for MS1) and Cycle column
+	*/
+	int getIsolationScheme(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+
+		lua_getuservalue(L, 1);
+		long first = 0;
+		long last = 0;
+		luaD_getLong(L, "FirstSpectrumNumber", first);
+		luaD_getLong(L, "LastSpectrumNumber", last);
+		lua_pop(L, 1);
+
+		first = (long)luaL_optinteger(L, 2, first);
+		last = (long)luaL_optinteger(L, 3, last);
+
+		IsolationScheme scheme;
+		ReadIsolationScheme(rawFile, first, last, scheme);
+
+		size_t nWindows = scheme.Windows.size();
+		std::vector<double> centers(nWindows), widths(nWindows), lows(nWindows), highs(nWindows);
+		std::vector<long> msOrders(nWindows), scanEvents(nWindows), scans(nWindows);
+		for (size_t w = 0; w < nWindows; w++)
+		{
+			const IsolationWindow& window = scheme.Windows[w];
+			centers[w] = window.Center;
+			widths[w] = window.Width;
+			lows[w] = window.Center - window.Width / 2;
+			highs[w] = window.Center + window.Width / 2;
+			msOrders[w] = window.MSOrder;
+			scanEvents[w] = window.ScanEvent;
+			scans[w] = window.Scans;
+		}
+
+		size_t nCycles = scheme.CycleStarts.size();
+		std::vector<long> firstScans(nCycles), lastScans(nCycles);
+		std::vector<double> startTimes(nCycles);
+		for (size_t c = 0; c < nCycles; c++)
+		{
+			long start = scheme.CycleStarts[c];
+			long end = c + 1 < nCycles ? scheme.CycleStarts[c + 1] : (long)scheme.ScanNumbers.size();
+			firstScans[c] = scheme.ScanNumbers[start];
+			lastScans[c] = scheme.ScanNumbers[end - 1];
+			startTimes[c] = scheme.RetentionTimes[start];
+		}
+
+		lua_createtable(L, 0, 6);
+
+		lua_createtable(L, 0, 7);
+		SetColumn(L, centers, "Center");
+		SetColumn(L, widths, "Width");
+		SetColumn(L, lows, "LowMz");
+		SetColumn(L, highs, "HighMz");
+		SetColumn(L, msOrders, "MSOrder");
+		SetColumn(L, scanEvents, "ScanEvent");
+		SetColumn(L, scans, "Scans");
+		lua_setfield(L, -2, "Windows");
+
+		lua_createtable(L, 0, 3);
+		SetColumn(L, firstScans, "FirstScan");
+		SetColumn(L, lastScans, "LastScan");
+		SetColumn(L, startTimes, "StartTime");
+		lua_setfield(L, -2, "Cycles");
+
+		SetColumn(L, scheme.ScanNumbers, "ScanNumber");
+		SetColumn(L, scheme.RetentionTimes, "RetentionTime");
+		SetColumn(L, scheme.WindowIds, "Window");
+		SetColumn(L, scheme.CycleIds, "Cycle");
+		return 1;
+	}
+
+	// An interval tree over isolation windows, kept as the windows sorted by
+	// their low m/z, the middle of each range being the root of its subtree
+	struct WindowIndex
+	{
+		std::vector<double> Lows;
+		std::vector<double> Highs;
+		std::vector<double> MaxHighs;		// the highest of each subtree
+		std::vector<long> Ids;
+	};
+
+	static double BuildWindowIndex(WindowIndex& index, size_t lo, size_t hi)
+	{
+		if (lo >= hi)
+			return -HUGE_VAL;
+		size_t mid = lo + (hi - lo) / 2;
+		double left = BuildWindowIndex(index, lo, mid);
+		double right = BuildWindowIndex(index, mid + 1, hi);
+		index.MaxHighs[mid] = (std::max)(index.Highs[mid], (std::max)(left, right));
+		return index.MaxHighs[mid];
+	}
+
+	// Index the MS2 windows of a scheme, by window id
+	static void BuildWindowIndex(const IsolationScheme& scheme, WindowIndex& index)
+	{
+		std::vector<std::pair<double, long> > byLow;
+		for (size_t w = 0; w < scheme.Windows.size(); w++)
+		{
+			if (scheme.Windows[w].MSOrder == 2)
+				byLow.push_back(std::make_pair(scheme.Windows[w].Center - scheme.Windows[w].Width / 2, (long)w + 1));
+		}
+		std::sort(byLow.begin(), byLow.end());
+
+		size_t count = byLow.size();
+		index.Lows.resize(count);
+		index.Highs.resize(count);
+		index.MaxHighs.resize(count);
+		index.Ids.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const IsolationWindow& window = scheme.Windows[byLow[i].second - 1];
+			index.Lows[i] = byLow[i].first;
+			index.Highs[i] = window.Center + window.Width / 2;
+			index.Ids[i] = byLow[i].second;
+		}
+		BuildWindowIndex(index, 0, count);
+	}
+
+	// The ids of the windows containing mz
+	static void FindWindows(const WindowIndex& index, size_t lo, size_t hi, double mz, std::vector<long>& ids)
+	{
+		if (lo >= hi)
+			return;
+		size_t mid = lo + (hi - lo) / 2;
+		if (index.MaxHighs[mid] < mz)
+			return;
+		FindWindows(index, lo, mid, mz, ids);
+		if (index.Lows[mid] > mz)
+			return;
+		if (mz <= index.Highs[mid])
+			ids.push_back(index.Ids[mid]);
+		FindWindows(index, mid + 1, hi, mz, ids);
+	}
+
+	// A precursor and its fragments to extract, with the points found so far
+	struct DIATarget
+	{
+		double Mz;
+		std::vector<double> Fragments;
+		double Ppm;
+		double RTLow;
+		double RTHigh;
+		std::vector<long> ScanNumbers;
+		std::vector<double> RetentionTimes;
+		std::vector<long> Windows;
+		std::vector<std::vector<double> > Intensities;		// by fragment
+	};
+
+	/***
+	Extract fragment chromatograms of DIA targets
+
+	The MS2 isolation windows are put in an interval tree, the windows
+	containing each precursor found in it, and then each MS2 spectrum of a
+	window with targets is read once.  Fragment intensities are the highest
+	centroid within the target's ppm, or interpolated in profile spectra.
+
+	@function ExtractDIAFragments
+	@tab 			targets Tables of mz (precursor), fragments (m/z list),
+					ppm and rtRange ({low, high}, default the whole run)
+	@tab[opt] 		options ppm, the default of the targets (default 10)
+	@treturn 		table For each target ScanNumber, RetentionTime and Window
+					columns, and Intensities, a column for each fragment
+	*/
+	int extractDIAFragments(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		luaL_checktype(L, 2, LUA_TTABLE);
+
+		double ppm = 10;
+		if (!lua_isnoneornil(L, 3))
+		{
+			luaL_checktype(L, 3, LUA_TTABLE);
+			lua_pushvalue(L, 3);
+			luaD_getNumber(L, "ppm", ppm);
+			lua_pop(L, 1);
+		}
+
+		int nTargets = (int)lua_rawlen(L, 2);
+		std::vector<DIATarget> targets(nTargets);
+		double rtLow = HUGE_VAL;
+		double rtHigh = -HUGE_VAL;
+		for (int t = 0; t < nTargets; t++)
+		{
+			DIATarget& target = targets[t];
+			lua_rawgeti(L, 2, t + 1);
+			if (!lua_istable(L, -1))
+				return luaL_error(L, "Target %d isn't a table", t + 1);
+
+			lua_getfield(L, -1, "mz");
+			lua_getfield(L, -2, "fragments");
+			if (!lua_isnumber(L, -2) || !lua_istable(L, -1))
+				return luaL_error(L, "Target %d needs an mz and fragments", t + 1);
+			target.Mz = lua_tonumber(L, -2);
+			int nFragments = (int)lua_rawlen(L, -1);
+			for (int f = 1; f <= nFragments; f++)
+			{
+				lua_rawgeti(L, -1, f);
+				target.Fragments.push_back(luaL_checknumber(L, -1));
+				lua_pop(L, 1);
+			}
+			lua_pop(L, 2);
+
+			target.Ppm = ppm;
+			luaD_getNumber(L, "ppm", target.Ppm);
+
+			target.RTLow = -HUGE_VAL;
+			target.RTHigh = HUGE_VAL;
+			lua_getfield(L, -1, "rtRange");
+			if (lua_istable(L, -1))
+			{
+				lua_rawgeti(L, -1, 1);
+				lua_rawgeti(L, -2, 2);
+				target.RTLow = luaL_optnumber(L, -2, -HUGE_VAL);
+				target.RTHigh = luaL_optnumber(L, -1, HUGE_VAL);
+				lua_pop(L, 2);
+			}
+			lua_pop(L, 2);
+
+			target.Intensities.resize(target.Fragments.size());
+			rtLow = (std::min)(rtLow, target.RTLow);
+			rtHigh = (std::max)(rtHigh, target.RTHigh);
+		}
+
+		// Only the scans within the retention times of some target
+		long first = 0;
+		long last = -1;
+		rawFile->Reader->GetFirstSpectrumNumber(first);
+		rawFile->Reader->GetLastSpectrumNumber(last);
+		long sn = 0;
+		if (nTargets > 0 && rtLow > -HUGE_VAL && rawFile->Reader->ScanNumFromRT(rtLow, sn))
+			first = (std::max)(first, sn - 1);
+		if (nTargets > 0 && rtHigh < HUGE_VAL && rawFile->Reader->ScanNumFromRT(rtHigh, sn))
+			last = (std::min)(last, sn + 1);
+		if (nTargets == 0)
+			last = first - 1;
+
+		IsolationScheme scheme;
+		ReadIsolationScheme(rawFile, first, last, scheme);
+		WindowIndex index;
+		BuildWindowIndex(scheme, index);
+
+		std::vector<std::vector<int> > windowTargets(scheme.Windows.size() + 1);
+		std::vector<long> ids;
+		for (int t = 0; t < nTargets; t++)
+		{
+			ids.clear();
+			FindWindows(index, 0, index.Ids.size(), targets[t].Mz, ids);
+			for (size_t i = 0; i < ids.size(); i++)
+				windowTargets[ids[i]].push_back(t);
+		}
+
+		std::vector<DataPeak> peaks;
+		for (size_t s = 0; s < scheme.ScanNumbers.size(); s++)
+		{
+			const std::vector<int>& inWindow = windowTargets[scheme.WindowIds[s]];
+			double rt = scheme.RetentionTimes[s];
+			bool read = false;
+			bool centroid = false;
+			for (size_t i = 0; i < inWindow.size(); i++)
+			{
+				DIATarget& target = targets[inWindow[i]];
+				if (rt < target.RTLow || rt > target.RTHigh)
+					continue;
+				if (!read)
+				{
+					rawFile->Reader->IsCentroidScan(scheme.ScanNumbers[s], centroid);
+					ReadMassList(rawFile, scheme.ScanNumbers[s], peaks);
+					read = true;
+				}
+
+				target.ScanNumbers.push_back(scheme.ScanNumbers[s]);
+				target.RetentionTimes.push_back(rt);
+				target.Windows.push_back(scheme.WindowIds[s]);
+				for (size_t f = 0; f < target.Fragments.size(); f++)
+					target.Intensities[f].push_back(PrecursorIntensity(peaks, centroid, target.Fragments[f], target.Ppm));
+			}
+		}
+
+		lua_createtable(L, nTargets, 0);
+		for (int t = 0; t < nTargets; t++)
+		{
+			const DIATarget& target = targets[t];
+			lua_createtable(L, 0, 4);
+			SetColumn(L, target.ScanNumbers, "ScanNumber");
+			SetColumn(L, target.RetentionTimes, "RetentionTime");
+			SetColumn(L, target.Windows, "Window");
+
+			lua_createtable(L, (int)target.Fragments.size(), 0);
+			for (size_t f = 0; f < target.Fragments.size(); f++)
+			{
+				const std::vector<double>& values = target.Intensities[f];
+				lua_createtable(L, (int)values.size(), 0);
+				for (size_t i = 0; i < values.size(); i++)
+				{
+					lua_pushnumber(L, values[i]);
+					lua_rawseti(L, -2, (int)i + 1);
+				}
+				lua_rawseti(L, -2, (int)f + 1);
+			}
+			lua_setfield(L, -2, "Intensities");
+
+			lua_rawseti(L, -2, t + 1);
+		}
+		return 1;
+	}
+
+	int getInAcquisition(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		bool inAcq = false;
+		rawFile->Reader->InAcquisition(inAcq);
+		lua_pushboolean(L, inAcq);
+		return 1;
+	}
+
+	// Refresh the view of a file in acquisition, returns the new last spectrum number
+	static long RefreshLastSpectrum(lua_State* L, RawFile* rawFile)
+	{
+		long lastScanNumber = 0;
+		if (!rawFile->Reader->RefreshViewOfFile() ||
+			!rawFile->Reader->SetCurrentController(0, 1) || // MS device, 1st device
+			!rawFile->Reader->GetLastSpectrumNumber(lastScanNumber))
+		{
+			return rawFile->LastScanSeen;
+		}
+
+		lua_getuservalue(L, 1);
+		lua_pushnumber(L, lastScanNumber);
+		lua_setfield(L, -2, "LastSpectrumNumber");
+		lua_pop(L, 1);
+
+		return lastScanNumber;
+	}
+
+	/***
+	Refresh the view of a file that is still being acquired
+
+	@function Refresh
+	@treturn 		int The updated LastSpectrumNumber
+	*/
+	int refreshRawFile(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		lua_pushinteger(L, RefreshLastSpectrum(L, rawFile));
+		return 1;
+	}
+
+	static int newScansIterator(lua_State* L)
+	{
+		long next = (long)lua_tointeger(L, lua_upvalueindex(1));
+		long last = (long)lua_tointeger(L, lua_upvalueindex(2));
+		if (next > last)
+			return 0;
+
+		lua_pushinteger(L, next + 1);
+		lua_replace(L, lua_upvalueindex(1));
+		lua_pushinteger(L, next);
+		return 1;
+	}
+
+	/***
+	Iterate over the scans written since the previous call
+
+	The first call after Open yields every scan.  With a timeout the call waits,
+	polling the file, until new scans arrive, the acquisition ends or the
+	timeout passes.
+
+	@function NewScans
+	@int[opt=0] 	timeout The time to wait for new scans in milliseconds
+	@int[opt=250] 	interval The polling interval in milliseconds
+	@treturn 		function An iterator over the new spectrum numbers
+	*/
+	int newScans(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
+		long timeout = (long)luaL_optinteger(L, 2, 0);
+		long interval = (long)luaL_optinteger(L, 3, 250);
+
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		long lastScanNumber = RefreshLastSpectrum(L, rawFile);
+		while (lastScanNumber <= rawFile->LastScanSeen && std::chrono::steady_clock::now() < deadline)
+		{
+			bool inAcq = false;
+			rawFile->Reader->InAcquisition(inAcq);
+			if (!inAcq)
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds((std::max)(interval, 1L)));
+			lastScanNumber = RefreshLastSpectrum(L, rawFile);
+		}
+
+		long first = rawFile->LastScanSeen + 1;
+		if (lastScanNumber > rawFile->LastScanSeen)
+			rawFile->LastScanSeen = lastScanNumber;
+
+		lua_pushinteger(L, first);
+		lua_pushinteger(L, lastScanNumber);
+		lua_pushcclosure(L, newScansIterator, 2);
+		return 1;
+	}
+
+	// Scan fields read on first access and the raw file methods that read them
+	static const char* const ScanFields[][2] = {
+		{ "Header", "GetScanHeader" },
+		{ "Filter", "GetScanFilter" },
+		{ "Trailer", "GetScanTrailer" },
+		{ "StatusLog", "GetStatusLog" },
+		{ "RetentionTime", "GetRetentionTime" },
+		{ "MSOrder", "GetMSNOrder" },
+		{ "Centroid", "HasCentroidData" },
+		{ "PrecursorMass", "GetPrecursorMass" },
+		{ "IsolationWidth", "GetIsolationWidth" },
+		{ "Peaks", "GetSpectrum" },
+		{ "Labels", "GetLabelData" },
+	};
+	static const int ScanFieldCount = sizeof(ScanFields) / sizeof(ScanFields[0]);
+
+	// Push a scan of the raw file at index.  Its user value holds the raw file,
+	// the spectrum number and every field read so far.
+	static void PushScan(lua_State* L, int rawFile, long sn)
+	{
+		*reinterpret_cast<long*>(lua_newuserdata(L, sizeof(long))) = sn;
+		luaL_getmetatable(L, ScanType);
+		lua_setmetatable(L, -2);
+
+		lua_createtable(L, 0, 4);
+		lua_pushvalue(L, rawFile);
+		lua_setfield(L, -2, "RawFile");
+		lua_pushinteger(L, sn);
+		lua_setfield(L, -2, "Number");
+		lua_setuservalue(L, -2);
+	}
+
+	/***
+	Get a field of a scan, reading it through the raw file the first time
+
+	@function __index
+	@string 		key Number, RawFile, Header, Filter, Trailer, StatusLog, RetentionTime,
+					MSOrder, Centroid, PrecursorMass, IsolationWidth, Peaks or Labels
+	@return 		The field, as returned by the raw file method of the same data
+	*/
+	int scanIndex(lua_State* L)
+	{
+		long sn = checkScan(L);
+		const char* key = luaL_checkstring(L, 2);
+
+		lua_getuservalue(L, 1);
+		lua_getfield(L, -1, key);
+		if (!lua_isnil(L, -1))
+			return 1;
+		lua_pop(L, 1);
 
-		for (int i = 0; i < size; i++)
-		{
-			lua_createtable(L, 0, 2);
-			luaD_setNumber(L, pValues[i].dTime, "Time");
-			luaD_setNumber(L, pValues[i].dIntensity, "Intensity");
+		int f = 0;
+		while (f < ScanFieldCount && strcmp(key, ScanFields[f][0]) != 0) f++;
+		if (f == ScanFieldCount)
+			return 0;
 
-			lua_rawseti(L, -2, i + 1);
-		}
+		// Call through the metatable so call statistics count the read
+		luaL_getmetatable(L, RawFileType);
+		lua_getfield(L, -1, ScanFields[f][1]);
+		lua_getfield(L, -3, "RawFile");
+		lua_pushinteger(L, sn);
+		lua_call(L, 2, 1);
 
-		SafeArrayUnaccessData(valueSA);
-		SafeArrayDestroy(valueSA);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -4, key);
+		return 1;
+	}
 
+	int scanToString(lua_State* L)
+	{
+		lua_pushfstring(L, "Scan: %d", (int)checkScan(L));
 		return 1;
 	}
 
-	int getSpectrumData(lua_State* L)
+	// The next selected scan, upvalues: raw file, next and last spectrum
+	// number, MS order (0 for any), retention time range and filter text
+	static int scansIterator(lua_State* L)
 	{
-		RawFile *rawFile = checkRawFile(L);
-		long spectrumNumber = (long)luaL_checkinteger(L, 2);
+		RawFile* rawFile = *reinterpret_cast<RawFile**>(lua_touserdata(L, lua_upvalueindex(1)));
+		long next = (long)lua_tointeger(L, lua_upvalueindex(2));
+		long last = (long)lua_tointeger(L, lua_upvalueindex(3));
+		long msOrder = (long)lua_tointeger(L, lua_upvalueindex(4));
+		double rtLow = lua_tonumber(L, lua_upvalueindex(5));
+		double rtHigh = lua_tonumber(L, lua_upvalueindex(6));
+		const char* filter = lua_tostring(L, lua_upvalueindex(7));
+		bool timed = rtHigh >= rtLow;
+
+		for (long sn = next; sn <= last; sn++)
+		{
+			long order = 0;
+			if (msOrder != 0 && (!rawFile->Reader->GetMSOrder(sn, order) || order != msOrder))
+				continue;
 
-		double fm = 0;
-		double lm = 1000000000;
+			double rt = 0;
+			if (timed)
+			{
+				rawFile->Reader->RTFromScanNum(sn, rt);
+				if (rt > rtHigh)
+					break;
+				if (rt < rtLow)
+					continue;
+			}
 
-		if (lua_gettop(L) > 2) {
-			luaL_checktype(L, 3, LUA_TTABLE);
-			lua_getfield(L, 3, "fm");
-			if (lua_isnumber(L, -1))
+			std::string text;
+			if (filter != NULL && (!rawFile->Reader->GetFilter(sn, text) || text.find(filter) == std::string::npos))
+				continue;
+
+			lua_pushinteger(L, sn + 1);
+			lua_replace(L, lua_upvalueindex(2));
+
+			// What the selection read is kept as the scan's fields
+			PushScan(L, lua_upvalueindex(1), sn);
+			lua_getuservalue(L, -1);
+			if (msOrder != 0)
 			{
-				fm = lua_tonumber(L, -1);
+				lua_pushinteger(L, order);
+				lua_setfield(L, -2, "MSOrder");
 			}
-			lua_getfield(L, 3, "lm");
-			if (lua_isnumber(L, -1))
+			if (timed)
 			{
-				lm = lua_tonumber(L, -1);
+				lua_pushnumber(L, rt);
+				lua_setfield(L, -2, "RetentionTime");
 			}
-			lua_pop(L, 2);
+			if (filter != NULL)
+			{
+				lua_pushlstring(L, text.data(), text.size());
+				lua_setfield(L, -2, "Filter");
+			}
+			lua_pop(L, 1);
+			return 1;
 		}
 
-		VARIANT massList;
-		VariantInit(&massList);
-		VARIANT peakFlags;
-		VariantInit(&peakFlags);
-		long size;
-		double centroidPeakWidth = 0;	
-		rawFile->comRawFile->GetMassListFromScanNum(&spectrumNumber, (LPCTSTR)NULL, 0, 0, 0, 0, &centroidPeakWidth, &massList, &peakFlags, &size);
-				
-		SAFEARRAY FAR* psa = massList.parray;
-		DataPeak* pDataPeaks = NULL;
-		SafeArrayAccessData(psa, (void**)(&pDataPeaks));	
-	
-		lua_createtable(L, size, 0);
-		int c = 1;
-		for (int i = 0; i < size; i++)
-		{
-			double mass = pDataPeaks[i].Mass;
-			if (mass < fm || mass > lm)
-				continue;
+		lua_pushinteger(L, last + 1);
+		lua_replace(L, lua_upvalueindex(2));
+		return 0;
+	}
 
-			lua_createtable(L, 0, 2);
-			luaD_setNumber(L, mass, "Mass");
-			luaD_setNumber(L, pDataPeaks[i].Intensity, "Intensity");
-			lua_rawseti(L, -2, c++);
-		}	
-				
-		SafeArrayUnaccessData(psa);		
-		SafeArrayDestroy(psa);	
-		
-		VariantClear(&peakFlags);
+	/***
+	Iterate over the scans matching a selection
 
-		return 1;
-	}
+	Each scan is a light object with its Number; Header, Filter, Trailer,
+	StatusLog, RetentionTime, MSOrder, Centroid, PrecursorMass,
+	IsolationWidth, Peaks (GetSpectrum) and Labels (GetLabelData) are read
+	when first used and kept, so a loop only reads the data it looks at.
 
-	int getLabelData(lua_State* L)
+	@function Scans
+	@tab[opt] 		options msOrder, rtRange {from, to} in minutes, scanRange {first, last}
+					and filter, text the scan filter must contain
+	@treturn 		function An iterator over the selected scans
+	*/
+	int getScans(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		long spectrumNumber = (long)luaL_checkinteger(L, 2);
-
-		double fm = 0;
-		double lm = 1000000000;
+		lua_settop(L, 2);
+		long first = 0;
+		long last = -1;
+		rawFile->Reader->GetFirstSpectrumNumber(first);
+		rawFile->Reader->GetLastSpectrumNumber(last);
+
+		long msOrder = 0;
+		double rtLow = 0;
+		double rtHigh = -1;
+		if (!lua_isnoneornil(L, 2))
+		{
+			luaL_checktype(L, 2, LUA_TTABLE);
+			luaD_getLong(L, "msOrder", msOrder);
 
-		if (lua_gettop(L) > 2) {
-			luaL_checktype(L, 3, LUA_TTABLE);
-			lua_getfield(L, 3, "fm");
-			if (lua_isnumber(L, -1))
+			lua_getfield(L, 2, "scanRange");
+			if (lua_istable(L, -1))
 			{
-				fm = lua_tonumber(L, -1);
+				lua_rawgeti(L, -1, 1);
+				lua_rawgeti(L, -2, 2);
+				first = (std::max)(first, (long)luaL_optinteger(L, -2, first));
+				last = (std::min)(last, (long)luaL_optinteger(L, -1, last));
+				lua_pop(L, 2);
 			}
-			lua_getfield(L, 3, "lm");
-			if (lua_isnumber(L, -1))
+			lua_pop(L, 1);
+
+			lua_getfield(L, 2, "rtRange");
+			if (lua_istable(L, -1))
 			{
-				lm = lua_tonumber(L, -1);
+				lua_rawgeti(L, -1, 1);
+				lua_rawgeti(L, -2, 2);
+				rtLow = luaL_optnumber(L, -2, 0);
+				rtHigh = luaL_optnumber(L, -1, HUGE_VAL);
+				lua_pop(L, 2);
+
+				// Scans before the closest to the start are earlier still
+				long start = 0;
+				if (rtHigh >= rtLow && rawFile->Reader->ScanNumFromRT(rtLow, start))
+					first = (std::max)(first, start);
 			}
-			lua_pop(L, 2);
+			lua_pop(L, 1);
 		}
 
-		VARIANT labels;
-		VARIANT flags;
-		VariantInit(&labels);
-		VariantInit(&flags);
-
-		rawFile->comRawFile->GetLabelData(&labels, &flags, &spectrumNumber);
+		lua_pushvalue(L, 1);
+		lua_pushinteger(L, first);
+		lua_pushinteger(L, last);
+		lua_pushinteger(L, msOrder);
+		lua_pushnumber(L, rtLow);
+		lua_pushnumber(L, rtHigh);
+		if (lua_istable(L, 2))
+			lua_getfield(L, 2, "filter");
+		else
+			lua_pushnil(L);
+		if (!lua_isnil(L, -1) && !lua_isstring(L, -1))
+			return luaL_argerror(L, 2, "filter must be a string");
+		lua_pushcclosure(L, scansIterator, 7);
+		return 1;
+	}
 
-		LabelData* pValues = NULL;
-		SAFEARRAY FAR* valueSA = labels.parray;
-		SafeArrayAccessData(valueSA, (void**)(&pValues));
+	static char const* DeviceTypeNames[] = { "MS", "Analog", "A/D card", "PDA", "UV" };
+	static const long DeviceTypeCount = sizeof(DeviceTypeNames) / sizeof(DeviceTypeNames[0]);
 
-		LabelFlags* pFlags = NULL;
-		SAFEARRAY FAR* flagsSA = flags.parray;
-		SafeArrayAccessData(flagsSA, (void**)(&pFlags));
+	// Device type from a number or a type name
+	static long CheckDeviceType(lua_State* L, int index)
+	{
+		if (lua_type(L, index) == LUA_TNUMBER)
+			return (long)lua_tointeger(L, index);
 
-		int size = labels.parray->rgsabound[0].cElements;
-		lua_createtable(L, size, 0);
-		int c = 1;
-		for (int i = 0; i < size; i++)
+		const char* name = luaL_checkstring(L, index);
+		for (long type = 0; type < DeviceTypeCount; type++)
 		{
-			double mass = pValues[i].Mass;
-			if (mass < fm || mass > lm)
-				continue;
+			if (strcmp(name, DeviceTypeNames[type]) == 0)
+				return type;
+		}
+		return luaL_argerror(L, index, "Unknown device type");
+	}
 
-			lua_createtable(L, 0, 6);
-			luaD_setNumber(L, mass, "Mass");
-			luaD_setNumber(L, pValues[i].Intensity, "Intensity");
-			luaD_setNumber(L, pValues[i].Baseline, "Baseline");
-			luaD_setNumber(L, pValues[i].Noise, "Noise");
-			luaD_setNumber(L, pValues[i].Resolution, "Resolution");
-			luaD_setNumber(L, pValues[i].Charge, "Charge");
+	// Get the cached reader for a controller, opening the file on it the first time.
+	// The MS controller always uses the main reader.
+	static RawFileBackend* GetDeviceHandle(RawFile* rawFile, long type, long index)
+	{
+		if (type == 0 && index == 1)
+			return rawFile->Reader.Get();
 
-			if (pFlags[i].Exception)
-			{
-				lua_pushboolean(L, true);
-				lua_setfield(L, -2, "Exception");
-			}
+		DeviceKey key(type, index);
+		std::map<DeviceKey, RawFileBackend*>::iterator it = rawFile->Devices.find(key);
+		if (it != rawFile->Devices.end())
+			return it->second;
 
-			if (pFlags[i].Fragmented)
-			{
-				lua_pushboolean(L, true);
-				lua_setfield(L, -2, "Fragmented");
-			}
+		int error = 0;
+		RawFileBackend* device = CreateBackend(rawFile->BackendName.c_str(), error);
+		if (device == NULL)
+			return NULL;
 
-			if (pFlags[i].Merged)
-			{
-				lua_pushboolean(L, true);
-				lua_setfield(L, -2, "Merged");
-			}
+		if (!device->Open(rawFile->FileName.c_str()) || !device->SetCurrentController(type, index))
+		{
+			device->Close();
+			delete device;
+			return NULL;
+		}
 
-			if (pFlags[i].Modified)
-			{
-				lua_pushboolean(L, true);
-				lua_setfield(L, -2, "Modified");
-			}
+		return rawFile->Devices[key] = device;
+	}
 
-			if (pFlags[i].Saturated)
-			{
-				lua_pushboolean(L, true);
-				lua_setfield(L, -2, "Saturated");
-			}
+	/***
+	List the devices (controllers) recorded in the raw file
 
-			lua_rawseti(L, -2, c++);
-		}
+	@function Devices
+	@treturn 		table An array of {Type, TypeName, Index} tables, Index is 1 based per type
+	*/
+	int getDevices(lua_State* L)
+	{
+		RawFile *rawFile = checkRawFile(L);
 
-		SafeArrayUnaccessData(valueSA);
-		SafeArrayDestroy(valueSA);
-		SafeArrayUnaccessData(flagsSA);
-		SafeArrayDestroy(flagsSA);
+		long count = 0;
+		rawFile->Reader->GetNumberOfControllers(count);
 
+		std::map<long, long> perType;
+		lua_createtable(L, count, 0);
+		for (long i = 0; i < count; i++)
+		{
+			long type = -1;
+			rawFile->Reader->GetControllerType(i, type);
 
+			lua_createtable(L, 0, 3);
+			luaD_setNumber(L, type, "Type");
+			luaD_setString(L, type >= 0 && type < DeviceTypeCount ? DeviceTypeNames[type] : "Unknown", "TypeName");
+			luaD_setNumber(L, ++perType[type], "Index");
+			lua_rawseti(L, -2, i + 1);
+		}
 		return 1;
 	}
 
 	/***
-	Get the precursor mass of a given MSn stage in a spectrum
-	@function GetPrecursorMass
-	@int 			sn The spectrum number
-	@int[opt=2] 	msn The precursor MSn stage
-	@treturn 		float The precursor mass at the given stage
+	Get the trace (chromatogram) of a device channel
+
+	Each device is read through its own cached handle, so the MS controller is
+	left untouched.  The channel is the MS File Reader chromatogram type of
+	the device:
+
+	- MS: 0 the mass range given by MassRange, 1 TIC (the default), 2 base peak
+	- PDA: 0 the wavelength range given by MassRange, 1 total scan, 2 spectrum maximum
+	- UV, Analog and A/D card: 0 to 3 the first to fourth channel (A to D,
+	  analog or A/D input 1 to 4), 0 by default
+
+	@function GetTrace
+	@tparam int|string	deviceType 0 or "MS", 1 "Analog", 2 "A/D card", 3 "PDA", 4 "UV"
+	@int[opt=1] 	index The 1 based device index within the type
+	@tab[opt] 		options channel, StartTime, EndTime, Filter (the scans whose filter
+					contains it), MassRange ("low-high" or a single mass)
+	@treturn 		table Time and Value columns with StartTime and EndTime
 	*/
-	int getPrecursorMass(lua_State* L)
+	int getTrace(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		long sn = (long)luaL_checkinteger(L, 2);
-		long msOrder = 2;
+		long type = CheckDeviceType(L, 2);
+		long index = (long)luaL_optinteger(L, 3, 1);
 
-		if (lua_gettop(L) == 3) {
-			 msOrder = (long)luaL_checkinteger(L, 3);
+		long channel = type == 0 ? 1 : 0;
+		double startTime = 0;
+		double endTime = 0;
+		const char* filter = "";
+		const char* massRange = "";
+		if (lua_gettop(L) > 3) {
+			luaL_checktype(L, 4, LUA_TTABLE);
+			lua_pushvalue(L, 4);
+			luaD_getLong(L, "channel", channel);
+			luaD_getNumber(L, "StartTime", startTime);
+			luaD_getNumber(L, "EndTime", endTime);
+			luaD_getString(L, "Filter", filter);
+			luaD_getString(L, "MassRange", massRange);
+			lua_pop(L, 1);
 		}
-	
-		double mass = 0;
-		int charge = 0;
-		rawFile->comRawFile->GetPrecursorMassForScanNum(sn, msOrder, &mass);	
 
-		lua_pushnumber(L, mass);
-		lua_pushinteger(L, msOrder);
-		return 2;
-	}
+		RawFileBackend* device = GetDeviceHandle(rawFile, type, index);
+		if (device == NULL)
+			return luaL_error(L, "Couldn't open device %d, %d", (int)type, (int)index);
+
+		ChroSettings settings;
+		settings.Type = channel;
+		settings.Operator = 0;
+		settings.Type2 = 0;
+		settings.Filter = filter;
+		settings.MassRange1 = massRange;
+		settings.Delay = 0;
+		settings.SmoothingType = 0;
+		settings.SmoothingValue = 3;
+
+		std::vector<ChroPeak> points;
+		if (!device->GetChroData(settings, startTime, endTime, points))
+			return luaL_error(L, "Couldn't read channel %d of device %d, %d", (int)channel, (int)type, (int)index);
+
+		size_t size = points.size();
+		std::vector<double> times(size);
+		std::vector<double> values(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			times[i] = points[i].dTime;
+			values[i] = points[i].dIntensity;
+		}
 
-	int getInAcquisition(lua_State* L)
-	{
-		RawFile *rawFile = checkRawFile(L);
-		long inAcq = 0;
-		rawFile->comRawFile->InAcquisition(&inAcq);		
-		lua_pushboolean(L, inAcq);
+		lua_createtable(L, 0, 4);
+		luaD_setNumber(L, startTime, "StartTime");
+		luaD_setNumber(L, endTime, "EndTime");
+		SetColumn(L, times, "Time");
+		SetColumn(L, values, "Value");
 		return 1;
 	}
 
@@ -834,7 +4086,7 @@ namespace RawFile {
 		long sn = (long)luaL_checkinteger(L, 2);
 		long segs = 0;
 		long events = 0;
-		rawFile->comRawFile->GetSegmentAndEventForScanNum(sn, &segs, &events);
+		rawFile->Reader->GetSegmentAndEvent(sn, segs, events);
 		lua_pushinteger(L, segs);
 		lua_pushinteger(L, events);
 		return 2;
@@ -844,8 +4096,7 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);
 		double lowMass(0);
-		HRESULT hr = rawFile->comRawFile->GetLowMass(&lowMass);
-		if (FAILED(hr)) 
+		if (!rawFile->Reader->GetLowMass(lowMass)) 
 		{
 			lua_pushboolean(L, false);
 			return 1;
@@ -858,8 +4109,7 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);
 		double highMass(0);
-		HRESULT hr = rawFile->comRawFile->GetHighMass(&highMass);
-		if (FAILED(hr))
+		if (!rawFile->Reader->GetHighMass(highMass))
 		{
 			lua_pushboolean(L, false);
 			return 1;
@@ -871,70 +4121,65 @@ namespace RawFile {
 	int getInstName(lua_State* L)
 	{	
 		RawFile *rawFile = checkRawFile(L);
-		BSTR name = NULL; // the assignment to null is needed for some odd reason
-		HRESULT hr = rawFile->comRawFile->GetInstName(&name);
-		if (FAILED(hr))
+		std::string name;
+		if (!rawFile->Reader->GetInstName(name))
 		{
 			lua_pushboolean(L, false);
 			return 1;
 		}
-		lua_pushstring(L, _bstr_t(name));
+		lua_pushlstring(L, name.data(), name.size());
 		return 1;
 	}
 
 	int getSWVersion(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		BSTR version = NULL; // the assignment to null is needed for some odd reason
-		HRESULT hr = rawFile->comRawFile->GetInstSoftwareVersion(&version);
-		if (FAILED(hr))
+		std::string version;
+		if (!rawFile->Reader->GetInstSoftwareVersion(version))
 		{
 			lua_pushboolean(L, false);
 			return 1;
 		}
-		lua_pushstring(L, _bstr_t(version));
+		lua_pushlstring(L, version.data(), version.size());
 		return 1;
 	}
 
 	int getSerialNumber(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		BSTR serialNumber = NULL;
-		HRESULT hr = rawFile->comRawFile->GetInstSerialNumber(&serialNumber);
-		if (FAILED(hr))
+		std::string serialNumber;
+		if (!rawFile->Reader->GetInstSerialNumber(serialNumber))
 		{
 			lua_pushboolean(L, false);
 			return 1;
 		}
-		lua_pushstring(L, _bstr_t(serialNumber));
+		lua_pushlstring(L, serialNumber.data(), serialNumber.size());
 		return 1;
 	}
 
 	int getHWVersion(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		BSTR version = NULL;
-		HRESULT hr = rawFile->comRawFile->GetInstHardwareVersion(&version);
-		if (FAILED(hr))
+		std::string version;
+		if (!rawFile->Reader->GetInstHardwareVersion(version))
 		{
 			lua_pushboolean(L, false);
 			return 1;
 		}
-		lua_pushstring(L, _bstr_t(version));
+		lua_pushlstring(L, version.data(), version.size());
 		return 1;
 	}
 
 	int getInstModel(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
-		BSTR model = NULL;
-		HRESULT hr = rawFile->comRawFile->GetInstModel(&model);
-		if (FAILED(hr))
+		std::string model;
+		if (!rawFile->Reader->GetInstModel(model))
 		{
 			lua_pushboolean(L, false);
 			return 1;
 		}
-		lua_pushstring(L, _bstr_t(model));
+		lua_pushlstring(L, model.data(), model.size());
 		return 1;
 	}
 	
@@ -944,8 +4189,7 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);		
 		long count(0);
-		HRESULT hr = rawFile->comRawFile->GetNumErrorLog(&count);
-		if (FAILED(hr))
+		if (!rawFile->Reader->GetNumErrorLog(count))
 		{
 			lua_pushboolean(L, false);
 			return 1;
@@ -958,19 +4202,168 @@ namespace RawFile {
 	{
 		RawFile *rawFile = checkRawFile(L);
 		long id = (long)luaL_checkinteger(L, 2);
-		BSTR message = NULL; // the assignment to null is needed for some odd reason
+		std::string message;
 		double rt(0);
-		HRESULT hr = rawFile->comRawFile->GetErrorLogItem(id, &rt, &message);
-		if (FAILED(hr))
+		if (!rawFile->Reader->GetErrorLogItem(id, rt, message))
 		{
 			lua_pushboolean(L, false);
 			return 1;
 		}		
-		lua_pushstring(L, _bstr_t(message));
+		lua_pushlstring(L, message.data(), message.size());
 		lua_pushnumber(L, rt);
 		return 2;
 	}
 
+	std::atomic<bool> StatsEnabled(false);
+	std::atomic<long long> StatsComNanoseconds(0);
+
+	static const size_t StatsCount = sizeof(thermo_rawfile_m) / sizeof(thermo_rawfile_m[0]) - 1;
+	static FunctionStats CallStats[StatsCount];
+
+	// Bindings that are never instrumented
+	static bool IsStatsExempt(const char* name)
+	{
+		return name[0] == '_' || strcmp(name, "EnableStats") == 0 || strcmp(name, "GetStats") == 0 || strcmp(name, "ResetStats") == 0;
+	}
+
+	static double LuaMemoryBytes(lua_State* L)
+	{
+		return lua_gc(L, LUA_GCCOUNT, 0) * 1024.0 + lua_gc(L, LUA_GCCOUNTB, 0);
+	}
+
+	static int instrumentedCall(lua_State* L)
+	{
+		FunctionStats* stats = reinterpret_cast<FunctionStats*>(lua_touserdata(L, lua_upvalueindex(1)));
+
+		long long comBefore = StatsComNanoseconds.load(std::memory_order_relaxed);
+		double memoryBefore = LuaMemoryBytes(L);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		int results = stats->Function(L);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats->Calls++;
+		stats->TotalSeconds += seconds;
+		stats->ComSeconds += (StatsComNanoseconds.load(std::memory_order_relaxed) - comBefore) * 1e-9;
+		stats->LuaBytes += (std::max)(LuaMemoryBytes(L) - memoryBefore, 0.0);
+
+		int bucket = 0;
+		for (double us = seconds * 1e6; us >= 2 && bucket < STATS_BUCKETS - 1; us /= 2)
+			bucket++;
+		stats->Histogram[bucket]++;
+
+		return results;
+	}
+
+	// Upper bound of the histogram bucket holding the given fraction of the calls
+	static double StatsPercentile(const FunctionStats& stats, double fraction)
+	{
+		unsigned long long target = (unsigned long long)std::ceil(stats.Calls * fraction);
+		unsigned long long count = 0;
+		for (int bucket = 0; bucket < STATS_BUCKETS; bucket++)
+		{
+			count += stats.Histogram[bucket];
+			if (count >= target)
+				return std::ldexp(1e-6, bucket + 1);
+		}
+		return std::ldexp(1e-6, STATS_BUCKETS);
+	}
+
+	/***
+	Turn call statistics on or off for all raw files
+
+	While enabled every method is replaced in the metatable by a wrapper that
+	records its calls, so there is no cost while disabled.
+
+	@function EnableStats
+	@bool[opt=true] enable
+	@treturn 		bool If statistics were enabled before
+	*/
+	int enableStats(lua_State* L)
+	{
+		bool enable = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+		lua_pushboolean(L, StatsEnabled.load());
+
+		luaL_getmetatable(L, RawFileType);
+		for (size_t i = 0; i < StatsCount; i++)
+		{
+			const luaL_Reg& reg = thermo_rawfile_m[i];
+			if (IsStatsExempt(reg.name))
+				continue;
+
+			CallStats[i].Name = reg.name;
+			CallStats[i].Function = reg.func;
+			if (enable)
+			{
+				lua_pushlightuserdata(L, &CallStats[i]);
+				lua_pushcclosure(L, instrumentedCall, 1);
+			}
+			else
+			{
+				lua_pushcfunction(L, reg.func);
+			}
+			lua_setfield(L, -2, reg.name);
+		}
+		lua_pop(L, 1);
+
+		StatsEnabled = enable;
+		return 1;
+	}
+
+	/***
+	Get the call statistics of every method called since the last reset
+
+	Times are in seconds.  ComTime is spent in the readers, summed over the
+	worker threads of a call, LuaTime is the rest of the call, mostly building
+	the results.  The percentiles are the upper
+	bounds of power of two microsecond buckets.  LuaBytes is the Lua memory
+	growth during the calls.
+
+	@function GetStats
+	@treturn 		table Per method {Calls, TotalTime, ComTime, LuaTime, MeanTime, P50, P90, P99, LuaBytes}
+	*/
+	int getStats(lua_State* L)
+	{
+		lua_createtable(L, 0, 0);
+		for (size_t i = 0; i < StatsCount; i++)
+		{
+			const FunctionStats& stats = CallStats[i];
+			if (stats.Calls == 0)
+				continue;
+
+			lua_createtable(L, 0, 9);
+			luaD_setNumber(L, (lua_Number)stats.Calls, "Calls");
+			luaD_setNumber(L, stats.TotalSeconds, "TotalTime");
+			luaD_setNumber(L, stats.ComSeconds, "ComTime");
+			luaD_setNumber(L, (std::max)(stats.TotalSeconds - stats.ComSeconds, 0.0), "LuaTime");
+			luaD_setNumber(L, stats.TotalSeconds / stats.Calls, "MeanTime");
+			luaD_setNumber(L, StatsPercentile(stats, 0.5), "P50");
+			luaD_setNumber(L, StatsPercentile(stats, 0.9), "P90");
+			luaD_setNumber(L, StatsPercentile(stats, 0.99), "P99");
+			luaD_setNumber(L, stats.LuaBytes, "LuaBytes");
+			lua_setfield(L, -2, stats.Name);
+		}
+		return 1;
+	}
+
+	/***
+	Clear the call statistics
+
+	@function ResetStats
+	*/
+	int resetStats(lua_State*)
+	{
+		for (size_t i = 0; i < StatsCount; i++)
+		{
+			const char* name = CallStats[i].Name;
+			lua_CFunction function = CallStats[i].Function;
+			memset(&CallStats[i], 0, sizeof(FunctionStats));
+			CallStats[i].Name = name;
+			CallStats[i].Function = function;
+		}
+		return 0;
+	}
+
 	int releaseRawfile(lua_State* L)
 	{
 		RawFile *rawFile = checkRawFile(L);
@@ -978,8 +4371,124 @@ namespace RawFile {
 		return 0;
 	}
 
+	int matrixSize(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		lua_pushinteger(L, matrix->Rows);
+		lua_pushinteger(L, matrix->Columns);
+		return 2;
+	}
+
+	int matrixGet(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		int row = (int)luaL_checkinteger(L, 2);
+		int column = (int)luaL_checkinteger(L, 3);
+		luaL_argcheck(L, row >= 1 && row <= matrix->Rows, 2, "row out of range");
+		luaL_argcheck(L, column >= 1 && column <= matrix->Columns, 3, "column out of range");
+		lua_pushnumber(L, matrix->Row(row - 1)[column - 1]);
+		return 1;
+	}
+
+	int matrixGetRow(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		int row = (int)luaL_checkinteger(L, 2);
+		luaL_argcheck(L, row >= 1 && row <= matrix->Rows, 2, "row out of range");
+
+		float* values = matrix->Row(row - 1);
+		lua_createtable(L, matrix->Columns, 0);
+		for (int i = 0; i < matrix->Columns; i++)
+		{
+			lua_pushnumber(L, values[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	int matrixSave(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		const char* fileName = luaL_checkstring(L, 2);
+		lua_pushboolean(L, SaveNpy(matrix, fileName));
+		return 1;
+	}
+
+	int matrixLength(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		lua_pushinteger(L, matrix->Rows);
+		return 1;
+	}
+
+	int matrixToString(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		lua_pushfstring(L, "Matrix: %d x %d", matrix->Rows, matrix->Columns);
+		return 1;
+	}
+
+	int releaseMatrix(lua_State* L)
+	{
+		Matrix *matrix = checkMatrix(L);
+		delete matrix;
+		return 0;
+	}
+
+	int libraryGet(lua_State* L)
+	{
+		Library *library = checkLibrary(L, 1);
+		long index = (long)luaL_checkinteger(L, 2);
+		luaL_argcheck(L, index >= 1 && index <= (long)library->Spectra.size(), 2, "entry out of range");
+
+		const LibrarySpectrum& spectrum = library->Spectra[index - 1];
+		lua_createtable(L, 0, 3);
+		luaD_setString(L, spectrum.Name.c_str(), "Name");
+		luaD_setNumber(L, spectrum.PrecursorMz, "PrecursorMz");
+		lua_pushinteger(L, (lua_Integer)spectrum.Peaks.size());
+		lua_setfield(L, -2, "NumPeaks");
+		return 1;
+	}
+
+	int libraryLength(lua_State* L)
+	{
+		Library *library = checkLibrary(L, 1);
+		lua_pushinteger(L, (lua_Integer)library->Spectra.size());
+		return 1;
+	}
+
+	int libraryToString(lua_State* L)
+	{
+		Library *library = checkLibrary(L, 1);
+		lua_pushfstring(L, "Library: %s", library->FileName.c_str());
+		return 1;
+	}
+
+	int releaseLibrary(lua_State* L)
+	{
+		Library *library = checkLibrary(L, 1);
+		delete library;
+		return 0;
+	}
+
 	int Register(lua_State* L)
 	{
+		luaL_newmetatable(L, LibraryType);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -2, "__index");
+		luaL_setfuncs(L, thermo_library_m, 0);
+		lua_pop(L, 1);
+
+		luaL_newmetatable(L, ScanType);
+		luaL_setfuncs(L, thermo_scan_m, 0);
+		lua_pop(L, 1);
+
+		luaL_newmetatable(L, MatrixType);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -2, "__index");
+		luaL_setfuncs(L, thermo_matrix_m, 0);
+		lua_pop(L, 1);
+
 		luaL_newmetatable(L, RawFileType);
 		lua_pushvalue(L, -1);
 		lua_setfield(L, -2, "__index");
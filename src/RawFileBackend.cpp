@@ -0,0 +1,173 @@
+/* RawFileBackend.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "ComBackend.h"
+#include "MemoryBackend.h"
+#include "NativeBackend.h"
+
+namespace RawFile {
+
+	// Code units of wide characters in memory
+	class WideUnits
+	{
+	public:
+		WideUnits(const wchar_t* text) : Text(text) {}
+		unsigned long operator[](size_t i) const { return (unsigned long)Text[i]; }
+	private:
+		const wchar_t* Text;
+	};
+
+	// Code units of little endian UTF-16 bytes
+	class FileUnits
+	{
+	public:
+		FileUnits(const unsigned char* text) : Text(text) {}
+		unsigned long operator[](size_t i) const { return Text[2 * i] | ((unsigned long)Text[2 * i + 1] << 8); }
+	private:
+		const unsigned char* Text;
+	};
+
+	// The code point at i, a surrogate pair is joined and i moved to its second
+	// half.  A lone surrogate, or a wide character beyond Unicode, has no UTF-8
+	// encoding and becomes U+FFFD.
+	template<typename Units> static unsigned long CodePoint(const Units& units, size_t& i, size_t length)
+	{
+		unsigned long c = units[i];
+		if (c >= 0xd800 && c < 0xdc00 && i + 1 < length && units[i + 1] >= 0xdc00 && units[i + 1] < 0xe000)
+			c = 0x10000 + ((c - 0xd800) << 10) + (units[++i] - 0xdc00);
+		else if ((c >= 0xd800 && c < 0xe000) || c > 0x10ffff)
+			c = 0xfffd;
+		return c;
+	}
+
+	// The UTF-8 size is counted first, so the text is written once in place
+	// without regrowing the output however long it is
+	template<typename Units> static void AppendUnits(const Units& units, size_t length, std::string& out)
+	{
+		size_t size = 0;
+		for (size_t i = 0; i < length; i++)
+		{
+			unsigned long c = CodePoint(units, i, length);
+			if (c == 0)
+				break;
+			size += c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+		}
+		if (size == 0)
+			return;
+
+		size_t start = out.size();
+		out.resize(start + size);
+		char* p = &out[start];
+		for (size_t i = 0; i < length; i++)
+		{
+			unsigned long c = CodePoint(units, i, length);
+			if (c == 0)
+				break;
+
+			if (c < 0x80)
+			{
+				*p++ = (char)c;
+			}
+			else if (c < 0x800)
+			{
+				*p++ = (char)(0xc0 | (c >> 6));
+				*p++ = (char)(0x80 | (c & 0x3f));
+			}
+			else if (c < 0x10000)
+			{
+				*p++ = (char)(0xe0 | (c >> 12));
+				*p++ = (char)(0x80 | ((c >> 6) & 0x3f));
+				*p++ = (char)(0x80 | (c & 0x3f));
+			}
+			else
+			{
+				*p++ = (char)(0xf0 | ((c >> 18) & 0x07));
+				*p++ = (char)(0x80 | ((c >> 12) & 0x3f));
+				*p++ = (char)(0x80 | ((c >> 6) & 0x3f));
+				*p++ = (char)(0x80 | (c & 0x3f));
+			}
+		}
+	}
+
+	void AppendUtf8(const wchar_t* text, size_t length, std::string& out)
+	{
+		if (text != NULL)
+			AppendUnits(WideUnits(text), length, out);
+	}
+
+	void AppendUtf8(const unsigned char* text, size_t length, std::string& out)
+	{
+		if (text != NULL)
+			AppendUnits(FileUnits(text), length, out);
+	}
+
+	void AppendWide(const std::string& text, std::wstring& out)
+	{
+		out.reserve(out.size() + text.size());
+		const unsigned char* p = (const unsigned char*)text.data();
+		const unsigned char* end = p + text.size();
+		while (p < end)
+		{
+			unsigned long c = *p++;
+			int more = c >= 0xf0 && c < 0xf5 ? 3 : c >= 0xe0 ? 2 : c >= 0xc2 ? 1 : 0;
+			if (c >= 0xf5 || end - p < more)
+				more = 0;
+			unsigned long code = more == 3 ? c & 0x07 : more == 2 ? c & 0x0f : c & 0x1f;
+			int i = 0;
+			for (; i < more && (p[i] & 0xc0) == 0x80; i++)
+				code = (code << 6) | (p[i] & 0x3f);
+			if (more > 0 && i == more)
+			{
+				c = code;
+				p += more;
+			}
+
+			if (c >= 0x10000 && sizeof(wchar_t) == 2)
+			{
+				out += (wchar_t)(0xd800 + ((c - 0x10000) >> 10));
+				out += (wchar_t)(0xdc00 + ((c - 0x10000) & 0x3ff));
+			}
+			else
+			{
+				out += (wchar_t)c;
+			}
+		}
+	}
+
+	const char* const BackendNames[] = { "com", "memory", "native", NULL };
+
+	RawFileBackend* CreateBackend(const char* name, int& error)
+	{
+		std::string backend = name != NULL ? name : "";
+		error = 0;
+
+		if (backend.empty() || backend == "com")
+		{
+			ComBackend* com = new ComBackend();
+			error = com->Status();
+			if (error != 0)
+			{
+				delete com;
+				return NULL;
+			}
+			return com;
+		}
+
+		if (backend == "native")
+			return new NativeBackend();
+
+		// memory or memory:<reader> loads the whole run through that reader
+		if (backend == "memory")
+			return new MemoryBackend("");
+		if (backend.compare(0, 7, "memory:") == 0)
+			return new MemoryBackend(backend.substr(7));
+
+		return NULL;
+	}
+
+}
@@ -0,0 +1,136 @@
+/* SpectrumStore.cpp
+ *
+ * Copyright (C) 2016 Thermo Fisher Scientific
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ */
+
+#include "SpectrumStore.h"
+#include "Codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace RawFile {
+
+	// Half precision values are scaled to at most this, well inside their range
+	#define STORE_HALF_MAX				32768.0
+
+	SpectrumStore::SpectrumStore(MassCoding masses, IntensityCoding intensities)
+		: Masses(masses), Intensities(intensities), Peaks(0)
+	{
+	}
+
+	bool SpectrumStore::Add(long sn, const std::vector<DataPeak>& peaks, size_t maxBytes)
+	{
+		if (!Numbers.empty() && sn <= Numbers.back())
+			return false;
+
+		size_t count = peaks.size();
+		MassBuffer.resize(count);
+		IntensityBuffer.resize(count);
+		double largest = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			MassBuffer[i] = peaks[i].Mass;
+			IntensityBuffer[i] = peaks[i].Intensity;
+			largest = (std::max)(largest, std::fabs(peaks[i].Intensity));
+		}
+
+		// Start each scan on an 8 byte boundary, for the intensities
+		size_t start = Data.size();
+		size_t offset = (start + 7) & ~(size_t)7;
+		Data.resize(offset);
+
+		StoredScan scan = { offset, 0, count, largest > 0 ? largest / STORE_HALF_MAX : 1 };
+		switch (Intensities)
+		{
+		case IntensityHalf:
+			Data.resize(offset + count * sizeof(unsigned short));
+			EncodeHalf(IntensityBuffer.data(), count, scan.Scale, reinterpret_cast<unsigned short*>(Data.data() + offset));
+			break;
+		case IntensityFloat:
+			Data.resize(offset + count * sizeof(float));
+			EncodeFloat(IntensityBuffer.data(), count, reinterpret_cast<float*>(Data.data() + offset));
+			break;
+		default:
+			Data.resize(offset + count * sizeof(double));
+			if (count > 0)
+				memcpy(&Data[offset], IntensityBuffer.data(), count * sizeof(double));
+			break;
+		}
+
+		if (Masses == MassDelta)
+			EncodeDeltaDoubles(MassBuffer.data(), count, Data);
+		else
+		{
+			size_t masses = Data.size();
+			Data.resize(masses + count * sizeof(double));
+			if (count > 0)
+				memcpy(&Data[masses], MassBuffer.data(), count * sizeof(double));
+		}
+
+		scan.Size = Data.size() - offset;
+		if (Data.size() + (Numbers.size() + 1) * (sizeof(long) + sizeof(StoredScan)) > maxBytes)
+		{
+			Data.resize(start);
+			return false;
+		}
+
+		Numbers.push_back(sn);
+		Stored.push_back(scan);
+		Peaks += count;
+		return true;
+	}
+
+	bool SpectrumStore::Get(long sn, std::vector<DataPeak>& peaks) const
+	{
+		std::vector<long>::const_iterator it = std::lower_bound(Numbers.begin(), Numbers.end(), sn);
+		if (it == Numbers.end() || *it != sn)
+			return false;
+
+		const StoredScan& scan = Stored[it - Numbers.begin()];
+		size_t count = scan.Count;
+		const unsigned char* data = Data.data() + scan.Offset;
+		size_t size = scan.Size;
+		MassBuffer.resize(count);
+		IntensityBuffer.resize(count);
+
+		size_t used = 0;
+		switch (Intensities)
+		{
+		case IntensityHalf:
+			DecodeHalf(reinterpret_cast<const unsigned short*>(data), count, scan.Scale, IntensityBuffer.data());
+			used = count * sizeof(unsigned short);
+			break;
+		case IntensityFloat:
+			DecodeFloat(reinterpret_cast<const float*>(data), count, IntensityBuffer.data());
+			used = count * sizeof(float);
+			break;
+		default:
+			if (count > 0)
+				memcpy(IntensityBuffer.data(), data, count * sizeof(double));
+			used = count * sizeof(double);
+			break;
+		}
+
+		if (Masses == MassDelta)
+		{
+			if (count > 0 && DecodeDeltaDoubles(data + used, size - used, count, MassBuffer.data()) == 0)
+				return false;
+		}
+		else if (count > 0)
+			memcpy(MassBuffer.data(), data + used, count * sizeof(double));
+
+		peaks.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			peaks[i].Mass = MassBuffer[i];
+			peaks[i].Intensity = IntensityBuffer[i];
+		}
+		return true;
+	}
+
+}
@@ -287,7 +287,12 @@ int luaL_fileresult(lua_State *L, int stat, const char *fname) {
 
 		char buff[512];
 
+#ifdef _MSC_VER
 		errno_t er = strerror_s(buff, 512, en);
+#else
+		strncpy(buff, strerror(en), sizeof(buff) - 1);
+		buff[sizeof(buff) - 1] = '\0';
+#endif
 
 		if (fname)
 			lua_pushfstring(L, "%s: %s", fname, buff);